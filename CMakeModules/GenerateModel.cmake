@@ -0,0 +1,373 @@
+# Generate the C model (structs, xpath templates and leaf tables) from a YANG module.
+#
+# Usage: cmake -DYANG_FILE=<module.yang> -DOUTPUT=<header.h> -P GenerateModel.cmake
+#
+# Every list, and every top level container that carries leaves directly, becomes a
+# "model node": a C struct plus a constant table describing its leaves.  Nested
+# containers are embedded into the struct of their parent node.  Subtrees marked
+# `config false`, notifications and rpcs are runtime data and are not generated.
+#
+# The parser only understands the YANG subset used by the plugin's own module.
+
+if(POLICY CMP0054)
+  cmake_policy(SET CMP0054 NEW)
+endif()
+
+if(NOT YANG_FILE OR NOT OUTPUT)
+  message(FATAL_ERROR "GenerateModel.cmake: YANG_FILE and OUTPUT must be set")
+endif()
+
+# Struct names that differ from the YANG node name.
+set(STRUCT_NAME_dhcp-leases "dhcp_lease")
+
+file(READ "${YANG_FILE}" yang)
+get_filename_component(yang_name "${YANG_FILE}" NAME)
+
+# Make the text safe for CMake lists before tokenizing.
+string(REGEX REPLACE "//[^\n]*" "" yang "${yang}")
+string(REPLACE "[" "(" yang "${yang}")
+string(REPLACE "]" ")" yang "${yang}")
+string(REPLACE "\\" "" yang "${yang}")
+string(REPLACE ";" " @SEMI@ " yang "${yang}")
+string(REGEX MATCHALL "\"[^\"]*\"|[{}]|@SEMI@|[^ \t\r\n{}\"]+" tokens "${yang}")
+
+set(depth 0)
+set(module "")
+set(nodes "")
+set(pending_keyword "")
+set(pending_arg "")
+set(have_arg FALSE)
+# Depth of the statement whose content is being skipped, -1 when none.
+set(skip_depth -1)
+
+macro(c_ident out name)
+  string(REPLACE "-" "_" ${out} "${name}")
+endmacro()
+
+macro(upper_ident out name)
+  c_ident(${out} "${name}")
+  string(TOUPPER "${${out}}" ${out})
+endmacro()
+
+macro(sr_type out yang_type)
+  if("${yang_type}" STREQUAL "boolean")
+    set(${out} "SR_BOOL_T")
+  elseif("${yang_type}" MATCHES "^u?int(8|16|32|64)$")
+    string(TOUPPER "${yang_type}" _t)
+    set(${out} "SR_${_t}_T")
+  elseif("${yang_type}" STREQUAL "enumeration")
+    set(${out} "SR_ENUM_T")
+  else()
+    set(${out} "SR_STRING_T")
+  endif()
+endmacro()
+
+macro(c_type out yang_type)
+  if("${yang_type}" STREQUAL "boolean")
+    set(${out} "bool ")
+  elseif("${yang_type}" MATCHES "^(u?int(8|16|32|64))$")
+    set(${out} "${CMAKE_MATCH_1}_t ")
+  else()
+    set(${out} "char *")
+  endif()
+endmacro()
+
+# Open a block statement and record the data node it declares, if any.
+macro(open_statement keyword arg)
+  math(EXPR depth "${depth} + 1")
+  set(frame_${depth}_keyword "${keyword}")
+  set(frame_${depth}_arg "${arg}")
+  set(frame_${depth}_node "")
+
+  if(skip_depth EQUAL -1)
+    if("${keyword}" MATCHES "^(notification|rpc|action|grouping|augment)$")
+      set(skip_depth ${depth})
+    elseif("${keyword}" MATCHES "^(container|list|leaf|leaf-list)$")
+      math(EXPR parent "${depth} - 1")
+      set(parent_xpath "${frame_${parent}_xpath}")
+      set(parent_node "${frame_${parent}_node}")
+      set(parent_rel "${frame_${parent}_rel}")
+      if("${parent_xpath}" STREQUAL "")
+        set(frame_${depth}_xpath "/${module}:${arg}")
+      else()
+        set(frame_${depth}_xpath "${parent_xpath}/${arg}")
+      endif()
+
+      if("${keyword}" STREQUAL "list")
+        set(frame_${depth}_node "${arg}")
+        set(frame_${depth}_rel "")
+        list(APPEND nodes "${arg}")
+        set(node_${arg}_kind "list")
+        set(node_${arg}_xpath "${frame_${depth}_xpath}")
+        set(node_${arg}_key "")
+        set(node_${arg}_members "")
+        set(node_${arg}_leaves "")
+      elseif("${keyword}" STREQUAL "container")
+        if("${parent_node}" STREQUAL "")
+          # Top level container; becomes a node once it holds a leaf.
+          set(frame_${depth}_node "${arg}")
+          set(frame_${depth}_rel "")
+          set(node_${arg}_kind "container")
+          set(node_${arg}_xpath "${frame_${depth}_xpath}")
+          set(node_${arg}_key "")
+          set(node_${arg}_members "")
+          set(node_${arg}_leaves "")
+          else()
+          # Nested container, embedded into the parent node struct.
+          set(frame_${depth}_node "${parent_node}")
+          if("${parent_rel}" STREQUAL "")
+            set(frame_${depth}_rel "${arg}")
+          else()
+            set(frame_${depth}_rel "${parent_rel}/${arg}")
+          endif()
+          set(container_${arg}_members "")
+          list(APPEND node_${parent_node}_subs "${arg}")
+          set(frame_${depth}_sub "${arg}")
+        endif()
+      else()
+        set(frame_${depth}_node "${parent_node}")
+        set(frame_${depth}_rel "${parent_rel}")
+        set(frame_${depth}_leaf_type "string")
+        set(frame_${depth}_list_leaf FALSE)
+        if("${keyword}" STREQUAL "leaf-list")
+          set(frame_${depth}_list_leaf TRUE)
+        endif()
+      endif()
+    endif()
+  endif()
+endmacro()
+
+# Close a block statement; leaves are registered with their node here.
+macro(close_statement)
+  if(skip_depth EQUAL -1)
+    set(keyword "${frame_${depth}_keyword}")
+    set(arg "${frame_${depth}_arg}")
+    set(node "${frame_${depth}_node}")
+    if("${keyword}" MATCHES "^leaf(-list)?$" AND NOT "${node}" STREQUAL "")
+      set(rel "${frame_${depth}_rel}")
+      math(EXPR parent "${depth} - 1")
+      if("${rel}" STREQUAL "")
+        set(path "${arg}")
+        set(field "")
+      else()
+        set(path "${rel}/${arg}")
+        string(REPLACE "/" "." field "${rel}")
+        c_ident(field "${field}")
+        set(field "${field}.")
+      endif()
+      c_ident(leaf_ident "${arg}")
+      list(APPEND node_${node}_leaves "${arg}")
+      set(leaf_${node}_${arg}_path "${path}")
+      set(leaf_${node}_${arg}_field "${field}${leaf_ident}")
+      set(leaf_${node}_${arg}_type "${frame_${depth}_leaf_type}")
+      set(leaf_${node}_${arg}_list ${frame_${depth}_list_leaf})
+      if(NOT "${frame_${parent}_sub}" STREQUAL "" AND NOT "${rel}" STREQUAL "")
+        list(APPEND container_${frame_${parent}_sub}_members "${arg}")
+      else()
+        list(APPEND node_${node}_members "${arg}")
+      endif()
+      if("${node_${node}_kind}" STREQUAL "container")
+        list(FIND nodes "${node}" idx)
+        if(idx EQUAL -1)
+          list(APPEND nodes "${node}")
+        endif()
+      endif()
+    endif()
+  endif()
+  if(depth EQUAL skip_depth)
+    set(skip_depth -1)
+  endif()
+  set(frame_${depth}_sub "")
+  math(EXPR depth "${depth} - 1")
+endmacro()
+
+# Statements that carry properties of the enclosing node.
+macro(simple_statement keyword arg)
+  if(skip_depth EQUAL -1)
+    set(node "${frame_${depth}_node}")
+    if("${keyword}" STREQUAL "key" AND "${frame_${depth}_keyword}" STREQUAL "list")
+      set(node_${node}_key "${arg}")
+    elseif("${keyword}" STREQUAL "type" AND "${frame_${depth}_keyword}" MATCHES "^leaf(-list)?$")
+      set(frame_${depth}_leaf_type "${arg}")
+    elseif("${keyword}" STREQUAL "config" AND "${arg}" STREQUAL "false")
+      # Runtime subtree: forget anything collected for it and skip its content.
+      if("${frame_${depth}_keyword}" MATCHES "^(container|list)$"
+          AND "${frame_${depth}_arg}" STREQUAL "${node}")
+        list(REMOVE_ITEM nodes "${node}")
+        set(node_${node}_kind "runtime")
+      elseif("${frame_${depth}_keyword}" STREQUAL "container")
+        math(EXPR parent "${depth} - 1")
+        list(REMOVE_ITEM node_${frame_${parent}_node}_subs "${frame_${depth}_arg}")
+      endif()
+      set(skip_depth ${depth})
+    endif()
+  endif()
+endmacro()
+
+foreach(tok IN LISTS tokens)
+  string(REGEX REPLACE "^\"(.*)\"$" "\\1" value "${tok}")
+  if("${tok}" STREQUAL "{")
+    if("${pending_keyword}" STREQUAL "module")
+      set(module "${pending_arg}")
+    endif()
+    if("${pending_keyword}" STREQUAL "type")
+      simple_statement("${pending_keyword}" "${pending_arg}")
+    endif()
+    open_statement("${pending_keyword}" "${pending_arg}")
+    set(pending_keyword "")
+    set(have_arg FALSE)
+  elseif("${tok}" STREQUAL "}")
+    close_statement()
+  elseif("${tok}" STREQUAL "@SEMI@")
+    simple_statement("${pending_keyword}" "${pending_arg}")
+    set(pending_keyword "")
+    set(have_arg FALSE)
+  elseif("${pending_keyword}" STREQUAL "")
+    set(pending_keyword "${value}")
+    set(pending_arg "")
+  elseif(NOT have_arg)
+    set(pending_arg "${value}")
+    set(have_arg TRUE)
+  endif()
+endforeach()
+
+if("${module}" STREQUAL "")
+  message(FATAL_ERROR "GenerateModel.cmake: no module statement in ${YANG_FILE}")
+endif()
+
+# Emit the header.
+set(out "/*\n * Generated from ${yang_name} by CMakeModules/GenerateModel.cmake.\n")
+string(APPEND out " * Do not edit; change the YANG module instead.\n */\n\n")
+string(APPEND out "#ifndef STATUS_MODEL_H\n#define STATUS_MODEL_H\n\n")
+string(APPEND out "#include <stdbool.h>\n#include <stddef.h>\n#include <stdint.h>\n")
+string(APPEND out "#include <libubox/list.h>\n#include \"sysrepo.h\"\n\n")
+string(APPEND out "#define MODEL_MODULE \"${module}\"\n\n")
+
+foreach(node IN LISTS nodes)
+  if(DEFINED STRUCT_NAME_${node})
+    set(struct_${node} "${STRUCT_NAME_${node}}")
+  else()
+    c_ident(struct_${node} "${node}")
+  endif()
+
+  foreach(sub IN LISTS node_${node}_subs)
+    c_ident(sub_ident "${sub}")
+    string(APPEND out "struct ${sub_ident} {\n")
+    foreach(leaf IN LISTS container_${sub}_members)
+      c_type(ct "${leaf_${node}_${leaf}_type}")
+      c_ident(leaf_ident "${leaf}")
+      string(APPEND out "    ${ct}${leaf_ident};\n")
+    endforeach()
+    string(APPEND out "};\n\n")
+  endforeach()
+
+  string(APPEND out "struct ${struct_${node}} {\n")
+  if("${node_${node}_kind}" STREQUAL "list")
+    string(APPEND out "    struct list_head head;\n")
+  endif()
+  foreach(leaf IN LISTS node_${node}_members)
+    c_type(ct "${leaf_${node}_${leaf}_type}")
+    c_ident(leaf_ident "${leaf}")
+    string(APPEND out "    ${ct}${leaf_ident};\n")
+  endforeach()
+  foreach(sub IN LISTS node_${node}_subs)
+    c_ident(sub_ident "${sub}")
+    string(APPEND out "    struct ${sub_ident} ${sub_ident};\n")
+  endforeach()
+  string(APPEND out "};\n\n")
+endforeach()
+
+string(APPEND out "/* Leaf flags. */\n")
+string(APPEND out "#define MODEL_LEAF_KEY  0x1 /* list key, addressed by the list predicate */\n")
+string(APPEND out "#define MODEL_LEAF_LIST 0x2 /* leaf-list */\n\n")
+string(APPEND out "/* Leaf of a model node, stored at offset in the node's struct. */\n")
+string(APPEND out "struct model_leaf {\n")
+string(APPEND out "    const char *name;   /* YANG leaf name, also the UCI option name */\n")
+string(APPEND out "    const char *path;   /* xpath relative to the node */\n")
+string(APPEND out "    const char *xpath;  /* absolute xpath; lists take the key value as %s */\n")
+string(APPEND out "    size_t offset;\n")
+string(APPEND out "    sr_type_t type;\n")
+string(APPEND out "    int flags;\n")
+string(APPEND out "};\n\n")
+string(APPEND out "/* List or top level container of the module. */\n")
+string(APPEND out "struct model_node {\n")
+string(APPEND out "    const char *name;   /* YANG node name, also the UCI section type */\n")
+string(APPEND out "    const char *xpath;  /* absolute schema xpath */\n")
+string(APPEND out "    const char *key;    /* key leaf for lists, NULL for containers */\n")
+string(APPEND out "    const struct model_leaf *leaves;\n")
+string(APPEND out "    size_t n_leaves;\n")
+string(APPEND out "    size_t size;        /* size of the node struct */\n")
+string(APPEND out "};\n\n")
+
+string(APPEND out "enum model_node_id {\n")
+foreach(node IN LISTS nodes)
+  upper_ident(node_upper "${node}")
+  string(APPEND out "    MODEL_${node_upper},\n")
+endforeach()
+string(APPEND out "    MODEL_NODE_COUNT\n};\n\n")
+
+foreach(node IN LISTS nodes)
+  c_ident(node_ident "${node}")
+  upper_ident(node_upper "${node}")
+  set(key "${node_${node}_key}")
+  if("${key}" STREQUAL "")
+    set(prefix "${node_${node}_xpath}")
+  else()
+    set(prefix "${node_${node}_xpath}[${key}='%s']")
+  endif()
+
+  list(LENGTH node_${node}_leaves n_leaves)
+  string(APPEND out "enum model_${node_ident}_leaf {\n")
+  foreach(leaf IN LISTS node_${node}_leaves)
+    upper_ident(leaf_upper "${leaf}")
+    string(APPEND out "    ${node_upper}_${leaf_upper},\n")
+  endforeach()
+  string(APPEND out "};\n\n")
+
+  string(APPEND out "static const struct model_leaf model_${node_ident}_leaves[${n_leaves}] = {\n")
+  foreach(leaf IN LISTS node_${node}_leaves)
+    sr_type(st "${leaf_${node}_${leaf}_type}")
+    set(flags "0")
+    if("${leaf}" STREQUAL "${key}")
+      set(flags "MODEL_LEAF_KEY")
+    elseif(leaf_${node}_${leaf}_list)
+      set(flags "MODEL_LEAF_LIST")
+    endif()
+    set(path "${leaf_${node}_${leaf}_path}")
+    string(APPEND out "    { \"${leaf}\", \"${path}\", \"${prefix}/${path}\",\n")
+    string(APPEND out "      offsetof(struct ${struct_${node}}, ${leaf_${node}_${leaf}_field}), ${st}, ${flags} },\n")
+  endforeach()
+  string(APPEND out "};\n\n")
+endforeach()
+
+string(APPEND out "static const struct model_node model_nodes[MODEL_NODE_COUNT] = {\n")
+foreach(node IN LISTS nodes)
+  c_ident(node_ident "${node}")
+  upper_ident(node_upper "${node}")
+  set(key "${node_${node}_key}")
+  if("${key}" STREQUAL "")
+    set(key "NULL")
+  else()
+    set(key "\"${key}\"")
+  endif()
+  string(APPEND out "    [MODEL_${node_upper}] = { \"${node}\", \"${node_${node}_xpath}\", ${key},\n")
+  string(APPEND out "        model_${node_ident}_leaves,\n")
+  string(APPEND out "        sizeof(model_${node_ident}_leaves) / sizeof(model_${node_ident}_leaves[0]),\n")
+  string(APPEND out "        sizeof(struct ${struct_${node}}) },\n")
+endforeach()
+string(APPEND out "};\n\n")
+
+string(APPEND out "/* String value of a leaf in a node struct. */\n")
+string(APPEND out "#define MODEL_LEAF_STR(obj, leaf) (*(char **) ((char *) (obj) + (leaf)->offset))\n\n")
+string(APPEND out "/* Leaves stored as strings, enumerations included. */\n")
+string(APPEND out "#define MODEL_LEAF_IS_STR(leaf) ((leaf)->type == SR_STRING_T || (leaf)->type == SR_ENUM_T)\n\n")
+string(APPEND out "#endif /* STATUS_MODEL_H */\n")
+
+# Only touch the output when it changes so dependants are not rebuilt needlessly.
+if(EXISTS "${OUTPUT}")
+  file(READ "${OUTPUT}" previous)
+  if("${previous}" STREQUAL "${out}")
+    return()
+  endif()
+endif()
+file(WRITE "${OUTPUT}" "${out}")
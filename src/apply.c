@@ -0,0 +1,334 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apply.h"
+
+static void
+timespec_add_ms(struct timespec *ts, uint32_t ms)
+{
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long) (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static bool
+timespec_before(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+struct apply_set *
+apply_set_new(void)
+{
+    struct apply_set *set = calloc(1, sizeof(*set));
+
+    if (set) {
+        INIT_LIST_HEAD(&set->changes);
+    }
+
+    return set;
+}
+
+/**
+ * @brief Record one change in the set.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_NOMEM otherwise.
+ */
+int
+apply_set_add(struct apply_set *set, enum model_node_id node, const char *key,
+              const struct model_leaf *leaf, sr_change_oper_t oper, const char *value)
+{
+    struct apply_change *change = calloc(1, sizeof(*change));
+
+    if (!change) {
+        return SR_ERR_NOMEM;
+    }
+
+    change->node = node;
+    change->leaf = leaf;
+    change->oper = oper;
+    change->key = strdup(key);
+    change->value = value ? strdup(value) : NULL;
+    if (!change->key || (value && !change->value)) {
+        free(change->key);
+        free(change->value);
+        free(change);
+        return SR_ERR_NOMEM;
+    }
+    list_add_tail(&change->head, &set->changes);
+
+    return SR_ERR_OK;
+}
+
+void
+apply_set_free(struct apply_set *set)
+{
+    struct apply_change *change, *tmp;
+
+    list_for_each_entry_safe(change, tmp, &set->changes, head) {
+        list_del(&change->head);
+        free(change->key);
+        free(change->value);
+        free(change);
+    }
+    free(set);
+}
+
+/* Both sets hold the same changes in the same order. */
+bool
+apply_set_equal(const struct apply_set *a, const struct apply_set *b)
+{
+    const struct list_head *pa, *pb;
+    const struct apply_change *ca, *cb;
+
+    for (pa = a->changes.next, pb = b->changes.next; pa != &a->changes && pb != &b->changes;
+         pa = pa->next, pb = pb->next) {
+        ca = list_entry(pa, struct apply_change, head);
+        cb = list_entry(pb, struct apply_change, head);
+        if (ca->node != cb->node || ca->leaf != cb->leaf || ca->oper != cb->oper ||
+            strcmp(ca->key, cb->key) || !ca->value != !cb->value ||
+            (ca->value && strcmp(ca->value, cb->value))) {
+            return false;
+        }
+    }
+
+    return pa == &a->changes && pb == &b->changes;
+}
+
+/* Remember the outcome of a change set, called with the lock held. */
+static void
+apply_queue_record(struct apply_queue *q, struct apply_set *set, size_t merged)
+{
+    struct apply_result *result = &q->results[q->n_results++ % APPLY_RESULTS_LEN];
+
+    result->id = set->id;
+    result->rc = set->rc;
+    result->merged = merged;
+    result->completed = time(NULL);
+
+    if (set->rc) {
+        q->n_failed++;
+    } else {
+        q->n_applied++;
+    }
+}
+
+/* Apply everything pending as one merged flush, called with the lock held. */
+static void
+apply_queue_flush(struct apply_queue *q)
+{
+    struct list_head sets = LIST_HEAD_INIT(sets);
+    struct apply_set *set, *tmp;
+    size_t n_sets;
+    int rc;
+
+    list_splice_init(&q->pending, &sets);
+    n_sets = q->n_pending;
+    q->n_pending = 0;
+    q->applying = true;
+    q->generation++;
+    pthread_mutex_unlock(&q->lock);
+
+    rc = q->flush(&sets, q->priv);
+
+    pthread_mutex_lock(&q->lock);
+    list_for_each_entry_safe(set, tmp, &sets, head) {
+        if (rc && !set->rc) {
+            set->rc = rc;
+        }
+        fprintf(stderr, "apply #%lu: %s (%zu change sets in one commit)\n",
+                set->id, set->rc ? "failed" : "done", n_sets);
+        apply_queue_record(q, set, n_sets);
+        list_del(&set->head);
+        apply_set_free(set);
+    }
+    q->applying = false;
+    q->generation++;
+}
+
+static void *
+apply_worker(void *arg)
+{
+    struct apply_queue *q = arg;
+    struct timespec now, deadline, latest;
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->stop) {
+        if (list_empty(&q->pending)) {
+            pthread_cond_wait(&q->cond, &q->lock);
+            continue;
+        }
+
+        deadline = q->last_push;
+        timespec_add_ms(&deadline, q->quiet_window_ms);
+        latest = q->first_push;
+        timespec_add_ms(&latest, q->max_delay_ms);
+        if (timespec_before(&latest, &deadline)) {
+            deadline = latest;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timespec_before(&now, &deadline)) {
+            /* More changes may follow, wait until the window stays quiet or the delay ran out. */
+            pthread_cond_timedwait(&q->cond, &q->lock, &deadline);
+            continue;
+        }
+
+        apply_queue_flush(q);
+    }
+
+    /* Do not lose changes accepted before shutdown. */
+    if (!list_empty(&q->pending)) {
+        apply_queue_flush(q);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Start the apply worker.
+ *
+ * @param[in] quiet_window_ms Time without new change sets before they are applied.
+ * @param[in] flush Callback applying the merged change sets.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_INTERNAL when the thread can not be started.
+ */
+int
+apply_queue_start(struct apply_queue *q, uint32_t quiet_window_ms,
+                  apply_flush_cb flush, void *priv)
+{
+    pthread_condattr_t attr;
+    int rc;
+
+    INIT_LIST_HEAD(&q->pending);
+    q->quiet_window_ms = quiet_window_ms;
+    q->max_delay_ms = APPLY_MAX_DELAY_MS;
+    q->flush = flush;
+    q->priv = priv;
+    q->next_id = 1;
+    q->stop = false;
+
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&q->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    rc = pthread_create(&q->thread, NULL, apply_worker, q);
+    if (rc) {
+        fprintf(stderr, "Can't start apply worker: %s\n", strerror(rc));
+        pthread_cond_destroy(&q->cond);
+        pthread_mutex_destroy(&q->lock);
+        return SR_ERR_INTERNAL;
+    }
+    q->running = true;
+
+    return SR_ERR_OK;
+}
+
+/* Stop the worker, pending change sets are applied first. */
+void
+apply_queue_stop(struct apply_queue *q)
+{
+    if (!q->running) {
+        return;
+    }
+
+    pthread_mutex_lock(&q->lock);
+    q->stop = true;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+
+    pthread_join(q->thread, NULL);
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->lock);
+    q->running = false;
+}
+
+void
+apply_queue_set_window(struct apply_queue *q, uint32_t quiet_window_ms)
+{
+    pthread_mutex_lock(&q->lock);
+    q->quiet_window_ms = quiet_window_ms;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * @brief Reserve a slot for a verified commit.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_OPERATION_FAILED when the queue is full.
+ */
+int
+apply_queue_reserve(struct apply_queue *q)
+{
+    int rc = SR_ERR_OK;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->n_pending + q->n_reserved >= APPLY_QUEUE_LEN) {
+        rc = SR_ERR_OPERATION_FAILED;
+    } else {
+        q->n_reserved++;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return rc;
+}
+
+/* Give back a reserved slot of an aborted or empty commit. */
+void
+apply_queue_release(struct apply_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->n_reserved) {
+        q->n_reserved--;
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+/*
+ * Queue a change set, the queue takes ownership. The set uses the slot reserved
+ * at verification; accepted changes are never dropped.
+ */
+void
+apply_queue_push(struct apply_queue *q, struct apply_set *set)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->n_reserved) {
+        q->n_reserved--;
+    }
+    q->n_pending++;
+    q->generation++;
+    set->id = q->next_id++;
+    clock_gettime(CLOCK_MONOTONIC, &q->last_push);
+    if (list_empty(&q->pending)) {
+        q->first_push = q->last_push;
+    }
+    list_add_tail(&set->head, &q->pending);
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void
+apply_queue_status(struct apply_queue *q, struct apply_status *status)
+{
+    unsigned long i, first;
+
+    pthread_mutex_lock(&q->lock);
+    status->pending = q->n_pending;
+    status->applying = q->applying;
+    status->applied = q->n_applied;
+    status->failed = q->n_failed;
+    status->generation = q->generation;
+
+    first = q->n_results > APPLY_RESULTS_LEN ? q->n_results - APPLY_RESULTS_LEN : 0;
+    status->n_results = q->n_results - first;
+    for (i = first; i < q->n_results; i++) {
+        status->results[i - first] = q->results[i % APPLY_RESULTS_LEN];
+    }
+    pthread_mutex_unlock(&q->lock);
+}
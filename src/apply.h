@@ -0,0 +1,104 @@
+#ifndef APPLY_H
+#define APPLY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "status.h"
+
+#define APPLY_QUEUE_LEN 16    /* change sets accepted while others wait to be applied */
+#define APPLY_RESULTS_LEN 16  /* latest results kept for apply-status */
+#define APPLY_MAX_DELAY_MS 10000  /* longest a change set waits for the window to close */
+
+/* One changed leaf or list entry of a writable list. */
+struct apply_change {
+    struct list_head head;
+    enum model_node_id node;
+    char *key;                      /* key of the list entry (UCI section name) */
+    const struct model_leaf *leaf;  /* NULL when the list entry itself changed */
+    sr_change_oper_t oper;
+    char *value;                    /* new value, the removed one for deleted leaf-list items */
+};
+
+/* Changes of one sysrepo commit. */
+struct apply_set {
+    struct list_head head;
+    unsigned long id;
+    struct list_head changes;
+    int rc;                         /* result, set by the flush callback */
+};
+
+/* Outcome of one change set. */
+struct apply_result {
+    unsigned long id;
+    int rc;
+    size_t merged;                  /* change sets applied in the same commit */
+    time_t completed;
+};
+
+/* Snapshot of the queue for the apply-status node. */
+struct apply_status {
+    size_t pending;
+    bool applying;
+    unsigned long applied;
+    unsigned long failed;
+    size_t n_results;
+    struct apply_result results[APPLY_RESULTS_LEN];  /* oldest first */
+    unsigned long generation;
+};
+
+/**
+ * Merge all queued change sets into one apply.
+ * Sets that fail get their rc set, the return value applies to all of them.
+ */
+typedef int (*apply_flush_cb)(struct list_head *sets, void *priv);
+
+/*
+ * Change sets are queued by the sysrepo callback and applied by a worker thread
+ * once no new set arrived for the quiet window, so the callback never blocks on
+ * UCI or the reload. A steady stream of sets is applied at the latest the max
+ * delay after the first of them. The queue is bounded: a slot is reserved when a
+ * commit is verified and commits are refused while all slots are taken.
+ */
+struct apply_queue {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct list_head pending;
+    struct timespec first_push;     /* of the oldest pending set */
+    struct timespec last_push;
+    uint32_t quiet_window_ms;
+    uint32_t max_delay_ms;
+    unsigned long next_id;
+    size_t n_pending;
+    size_t n_reserved;
+    bool applying;
+    unsigned long n_applied;
+    unsigned long n_failed;
+    unsigned long n_results;
+    struct apply_result results[APPLY_RESULTS_LEN];  /* ring, indexed by n_results */
+    unsigned long generation;       /* bumped whenever the reported status changes */
+    bool running;
+    bool stop;
+
+    apply_flush_cb flush;
+    void *priv;
+};
+
+int apply_queue_start(struct apply_queue *q, uint32_t quiet_window_ms,
+                      apply_flush_cb flush, void *priv);
+void apply_queue_stop(struct apply_queue *q);
+void apply_queue_set_window(struct apply_queue *q, uint32_t quiet_window_ms);
+int apply_queue_reserve(struct apply_queue *q);
+void apply_queue_release(struct apply_queue *q);
+void apply_queue_push(struct apply_queue *q, struct apply_set *set);
+void apply_queue_status(struct apply_queue *q, struct apply_status *status);
+
+struct apply_set *apply_set_new(void);
+int apply_set_add(struct apply_set *set, enum model_node_id node, const char *key,
+                  const struct model_leaf *leaf, sr_change_oper_t oper, const char *value);
+void apply_set_free(struct apply_set *set);
+bool apply_set_equal(const struct apply_set *a, const struct apply_set *b);
+
+#endif /* APPLY_H */
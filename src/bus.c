@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libubox/blobmsg.h>
+#include "bus.h"
+
+static void
+bus_forget_ids(struct bus *b)
+{
+    size_t i;
+
+    for (i = 0; i < b->n_ids; i++) {
+        free(b->ids[i].name);
+    }
+    b->n_ids = 0;
+}
+
+/*
+ * An object came or went; ids of removed objects may be reused and a cached
+ * miss may exist now. Runs inside the ubus calls of the thread holding the bus.
+ */
+static void
+bus_object_cb(struct ubus_context *ctx, struct ubus_event_handler *ev, const char *type,
+              struct blob_attr *msg)
+{
+    static const struct blobmsg_policy policy[] = {
+        {.name = "path", .type = BLOBMSG_TYPE_STRING},
+    };
+    struct bus *b = container_of(ev, struct bus, objects);
+    struct blob_attr *tb[1];
+
+    if (!msg) {
+        return;
+    }
+    blobmsg_parse(policy, 1, tb, blob_data(msg), blob_len(msg));
+    if (tb[0]) {
+        bus_forget(b, blobmsg_get_string(tb[0]));
+    }
+}
+
+/* Wait after one more failed connect: the minimum first, then twice as long up to the maximum. */
+uint32_t
+bus_backoff_next(uint32_t backoff_ms)
+{
+    if (!backoff_ms) {
+        return BUS_BACKOFF_MIN_MS;
+    }
+    if (backoff_ms < BUS_BACKOFF_MAX_MS / 2) {
+        return backoff_ms * 2;
+    }
+
+    return BUS_BACKOFF_MAX_MS;
+}
+
+/* Connect unless the last attempt failed too recently, called with the lock held. */
+static void
+bus_connect(struct bus *b)
+{
+    struct ubus_context *ctx;
+    struct timespec now;
+    int rc;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (b->backoff_ms && (now.tv_sec < b->retry.tv_sec ||
+                          (now.tv_sec == b->retry.tv_sec && now.tv_nsec < b->retry.tv_nsec))) {
+        return;
+    }
+
+    ctx = ubus_connect(NULL);
+    if (ctx) {
+        memset(&b->objects, 0, sizeof(b->objects));
+        b->objects.cb = bus_object_cb;
+        /* Without the events cached ids could not be trusted. */
+        rc = ubus_register_event_handler(ctx, &b->objects, "ubus.object.*");
+        if (UBUS_STATUS_OK != rc) {
+            fprintf(stderr, "ubus [%d]: can't follow objects\n", rc);
+            ubus_free(ctx);
+            ctx = NULL;
+        }
+    }
+    if (!ctx) {
+        b->backoff_ms = bus_backoff_next(b->backoff_ms);
+        b->retry.tv_sec = now.tv_sec + b->backoff_ms / 1000;
+        b->retry.tv_nsec = now.tv_nsec + (b->backoff_ms % 1000) * 1000000L;
+        if (b->retry.tv_nsec >= 1000000000L) {
+            b->retry.tv_sec++;
+            b->retry.tv_nsec -= 1000000000L;
+        }
+        fprintf(stderr, "Can't connect to ubus, next attempt in %u ms\n", b->backoff_ms);
+        return;
+    }
+
+    b->ctx = ctx;
+    b->backoff_ms = 0;
+    if (b->connects++) {
+        fprintf(stderr, "Reconnected to ubus\n");
+    }
+}
+
+/* ubusd went away, the next bus_get() reconnects. Called with the lock held. */
+static void
+bus_drop(struct bus *b)
+{
+    fprintf(stderr, "Lost ubus connection\n");
+    ubus_free(b->ctx);
+    b->ctx = NULL;
+    bus_forget_ids(b);
+}
+
+void
+bus_init(struct bus *b)
+{
+    memset(b, 0, sizeof(*b));
+    pthread_mutex_init(&b->lock, NULL);
+
+    pthread_mutex_lock(&b->lock);
+    bus_connect(b);
+    pthread_mutex_unlock(&b->lock);
+}
+
+void
+bus_free(struct bus *b)
+{
+    if (b->ctx) {
+        ubus_free(b->ctx);
+        b->ctx = NULL;
+    }
+    bus_forget_ids(b);
+    pthread_mutex_destroy(&b->lock);
+}
+
+/**
+ * @brief Take the connection for a series of calls.
+ *
+ * Object events received since the last use are applied first. Every
+ * successful call must be paired with bus_put().
+ *
+ * @return Connected context, NULL without ubus (the bus is not taken then).
+ */
+struct ubus_context *
+bus_get(struct bus *b)
+{
+    pthread_mutex_lock(&b->lock);
+    if (b->ctx) {
+        ubus_handle_event(b->ctx);
+        if (b->ctx->sock.eof) {
+            bus_drop(b);
+        }
+    }
+    if (!b->ctx) {
+        bus_connect(b);
+    }
+    if (!b->ctx) {
+        pthread_mutex_unlock(&b->lock);
+        return NULL;
+    }
+
+    return b->ctx;
+}
+
+/* Give the connection back, dropping it when ubusd closed it during the calls. */
+void
+bus_put(struct bus *b)
+{
+    if (b->ctx && b->ctx->sock.eof) {
+        bus_drop(b);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+/**
+ * @brief Id of a ubus object, called between bus_get() and bus_put().
+ *
+ * Found and missing objects are both remembered until ubusd announces a change.
+ *
+ * @return UBUS_STATUS_OK, UBUS_STATUS_NOT_FOUND or another ubus status.
+ */
+int
+bus_lookup(struct bus *b, const char *name, uint32_t *id)
+{
+    struct bus_id *cached;
+    size_t i;
+    int rc;
+
+    for (i = 0; i < b->n_ids; i++) {
+        if (!strcmp(b->ids[i].name, name)) {
+            *id = b->ids[i].id;
+            return b->ids[i].found ? UBUS_STATUS_OK : UBUS_STATUS_NOT_FOUND;
+        }
+    }
+
+    rc = ubus_lookup_id(b->ctx, name, id);
+    if ((UBUS_STATUS_OK == rc || UBUS_STATUS_NOT_FOUND == rc) && b->n_ids < BUS_IDS_LEN) {
+        cached = &b->ids[b->n_ids];
+        cached->name = strdup(name);
+        if (cached->name) {
+            cached->id = UBUS_STATUS_OK == rc ? *id : 0;
+            cached->found = UBUS_STATUS_OK == rc;
+            b->n_ids++;
+        }
+    }
+
+    return rc;
+}
+
+/* A call found the object gone before its event arrived. */
+void
+bus_forget(struct bus *b, const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < b->n_ids; i++) {
+        if (!strcmp(b->ids[i].name, name)) {
+            free(b->ids[i].name);
+            b->ids[i] = b->ids[--b->n_ids];
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Call a method and wait for its reply.
+ *
+ * @return UBUS_STATUS_OK on success, UBUS_STATUS_CONNECTION_FAILED without
+ *         ubus, otherwise the ubus status of the lookup or call.
+ */
+int
+bus_invoke(struct bus *b, const char *object, const char *method, struct blob_attr *msg,
+           ubus_data_handler_t cb, void *priv, int timeout)
+{
+    struct ubus_context *ctx;
+    uint32_t id;
+    int rc;
+
+    ctx = bus_get(b);
+    if (!ctx) {
+        return UBUS_STATUS_CONNECTION_FAILED;
+    }
+    rc = bus_lookup(b, object, &id);
+    if (UBUS_STATUS_OK == rc) {
+        rc = ubus_invoke(ctx, id, method, msg, cb, priv, timeout);
+        if (UBUS_STATUS_NOT_FOUND == rc) {
+            bus_forget(b, object);
+        }
+    }
+    bus_put(b);
+
+    return rc;
+}
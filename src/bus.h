@@ -0,0 +1,50 @@
+#ifndef BUS_H
+#define BUS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <libubus.h>
+
+#define BUS_IDS_LEN 64                  /* ubus object ids kept */
+#define BUS_BACKOFF_MIN_MS 250          /* first wait after a failed connect */
+#define BUS_BACKOFF_MAX_MS 30000
+
+/* Object id looked up once; an object that was not found is kept with found unset. */
+struct bus_id {
+    char *name;
+    uint32_t id;
+    bool found;
+};
+
+/*
+ * ubus connection shared by all collectors. It is reconnected on first use
+ * after ubusd went away, waiting twice as long after every failed attempt.
+ * Object ids are kept until ubusd announces the object added or removed, so
+ * repeated calls skip the lookup. The connection is used by one thread at a
+ * time, between bus_get() and bus_put().
+ */
+struct bus {
+    pthread_mutex_t lock;
+    struct ubus_context *ctx;           /* NULL while disconnected */
+    struct ubus_event_handler objects;  /* ubus.object.add and ubus.object.remove */
+    struct bus_id ids[BUS_IDS_LEN];
+    size_t n_ids;
+
+    uint32_t backoff_ms;                /* wait before the next connect, 0 to connect now */
+    struct timespec retry;              /* CLOCK_MONOTONIC time of the next connect */
+    unsigned long connects;             /* successful connects, 1 after the first */
+};
+
+uint32_t bus_backoff_next(uint32_t backoff_ms);
+void bus_init(struct bus *b);
+void bus_free(struct bus *b);
+struct ubus_context *bus_get(struct bus *b);
+void bus_put(struct bus *b);
+int bus_lookup(struct bus *b, const char *name, uint32_t *id);
+void bus_forget(struct bus *b, const char *name);
+int bus_invoke(struct bus *b, const char *object, const char *method, struct blob_attr *msg,
+               ubus_data_handler_t cb, void *priv, int timeout);
+
+#endif /* BUS_H */
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sysrepo/values.h"
+#include "cache.h"
+
+void
+response_cache_init(struct response_cache *c)
+{
+    size_t i;
+
+    memset(c, 0, sizeof(*c));
+    pthread_mutex_init(&c->lock, NULL);
+    for (i = 0; i < RESPONSE_CACHE_LEN; i++) {
+        pthread_cond_init(&c->entries[i].built, NULL);
+    }
+}
+
+static void
+response_entry_clear(struct response_entry *e)
+{
+    free(e->xpath);
+    sr_free_values(e->values, e->cnt);
+    e->xpath = NULL;
+    e->generation = 0;
+    e->last_use = 0;
+    e->values = NULL;
+    e->cnt = 0;
+}
+
+void
+response_cache_free(struct response_cache *c)
+{
+    size_t i;
+
+    for (i = 0; i < RESPONSE_CACHE_LEN; i++) {
+        response_entry_clear(&c->entries[i]);
+        pthread_cond_destroy(&c->entries[i].built);
+    }
+    pthread_mutex_destroy(&c->lock);
+}
+
+/*
+ * Entry of xpath, or the one to reuse for it, NULL when all others are being
+ * built. Called with the lock held.
+ */
+static struct response_entry *
+response_cache_slot(struct response_cache *c, const char *xpath)
+{
+    struct response_entry *e, *victim = NULL;
+    size_t i;
+
+    for (i = 0; i < RESPONSE_CACHE_LEN; i++) {
+        e = &c->entries[i];
+        if (e->xpath && !strcmp(e->xpath, xpath)) {
+            return e;
+        }
+        if (e->building || (victim && !victim->xpath)) {
+            continue;
+        }
+        if (!victim || !e->xpath || e->last_use < victim->last_use) {
+            victim = e;
+        }
+    }
+
+    return victim;
+}
+
+/* Copy of the cached values, sysrepo frees what a data provider returns. */
+static int
+response_copy(const struct response_entry *e, sr_val_t **values, size_t *values_cnt)
+{
+    int rc = SR_ERR_OK;
+
+    *values = NULL;
+    *values_cnt = 0;
+    if (e->cnt) {
+        rc = sr_dup_values(e->values, e->cnt, values);
+        if (SR_ERR_OK == rc) {
+            *values_cnt = e->cnt;
+        }
+    }
+
+    return rc;
+}
+
+/**
+ * @brief Answer a data provider request for xpath.
+ *
+ * The cached values are returned while their generation is current, otherwise
+ * build is called and its values are cached for the next request. The build
+ * runs without the lock; requests for the same xpath meanwhile wait for it.
+ *
+ * @return SR_ERR_OK on success, otherwise the error of build or of the copy.
+ */
+int
+response_cache_get(struct response_cache *c, const char *xpath, unsigned long generation,
+                   response_build_cb build, void *arg,
+                   sr_val_t **values, size_t *values_cnt)
+{
+    struct response_entry *e;
+    sr_val_t *built = NULL;
+    size_t cnt = 0;
+    int rc;
+
+    pthread_mutex_lock(&c->lock);
+    for (;;) {
+        e = response_cache_slot(c, xpath);
+        if (!e || !e->xpath || strcmp(e->xpath, xpath)) {
+            break;
+        }
+        e->last_use = ++c->uses;
+        if (e->generation == generation && (e->values || !e->building)) {
+            rc = response_copy(e, values, values_cnt);
+            pthread_mutex_unlock(&c->lock);
+            return rc;
+        }
+        if (!e->building) {
+            break;
+        }
+        pthread_cond_wait(&e->built, &c->lock);
+    }
+
+    if (e && (!e->xpath || strcmp(e->xpath, xpath))) {
+        /* Take over the least recently used entry, dropped if it can't be named. */
+        response_entry_clear(e);
+        e->xpath = strdup(xpath);
+        if (!e->xpath) {
+            e = NULL;
+        }
+    }
+    if (!e) {
+        /* No entry to spare, the answer is not cached. */
+        pthread_mutex_unlock(&c->lock);
+        return build(xpath, arg, values, values_cnt);
+    }
+    e->building = true;
+    e->last_use = ++c->uses;
+    pthread_mutex_unlock(&c->lock);
+
+    rc = build(xpath, arg, &built, &cnt);
+
+    pthread_mutex_lock(&c->lock);
+    e->building = false;
+    pthread_cond_broadcast(&e->built);
+    if (SR_ERR_OK != rc) {
+        response_entry_clear(e);
+        pthread_mutex_unlock(&c->lock);
+        return rc;
+    }
+
+    /* Keep the built values and hand a copy out. */
+    sr_free_values(e->values, e->cnt);
+    e->generation = generation;
+    e->values = built;
+    e->cnt = cnt;
+    rc = response_copy(e, values, values_cnt);
+    pthread_mutex_unlock(&c->lock);
+
+    return rc;
+}
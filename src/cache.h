@@ -0,0 +1,44 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sysrepo.h"
+
+#define RESPONSE_CACHE_LEN 16  /* operational subtrees answered from the cache */
+
+/* Assemble the values of one operational request. */
+typedef int (*response_build_cb)(const char *xpath, void *arg, sr_val_t **values, size_t *values_cnt);
+
+/* Values last returned for one requested xpath. */
+struct response_entry {
+    char *xpath;
+    unsigned long generation;       /* generation of the data the values were built from */
+    unsigned long last_use;
+    sr_val_t *values;
+    size_t cnt;
+    bool building;                  /* a request builds new values without the lock */
+    pthread_cond_t built;           /* signalled when that build is done */
+};
+
+/*
+ * Ready-to-return answers of data provider requests. An answer is rebuilt only
+ * when the collector of its subtree moved to a new generation, repeated reads
+ * of unchanged data get a copy of the cached values. The least recently used
+ * entry makes room for a new xpath. Answers are built without the lock, so a
+ * slow subtree holds up only the requests waiting for the same entry.
+ */
+struct response_cache {
+    pthread_mutex_t lock;
+    unsigned long uses;
+    struct response_entry entries[RESPONSE_CACHE_LEN];
+};
+
+void response_cache_init(struct response_cache *c);
+void response_cache_free(struct response_cache *c);
+int response_cache_get(struct response_cache *c, const char *xpath, unsigned long generation,
+                       response_build_cb build, void *arg,
+                       sr_val_t **values, size_t *values_cnt);
+
+#endif /* CACHE_H */
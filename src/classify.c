@@ -0,0 +1,280 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "classify.h"
+
+struct trie_node {
+    char *segment;
+    size_t len;
+    enum change_class cls;
+    enum model_node_id node;
+    const struct model_leaf *leaf;
+    bool subtree;               /* everything below has the same class */
+    struct trie_node *children;
+    struct trie_node *next;
+};
+
+static struct trie_node *
+trie_child(struct trie_node *parent, const char *segment, size_t len)
+{
+    struct trie_node *child;
+
+    for (child = parent->children; child; child = child->next) {
+        if (child->len == len && !strncmp(child->segment, segment, len)) {
+            return child;
+        }
+    }
+
+    return NULL;
+}
+
+/* Insert all segments of path below parent, returns the node of the last one. */
+static struct trie_node *
+trie_insert(struct trie_node *parent, const char *path)
+{
+    struct trie_node *child;
+    const char *end;
+    size_t len;
+
+    while (*path) {
+        if (*path == '/') {
+            path++;
+            continue;
+        }
+        end = strchr(path, '/');
+        len = end ? (size_t) (end - path) : strlen(path);
+
+        child = trie_child(parent, path, len);
+        if (!child) {
+            child = calloc(1, sizeof(*child));
+            if (!child) {
+                return NULL;
+            }
+            child->segment = strndup(path, len);
+            if (!child->segment) {
+                free(child);
+                return NULL;
+            }
+            child->len = len;
+            child->node = MODEL_NODE_COUNT;
+            child->next = parent->children;
+            parent->children = child;
+        }
+
+        parent = child;
+        path += len;
+    }
+
+    return parent;
+}
+
+static void
+trie_free(struct trie_node *n)
+{
+    struct trie_node *child, *next;
+
+    for (child = n->children; child; child = next) {
+        next = child->next;
+        trie_free(child);
+    }
+    free(n->segment);
+    free(n);
+}
+
+/* Class of changes to a model node, the read-only ones cover their whole top container. */
+static enum change_class
+node_class(enum model_node_id id)
+{
+    switch (id) {
+    case MODEL_WIFI_DEVICE:
+        return CHANGE_WIFI_DEVICE;
+    case MODEL_WIFI_IFACE:
+        return CHANGE_WIFI_IFACE;
+    case MODEL_SETTINGS:
+    case MODEL_LEASE_SOURCE:
+        return CHANGE_SETTINGS;
+    default:
+        return CHANGE_READ_ONLY;
+    }
+}
+
+/*
+ * Containers inserted on the way to a node have no class of their own. Those
+ * holding nothing but writable nodes are writable as well. Returns whether
+ * everything at and below n is writable.
+ */
+static bool
+trie_classify_containers(struct trie_node *n)
+{
+    struct trie_node *child;
+    bool writable = true;
+
+    for (child = n->children; child; child = child->next) {
+        if (!trie_classify_containers(child)) {
+            writable = false;
+        }
+    }
+    if (n->cls == CHANGE_UNKNOWN && n->children && writable) {
+        n->cls = CHANGE_CONTAINER;
+    }
+
+    return writable && n->cls != CHANGE_UNKNOWN && n->cls != CHANGE_READ_ONLY;
+}
+
+/**
+ * @brief Compile the trie from the generated model tables.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_NOMEM otherwise.
+ */
+int
+classifier_init(struct change_classifier *c)
+{
+    const struct model_node *node;
+    struct trie_node *top, *n, *l;
+    char top_xpath[64];
+    const char *slash;
+    size_t i, j;
+
+    c->root = calloc(1, sizeof(*c->root));
+    if (!c->root) {
+        return SR_ERR_NOMEM;
+    }
+
+    for (i = 0; i < MODEL_NODE_COUNT; i++) {
+        node = &model_nodes[i];
+
+        if (node_class(i) == CHANGE_READ_ONLY) {
+            /* Mark the whole top level container, e.g. /status:dhcp. */
+            slash = strchr(node->xpath + 1, '/');
+            snprintf(top_xpath, sizeof(top_xpath), "%.*s",
+                     slash ? (int) (slash - node->xpath) : (int) strlen(node->xpath), node->xpath);
+            top = trie_insert(c->root, top_xpath);
+            if (!top) {
+                goto nomem;
+            }
+            top->cls = CHANGE_READ_ONLY;
+            top->subtree = true;
+            continue;
+        }
+
+        n = trie_insert(c->root, node->xpath);
+        if (!n) {
+            goto nomem;
+        }
+        n->cls = node_class(i);
+        n->node = i;
+
+        for (j = 0; j < node->n_leaves; j++) {
+            l = trie_insert(n, node->leaves[j].path);
+            if (!l) {
+                goto nomem;
+            }
+            l->cls = n->cls;
+            l->node = i;
+            l->leaf = &node->leaves[j];
+        }
+    }
+    trie_classify_containers(c->root);
+
+    return SR_ERR_OK;
+
+  nomem:
+    classifier_free(c);
+    return SR_ERR_NOMEM;
+}
+
+void
+classifier_free(struct change_classifier *c)
+{
+    if (c->root) {
+        trie_free(c->root);
+        c->root = NULL;
+    }
+}
+
+/*
+ * Skip a predicate starting at '['; quoted values may contain ']'.
+ * The value of a [key='value'] predicate is returned through key/key_len.
+ */
+static const char *
+skip_predicate(const char *p, const char **key, size_t *key_len)
+{
+    const char *end;
+    char quote;
+
+    p++;
+    while (*p && *p != ']') {
+        if (*p == '\'' || *p == '"') {
+            quote = *p;
+            end = strchr(p + 1, quote);
+            if (!end) {
+                return NULL;
+            }
+            if (!*key) {
+                *key = p + 1;
+                *key_len = end - p - 1;
+            }
+            p = end + 1;
+        } else {
+            p++;
+        }
+    }
+
+    return *p == ']' ? p + 1 : NULL;
+}
+
+/**
+ * @brief Classify a changed xpath.
+ *
+ * Runs in time linear to the xpath length. Nodes outside of the model are
+ * CHANGE_UNKNOWN.
+ */
+void
+classify_change(const struct change_classifier *c, const char *xpath, struct change_info *info)
+{
+    const struct trie_node *n = c->root;
+    const char *p = xpath, *end;
+    const char *key;
+    size_t key_len;
+
+    memset(info, 0, sizeof(*info));
+    info->node = MODEL_NODE_COUNT;
+
+    while (*p) {
+        if (*p == '/') {
+            p++;
+            continue;
+        }
+
+        end = p + strcspn(p, "/[");
+        n = trie_child((struct trie_node *) n, p, end - p);
+        if (!n) {
+            info->cls = CHANGE_UNKNOWN;
+            return;
+        }
+        if (n->subtree) {
+            info->cls = n->cls;
+            return;
+        }
+
+        p = end;
+        while (*p == '[') {
+            key = NULL;
+            key_len = 0;
+            p = skip_predicate(p, &key, &key_len);
+            if (!p) {
+                info->cls = CHANGE_UNKNOWN;
+                return;
+            }
+            /* Only the list entry predicate names the key, not leaf-list items. */
+            if (!n->leaf && !info->key) {
+                info->key = key;
+                info->key_len = key_len;
+            }
+        }
+    }
+
+    info->cls = n->cls;
+    info->node = n->node;
+    info->leaf = n->leaf;
+}
@@ -0,0 +1,41 @@
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <stddef.h>
+#include "status.h"
+
+enum change_class {
+    CHANGE_UNKNOWN,
+    CHANGE_READ_ONLY,       /* published by the plugin, not to be edited */
+    CHANGE_SETTINGS,
+    CHANGE_WIFI_DEVICE,
+    CHANGE_WIFI_IFACE,
+    CHANGE_CONTAINER,       /* holds nothing but writable nodes, e.g. /status:wifi */
+};
+
+/* Where a changed xpath points into the model. */
+struct change_info {
+    enum change_class cls;
+    enum model_node_id node;
+    const struct model_leaf *leaf;  /* NULL for a list entry or container itself */
+    const char *key;                /* key value of the list entry, inside the xpath */
+    size_t key_len;
+};
+
+struct trie_node;
+
+/*
+ * Prefix trie over the xpath segments of the model, compiled once from the
+ * generated node tables. A changed xpath is classified in one pass over its
+ * segments; list predicates are skipped and the list key is remembered.
+ */
+struct change_classifier {
+    struct trie_node *root;
+};
+
+int classifier_init(struct change_classifier *c);
+void classifier_free(struct change_classifier *c);
+void classify_change(const struct change_classifier *c, const char *xpath,
+                     struct change_info *info);
+
+#endif /* CLASSIFY_H */
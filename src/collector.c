@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <string.h>
+#include "sysrepo.h"
+#include "collector.h"
+#include "trace.h"
+
+void
+collector_init(struct collector *c, const char *name, uint32_t ttl_ms,
+               collect_cb collect, void *priv)
+{
+    memset(c, 0, sizeof(*c));
+    c->name = name;
+    c->ttl_ms = ttl_ms;
+    c->collect = collect;
+    c->priv = priv;
+    c->rc = SR_ERR_OK;
+
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->done, NULL);
+}
+
+void
+collector_destroy(struct collector *c)
+{
+    pthread_cond_destroy(&c->done);
+    pthread_mutex_destroy(&c->lock);
+}
+
+/* Last result succeeded and is younger than the TTL, called with the lock held. */
+static bool
+collector_fresh(struct collector *c)
+{
+    struct timespec now;
+    long long age_ms;
+
+    if (!c->generation || !c->ttl_ms || SR_ERR_OK != c->rc) {
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    age_ms = (now.tv_sec - c->collected.tv_sec) * 1000LL +
+             (now.tv_nsec - c->collected.tv_nsec) / 1000000L;
+
+    return age_ms < c->ttl_ms;
+}
+
+/**
+ * @brief Bring the source up to date.
+ *
+ * A caller that knows the source changed needs a collection begun after its
+ * call, so it does not join one already running but shares the next one with
+ * everybody else who arrived meanwhile. Other callers join a running collection
+ * or reuse a successful result younger than the TTL; a failure is retried.
+ *
+ * @param[in] changed Source changed, cached and running results are too old.
+ * @return Result of the collection the caller shared.
+ */
+int
+collector_refresh(struct collector *c, bool changed)
+{
+    unsigned long target;
+    int rc;
+
+    pthread_mutex_lock(&c->lock);
+    if (!changed && !c->in_flight && collector_fresh(c)) {
+        rc = c->rc;
+        pthread_mutex_unlock(&c->lock);
+        return rc;
+    }
+
+    target = c->started + (changed || !c->in_flight ? 1 : 0);
+    while (c->generation < target) {
+        if (c->in_flight) {
+            c->waiters++;
+            pthread_cond_wait(&c->done, &c->lock);
+            c->waiters--;
+            continue;
+        }
+
+        c->in_flight = true;
+        c->started++;
+        pthread_mutex_unlock(&c->lock);
+
+        trace_begin("collector", c->name);
+        rc = c->collect(c->priv);
+        trace_end("collector", c->name);
+
+        pthread_mutex_lock(&c->lock);
+        if (SR_ERR_OK != rc) {
+            fprintf(stderr, "Collecting %s failed: %s\n", c->name, sr_strerror(rc));
+        }
+        c->rc = rc;
+        c->generation = c->started;
+        clock_gettime(CLOCK_MONOTONIC, &c->collected);
+        c->in_flight = false;
+        pthread_cond_broadcast(&c->done);
+    }
+    rc = c->rc;
+    pthread_mutex_unlock(&c->lock);
+
+    return rc;
+}
+
+/* Number of finished collections, changes whenever the collected data may have. */
+unsigned long
+collector_generation(struct collector *c)
+{
+    unsigned long generation;
+
+    pthread_mutex_lock(&c->lock);
+    generation = c->generation;
+    pthread_mutex_unlock(&c->lock);
+
+    return generation;
+}
+
+/* Applies from the next refresh on. */
+void
+collector_set_ttl(struct collector *c, uint32_t ttl_ms)
+{
+    pthread_mutex_lock(&c->lock);
+    c->ttl_ms = ttl_ms;
+    pthread_mutex_unlock(&c->lock);
+}
@@ -0,0 +1,40 @@
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Collect one source into the model, returns a Sysrepo error code. */
+typedef int (*collect_cb)(void *priv);
+
+/*
+ * Single-flight front of a data source. Concurrent refreshes share one running
+ * collection instead of each reading the source; a result younger than the TTL
+ * is reused unless the caller knows the source changed.
+ */
+struct collector {
+    const char *name;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    bool in_flight;
+    unsigned int waiters;           /* callers waiting for a running collection */
+    unsigned long started;          /* collections begun */
+    unsigned long generation;       /* collections finished */
+    int rc;                         /* result of the last collection */
+    struct timespec collected;      /* CLOCK_MONOTONIC end of the last collection */
+    uint32_t ttl_ms;
+
+    collect_cb collect;
+    void *priv;
+};
+
+void collector_init(struct collector *c, const char *name, uint32_t ttl_ms,
+                    collect_cb collect, void *priv);
+void collector_destroy(struct collector *c);
+int collector_refresh(struct collector *c, bool changed);
+unsigned long collector_generation(struct collector *c);
+void collector_set_ttl(struct collector *c, uint32_t ttl_ms);
+
+#endif /* COLLECTOR_H */
@@ -0,0 +1,229 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libubox/blobmsg.h>
+#include "sysrepo.h"
+#include "bus.h"
+#include "confwatch.h"
+
+#define CONFIG_WATCH_EVENT "config.change"
+#define CONFIG_WATCH_RETRY_MS 5000      /* wait before subscribing to procd again */
+
+/* Remember an event naming the package, procd sends "package", others "config". */
+void
+config_watch_match(struct config_watch *w, const char *type, struct blob_attr *msg)
+{
+    enum {
+        CHANGE_PACKAGE,
+        CHANGE_CONFIG,
+        CHANGE_MAX
+    };
+    static const struct blobmsg_policy policy[CHANGE_MAX] = {
+        [CHANGE_PACKAGE] = {.name = "package", .type = BLOBMSG_TYPE_STRING},
+        [CHANGE_CONFIG] = {.name = "config", .type = BLOBMSG_TYPE_STRING},
+    };
+    struct blob_attr *tb[CHANGE_MAX];
+    int i;
+
+    if (!msg || strcmp(type, CONFIG_WATCH_EVENT)) {
+        return;
+    }
+    blobmsg_parse(policy, CHANGE_MAX, tb, blob_data(msg), blob_len(msg));
+    for (i = 0; i < CHANGE_MAX; i++) {
+        if (tb[i] && !strcmp(blobmsg_get_string(tb[i]), w->package)) {
+            w->pending = true;
+        }
+    }
+}
+
+static void
+config_event_cb(struct ubus_context *ctx, struct ubus_event_handler *ev, const char *type,
+                struct blob_attr *msg)
+{
+    config_watch_match(container_of(ev, struct config_watch, event), type, msg);
+}
+
+/* Notification of procd's service object, the method is the event type. */
+static int
+config_service_cb(struct ubus_context *ctx, struct ubus_object *obj,
+                  struct ubus_request_data *req, const char *method, struct blob_attr *msg)
+{
+    struct ubus_subscriber *sub = container_of(obj, struct ubus_subscriber, obj);
+
+    config_watch_match(container_of(sub, struct config_watch, service), method, msg);
+
+    return UBUS_STATUS_OK;
+}
+
+/* procd went away, its successor is subscribed to after a while. */
+static void
+config_service_remove_cb(struct ubus_context *ctx, struct ubus_subscriber *sub, uint32_t id)
+{
+    container_of(sub, struct config_watch, service)->subscribed = false;
+}
+
+static void
+config_watch_subscribe(struct config_watch *w)
+{
+    uint32_t id;
+
+    if (UBUS_STATUS_OK == ubus_lookup_id(w->ctx, "service", &id) &&
+        UBUS_STATUS_OK == ubus_subscribe(w->ctx, &w->service, id)) {
+        w->subscribed = true;
+    }
+}
+
+/* Connect and register for the events, on failure the next attempt waits longer. */
+static void
+config_watch_connect(struct config_watch *w)
+{
+    w->ctx = ubus_connect(NULL);
+    if (w->ctx) {
+        memset(&w->event, 0, sizeof(w->event));
+        memset(&w->service, 0, sizeof(w->service));
+        w->event.cb = config_event_cb;
+        w->service.cb = config_service_cb;
+        w->service.remove_cb = config_service_remove_cb;
+        if (UBUS_STATUS_OK != ubus_register_event_handler(w->ctx, &w->event, CONFIG_WATCH_EVENT) ||
+            UBUS_STATUS_OK != ubus_register_subscriber(w->ctx, &w->service)) {
+            fprintf(stderr, "Can't register for %s events\n", w->package);
+            ubus_free(w->ctx);
+            w->ctx = NULL;
+        }
+    }
+    if (!w->ctx) {
+        w->backoff_ms = bus_backoff_next(w->backoff_ms);
+        return;
+    }
+
+    /* Edits may have been missed unless this is a first connect that worked at once. */
+    if (w->connects++ || w->backoff_ms) {
+        w->pending = true;
+    }
+    w->backoff_ms = 0;
+    w->subscribed = false;
+}
+
+static void *
+config_watch_thread(void *arg)
+{
+    struct config_watch *w = arg;
+    struct pollfd fds[2];
+    int timeout;
+
+    fds[1].fd = w->wake_fd[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        if (!w->ctx) {
+            config_watch_connect(w);
+        }
+        if (w->ctx && !w->subscribed) {
+            config_watch_subscribe(w);
+        }
+        if (w->pending) {
+            w->pending = false;
+            w->changed(w->priv);
+        }
+
+        /* poll() skips the negative fd while disconnected. */
+        fds[0].fd = w->ctx ? w->ctx->sock.fd : -1;
+        fds[0].events = POLLIN;
+        if (!w->ctx) {
+            timeout = w->backoff_ms;
+        } else if (!w->subscribed) {
+            timeout = CONFIG_WATCH_RETRY_MS;
+        } else {
+            timeout = -1;
+        }
+
+        if (poll(fds, 2, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Config watcher poll failed: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (w->ctx && fds[0].revents) {
+            ubus_handle_event(w->ctx);
+            if (w->ctx->sock.eof) {
+                fprintf(stderr, "Config watcher lost ubus connection\n");
+                ubus_free(w->ctx);
+                w->ctx = NULL;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Start following changes of a UCI package.
+ *
+ * Without ubusd the watcher keeps trying to connect in the background.
+ *
+ * @return SR_ERR_OK on success, otherwise some Sysrepo error code.
+ */
+int
+config_watch_start(struct config_watch *w, const char *package,
+                   config_changed_cb changed, void *priv)
+{
+    int rc;
+
+    memset(w, 0, sizeof(*w));
+    w->wake_fd[0] = w->wake_fd[1] = -1;
+    w->changed = changed;
+    w->priv = priv;
+
+    w->package = strdup(package);
+    if (!w->package) {
+        return SR_ERR_NOMEM;
+    }
+    if (pipe(w->wake_fd)) {
+        fprintf(stderr, "Can't create config watcher pipe: %s\n", strerror(errno));
+        goto error;
+    }
+
+    rc = pthread_create(&w->thread, NULL, config_watch_thread, w);
+    if (rc) {
+        fprintf(stderr, "Can't start config watcher: %s\n", strerror(rc));
+        goto error;
+    }
+    w->running = true;
+
+    return SR_ERR_OK;
+
+  error:
+    config_watch_stop(w);
+    return SR_ERR_INTERNAL;
+}
+
+void
+config_watch_stop(struct config_watch *w)
+{
+    if (w->running) {
+        if (write(w->wake_fd[1], "", 1) < 0) {
+            fprintf(stderr, "Can't wake config watcher: %s\n", strerror(errno));
+        }
+        pthread_join(w->thread, NULL);
+        w->running = false;
+    }
+
+    if (w->ctx) {
+        ubus_free(w->ctx);
+        w->ctx = NULL;
+    }
+    if (w->wake_fd[0] >= 0) {
+        close(w->wake_fd[0]);
+        close(w->wake_fd[1]);
+    }
+    free(w->package);
+    memset(w, 0, sizeof(*w));
+    w->wake_fd[0] = w->wake_fd[1] = -1;
+}
@@ -0,0 +1,42 @@
+#ifndef CONFWATCH_H
+#define CONFWATCH_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <libubus.h>
+
+/* The package was changed, called from the watcher thread. */
+typedef void (*config_changed_cb)(void *priv);
+
+/*
+ * Follows config.change events of one UCI package: broadcast on ubus, or
+ * notified by procd's service object when a tool reloads the configuration.
+ * The events are served by an own thread on an own ubus connection, which is
+ * reconnected with the backoff of the shared bus. Edits while ubusd was away
+ * are reported once the connection is back.
+ */
+struct config_watch {
+    char *package;
+    config_changed_cb changed;
+    void *priv;
+
+    pthread_t thread;
+    bool running;
+    int wake_fd[2];
+
+    struct ubus_context *ctx;           /* NULL while disconnected */
+    struct ubus_event_handler event;
+    struct ubus_subscriber service;
+    bool subscribed;                    /* to procd's service object */
+    bool pending;                       /* an event for the package was received */
+    uint32_t backoff_ms;
+    unsigned long connects;
+};
+
+int config_watch_start(struct config_watch *w, const char *package,
+                       config_changed_cb changed, void *priv);
+void config_watch_stop(struct config_watch *w);
+void config_watch_match(struct config_watch *w, const char *type, struct blob_attr *msg);
+
+#endif /* CONFWATCH_H */
@@ -0,0 +1,316 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sysrepo/values.h"
+#include "health.h"
+#include "xpath.h"
+
+/* /proc/meminfo lines copied into the sample, in kB. */
+static const struct {
+    const char *name;
+    size_t offset;
+} meminfo_fields[] = {
+    { "MemTotal:", offsetof(struct health_sample, mem_total) },
+    { "MemFree:", offsetof(struct health_sample, mem_free) },
+    { "MemAvailable:", offsetof(struct health_sample, mem_available) },
+    { "Buffers:", offsetof(struct health_sample, mem_buffered) },
+    { "Cached:", offsetof(struct health_sample, mem_cached) },
+    { "SwapTotal:", offsetof(struct health_sample, swap_total) },
+    { "SwapFree:", offsetof(struct health_sample, swap_free) },
+};
+
+/* uint64 leaves of the health container. */
+static const struct {
+    const char *leaf;
+    size_t offset;
+} health_leaves[] = {
+    { "uptime", offsetof(struct health_sample, uptime) },
+    { "memory-total", offsetof(struct health_sample, mem_total) },
+    { "memory-free", offsetof(struct health_sample, mem_free) },
+    { "memory-available", offsetof(struct health_sample, mem_available) },
+    { "memory-buffered", offsetof(struct health_sample, mem_buffered) },
+    { "memory-cached", offsetof(struct health_sample, mem_cached) },
+    { "swap-total", offsetof(struct health_sample, swap_total) },
+    { "swap-free", offsetof(struct health_sample, swap_free) },
+};
+
+#define HEALTH_LEAVES (sizeof(health_leaves) / sizeof(health_leaves[0]))
+#define LOAD_LEAVES 3
+#define CPU_LEAVES 5
+
+static const char *load_leaves[LOAD_LEAVES] = { "load-1", "load-5", "load-15" };
+
+int
+health_init(struct health *h)
+{
+    memset(h, 0, sizeof(*h));
+    pthread_mutex_init(&h->lock, NULL);
+
+    h->loadavg_fd = open("/proc/loadavg", O_RDONLY | O_CLOEXEC);
+    h->meminfo_fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    h->uptime_fd = open("/proc/uptime", O_RDONLY | O_CLOEXEC);
+    h->stat_fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    if (h->loadavg_fd < 0 || h->meminfo_fd < 0 || h->uptime_fd < 0 || h->stat_fd < 0) {
+        fprintf(stderr, "Can't open /proc for board health: %s\n", strerror(errno));
+        health_free(h);
+        return SR_ERR_INTERNAL;
+    }
+
+    return SR_ERR_OK;
+}
+
+void
+health_free(struct health *h)
+{
+    int *fds[] = { &h->loadavg_fd, &h->meminfo_fd, &h->uptime_fd, &h->stat_fd };
+    size_t i;
+
+    for (i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] >= 0) {
+            close(*fds[i]);
+        }
+        *fds[i] = -1;
+    }
+    pthread_mutex_destroy(&h->lock);
+}
+
+/* Read the file from its start into the buffer, NULL when it could not be read. */
+static const char *
+health_read(struct health *h, int fd)
+{
+    ssize_t len;
+
+    len = pread(fd, h->buf, sizeof(h->buf) - 1, 0);
+    if (len <= 0) {
+        return NULL;
+    }
+    h->buf[len] = '\0';
+
+    return h->buf;
+}
+
+static void
+parse_meminfo(const char *p, struct health_sample *s)
+{
+    size_t i, len;
+
+    for (; *p; p = strchr(p, '\n') ? strchr(p, '\n') + 1 : p + strlen(p)) {
+        for (i = 0; i < sizeof(meminfo_fields) / sizeof(meminfo_fields[0]); i++) {
+            len = strlen(meminfo_fields[i].name);
+            if (!strncmp(p, meminfo_fields[i].name, len)) {
+                *(uint64_t *) ((char *) s + meminfo_fields[i].offset) = strtoull(p + len, NULL, 10);
+                break;
+            }
+        }
+    }
+}
+
+static void
+cpu_usage(struct cpu_usage *u, const struct cpu_times *now, struct cpu_times *prev)
+{
+    uint64_t total, idle;
+
+    if (now->total <= prev->total) {
+        /* Counters restarted, e.g. a CPU went offline, fall back to since boot. */
+        memset(prev, 0, sizeof(*prev));
+    }
+    total = now->total - prev->total;
+    if (total) {
+        idle = (now->idle - prev->idle) + (now->iowait - prev->iowait);
+        u->usage = 100 * (total - (idle < total ? idle : total)) / total;
+        u->user = 100 * (now->user - prev->user) / total;
+        u->system = 100 * (now->system - prev->system) / total;
+        u->iowait = 100 * (now->iowait - prev->iowait) / total;
+    }
+    *prev = *now;
+}
+
+/* The cpu lines at the top of /proc/stat, the rest is not looked at. */
+static void
+parse_stat(struct health *h, const char *p, struct health_sample *s)
+{
+    uint64_t v[8];
+    struct cpu_times t;
+    unsigned long id;
+    char *end;
+    bool all;
+    int i;
+
+    s->n_cpus = 0;
+    while (!strncmp(p, "cpu", 3)) {
+        p += 3;
+        all = !isdigit((unsigned char) *p);
+        id = all ? 0 : strtoul(p, &end, 10);
+        if (!all) {
+            p = end;
+        }
+        /* user nice system idle iowait irq softirq steal */
+        for (i = 0; i < 8; i++) {
+            v[i] = strtoull(p, &end, 10);
+            p = end;
+        }
+        t.user = v[0] + v[1];
+        t.system = v[2] + v[5] + v[6];
+        t.idle = v[3];
+        t.iowait = v[4];
+        t.total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+
+        if (all) {
+            cpu_usage(&s->all, &t, &h->prev_all);
+        } else if (id < HEALTH_MAX_CPUS && s->n_cpus < HEALTH_MAX_CPUS) {
+            s->cpu[s->n_cpus].id = id;
+            cpu_usage(&s->cpu[s->n_cpus++], &t, &h->prev[id]);
+        }
+
+        p = strchr(p, '\n');
+        if (!p) {
+            break;
+        }
+        p++;
+    }
+}
+
+/**
+ * @brief Take one sample of the board health.
+ *
+ * @return SR_ERR_OK on success, otherwise some Sysrepo error code.
+ */
+int
+health_collect(struct health *h)
+{
+    struct health_sample s;
+    const char *p;
+
+    memset(&s, 0, sizeof(s));
+
+    p = health_read(h, h->loadavg_fd);
+    if (!p || 3 != sscanf(p, "%lf %lf %lf", &s.load[0], &s.load[1], &s.load[2])) {
+        return SR_ERR_INTERNAL;
+    }
+    p = health_read(h, h->uptime_fd);
+    if (!p) {
+        return SR_ERR_INTERNAL;
+    }
+    s.uptime = strtoull(p, NULL, 10);
+    p = health_read(h, h->meminfo_fd);
+    if (!p) {
+        return SR_ERR_INTERNAL;
+    }
+    parse_meminfo(p, &s);
+    p = health_read(h, h->stat_fd);
+    if (!p) {
+        return SR_ERR_INTERNAL;
+    }
+    parse_stat(h, p, &s);
+
+    pthread_mutex_lock(&h->lock);
+    h->sample = s;
+    pthread_mutex_unlock(&h->lock);
+
+    return SR_ERR_OK;
+}
+
+static int
+health_container_values(const struct health_sample *s, struct xpath_buf *xb, sr_val_t *v, size_t *n)
+{
+    size_t prefix = xb->len, i;
+    int rc = SR_ERR_OK;
+
+    for (i = 0; i < HEALTH_LEAVES && SR_ERR_OK == rc; i++) {
+        rc = xpath_set_leaf(&v[*n], xb, prefix, health_leaves[i].leaf);
+        v[*n].type = SR_UINT64_T;
+        v[(*n)++].data.uint64_val = *(const uint64_t *) ((const char *) s + health_leaves[i].offset);
+    }
+    for (i = 0; i < LOAD_LEAVES && SR_ERR_OK == rc; i++) {
+        rc = xpath_set_leaf(&v[*n], xb, prefix, load_leaves[i]);
+        v[*n].type = SR_DECIMAL64_T;
+        v[(*n)++].data.decimal64_val = s->load[i];
+    }
+    if (SR_ERR_OK == rc && SR_ERR_OK == (rc = xpath_set_leaf(&v[*n], xb, prefix, "cpu-usage"))) {
+        v[*n].type = SR_UINT8_T;
+        v[(*n)++].data.uint8_val = s->all.usage;
+    }
+
+    return rc;
+}
+
+static int
+health_cpu_values(const struct health_sample *s, struct xpath_buf *xb, sr_val_t *v, size_t *n)
+{
+    static const char *leaves[CPU_LEAVES - 1] = { "usage", "user", "system", "iowait" };
+    const struct cpu_usage *u;
+    size_t base = xb->len, prefix, i, j;
+    uint8_t val;
+    int rc = SR_ERR_OK;
+
+    for (i = 0; i < s->n_cpus && SR_ERR_OK == rc; i++) {
+        u = &s->cpu[i];
+        xpath_buf_truncate(xb, base);
+        rc = xpath_buf_append(xb, "[id='%u']", u->id);
+        prefix = xb->len;
+
+        if (SR_ERR_OK == rc && SR_ERR_OK == (rc = xpath_set_leaf(&v[*n], xb, prefix, "id"))) {
+            v[*n].type = SR_UINT32_T;
+            v[(*n)++].data.uint32_val = u->id;
+        }
+        for (j = 0; j < CPU_LEAVES - 1 && SR_ERR_OK == rc; j++) {
+            rc = xpath_set_leaf(&v[*n], xb, prefix, leaves[j]);
+            val = j == 0 ? u->usage : j == 1 ? u->user : j == 2 ? u->system : u->iowait;
+            v[*n].type = SR_UINT8_T;
+            v[(*n)++].data.uint8_val = val;
+        }
+    }
+
+    return rc;
+}
+
+/**
+ * @brief Build the health container or its cpu list from the last sample.
+ */
+int
+health_build(const char *xpath, void *arg, sr_val_t **values, size_t *values_cnt)
+{
+    struct health *h = arg;
+    struct health_sample s;
+    struct xpath_buf xb = {0,};
+    sr_val_t *v = NULL;
+    size_t n = 0, cnt;
+    bool cpus;
+    int rc;
+
+    *values = NULL;
+    *values_cnt = 0;
+
+    pthread_mutex_lock(&h->lock);
+    s = h->sample;
+    pthread_mutex_unlock(&h->lock);
+
+    cpus = strlen(xpath) > 4 && !strcmp(xpath + strlen(xpath) - 4, "/cpu");
+    if (cpus && !s.n_cpus) {
+        return SR_ERR_OK;
+    }
+    cnt = cpus ? s.n_cpus * CPU_LEAVES : HEALTH_LEAVES + LOAD_LEAVES + 1;
+
+    rc = sr_new_values(cnt, &v);
+    if (SR_ERR_OK != rc) {
+        return rc;
+    }
+    rc = xpath_buf_append(&xb, "%s", xpath);
+    if (SR_ERR_OK == rc) {
+        rc = cpus ? health_cpu_values(&s, &xb, v, &n) : health_container_values(&s, &xb, v, &n);
+    }
+    xpath_buf_free(&xb);
+    if (SR_ERR_OK != rc) {
+        sr_free_values(v, cnt);
+        return rc;
+    }
+    *values = v;
+    *values_cnt = n;
+
+    return SR_ERR_OK;
+}
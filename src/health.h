@@ -0,0 +1,67 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "sysrepo.h"
+
+#define HEALTH_MAX_CPUS 64
+#define HEALTH_BUF_LEN 16384            /* the cpu lines at the top of /proc/stat */
+
+/* Jiffies of one /proc/stat cpu line. */
+struct cpu_times {
+    uint64_t user;
+    uint64_t system;
+    uint64_t iowait;
+    uint64_t idle;
+    uint64_t total;
+};
+
+struct cpu_usage {
+    uint32_t id;
+    uint8_t usage;
+    uint8_t user;
+    uint8_t system;
+    uint8_t iowait;
+};
+
+/* One sample of the board health. */
+struct health_sample {
+    uint64_t uptime;
+    double load[3];
+    uint64_t mem_total;
+    uint64_t mem_free;
+    uint64_t mem_available;
+    uint64_t mem_buffered;
+    uint64_t mem_cached;
+    uint64_t swap_total;
+    uint64_t swap_free;
+    struct cpu_usage all;
+    struct cpu_usage cpu[HEALTH_MAX_CPUS];
+    unsigned int n_cpus;
+};
+
+/*
+ * Board health read from /proc files that stay open, each sample is one pread
+ * per file parsed in place. CPU usage is the difference to the previous sample.
+ */
+struct health {
+    int loadavg_fd;
+    int meminfo_fd;
+    int uptime_fd;
+    int stat_fd;
+    char buf[HEALTH_BUF_LEN];
+    struct cpu_times prev_all;
+    struct cpu_times prev[HEALTH_MAX_CPUS];
+
+    pthread_mutex_t lock;               /* guards the sample */
+    struct health_sample sample;
+};
+
+int health_init(struct health *h);
+void health_free(struct health *h);
+int health_collect(struct health *h);
+int health_build(const char *xpath, void *arg, sr_val_t **values, size_t *values_cnt);
+
+#endif /* HEALTH_H */
@@ -0,0 +1,965 @@
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "leases.h"
+
+#define LEASE_WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE)
+#define LEASE_DIR_MASK (IN_DELETE_SELF | IN_MOVE_SELF)
+#define LEASE_PARENT_MASK (IN_CREATE | IN_MOVED_TO | IN_ONLYDIR)
+
+static const char *lease_event_names[] = {
+    [LEASE_ADDED] = "added",
+    [LEASE_RENEWED] = "renewed",
+    [LEASE_RELEASED] = "released",
+    [LEASE_EXPIRED] = "expired",
+};
+
+const char *
+lease_event_name(enum lease_event event)
+{
+    return lease_event_names[event];
+}
+
+/* Leases are keyed by client, like the dhcp-leases list. */
+static const char *
+lease_client(const struct dhcp_lease *lease)
+{
+    return lease->id ? lease->id : "";
+}
+
+static int
+lease_cmp(const void *a, const void *b)
+{
+    const struct dhcp_lease *la = *(const struct dhcp_lease * const *) a;
+    const struct dhcp_lease *lb = *(const struct dhcp_lease * const *) b;
+
+    return strcmp(lease_client(la), lease_client(lb));
+}
+
+static bool
+str_differ(const char *a, const char *b)
+{
+    if (!a || !b) {
+        return a != b;
+    }
+    return strcmp(a, b) != 0;
+}
+
+/* Snapshot of a lease list sorted by client, NULL if allocation fails. */
+static struct dhcp_lease **
+lease_sorted(struct list_head *list, size_t *cnt)
+{
+    struct dhcp_lease **sorted, *lease;
+    size_t n = 0;
+
+    list_for_each_entry(lease, list, head) {
+        n++;
+    }
+
+    sorted = malloc((n ? n : 1) * sizeof(*sorted));
+    if (!sorted) {
+        return NULL;
+    }
+
+    n = 0;
+    list_for_each_entry(lease, list, head) {
+        sorted[n++] = lease;
+    }
+    qsort(sorted, n, sizeof(*sorted), lease_cmp);
+    *cnt = n;
+
+    return sorted;
+}
+
+/**
+ * @brief Report the lease events between two snapshots of the lease file.
+ *
+ * Leases are matched by client id. A lease that disappeared before its expiry
+ * time was released, otherwise it expired; 0 is dnsmasq's infinite lease.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_NOMEM otherwise.
+ */
+int
+lease_diff(struct list_head *old, struct list_head *new, time_t now,
+           lease_event_cb cb, void *priv)
+{
+    struct dhcp_lease **o = NULL, **n = NULL;
+    size_t n_old = 0, n_new = 0, i = 0, j = 0;
+    long long expiry;
+    int cmp, rc = SR_ERR_OK;
+
+    o = lease_sorted(old, &n_old);
+    n = lease_sorted(new, &n_new);
+    if (!o || !n) {
+        rc = SR_ERR_NOMEM;
+        goto out;
+    }
+
+    while (i < n_old || j < n_new) {
+        if (i == n_old) {
+            cmp = 1;
+        } else if (j == n_new) {
+            cmp = -1;
+        } else {
+            cmp = strcmp(lease_client(o[i]), lease_client(n[j]));
+        }
+
+        if (cmp < 0) {
+            expiry = o[i]->lease_expirey ? strtoll(o[i]->lease_expirey, NULL, 10) : 0;
+            cb(expiry && expiry <= now ? LEASE_EXPIRED : LEASE_RELEASED, o[i], priv);
+            i++;
+        } else if (cmp > 0) {
+            cb(LEASE_ADDED, n[j], priv);
+            j++;
+        } else {
+            if (str_differ(o[i]->lease_expirey, n[j]->lease_expirey) ||
+                str_differ(o[i]->ip, n[j]->ip)) {
+                cb(LEASE_RENEWED, n[j], priv);
+            }
+            i++;
+            j++;
+        }
+    }
+
+  out:
+    free(o);
+    free(n);
+
+    return rc;
+}
+
+/**
+ * @brief Watch the directory of the lease file, or its nearest existing parent.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_INTERNAL if not even a parent can be watched.
+ */
+static int
+lease_watcher_arm(struct lease_watcher *w)
+{
+    char dir[PATH_MAX];
+    char *slash;
+
+    if (w->wd >= 0) {
+        /* Fails for a watch the kernel already removed with its directory. */
+        inotify_rm_watch(w->inotify_fd, w->wd);
+    }
+    snprintf(dir, sizeof(dir), "%s", w->dir);
+    w->armed = true;
+    for (;;) {
+        w->wd = inotify_add_watch(w->inotify_fd, dir, w->armed ?
+                                  LEASE_WATCH_MASK | LEASE_DIR_MASK :
+                                  LEASE_PARENT_MASK | LEASE_DIR_MASK);
+        if (w->wd >= 0) {
+            return SR_ERR_OK;
+        }
+        slash = strrchr(dir, '/');
+        if (errno != ENOENT || !strcmp(dir, "/") || !strcmp(dir, ".")) {
+            break;
+        }
+        if (!slash) {
+            snprintf(dir, sizeof(dir), ".");
+        } else {
+            slash[slash == dir ? 1 : 0] = '\0';
+        }
+        w->armed = false;
+    }
+    fprintf(stderr, "Can't watch %s: %s\n", dir, strerror(errno));
+
+    return SR_ERR_INTERNAL;
+}
+
+/**
+ * @brief Handle the events read at once.
+ *
+ * A new directory below a watched parent may be the one of the lease file or on
+ * its way, the watch moves down to the nearest existing one. A watched directory
+ * that goes away hands its watch back to a parent.
+ *
+ * @return The lease file may have changed.
+ */
+static bool
+watched_file_changed(struct lease_watcher *w, const char *buf, ssize_t len)
+{
+    const struct inotify_event *ev;
+    bool changed = false, rearm = false;
+    ssize_t off = 0;
+
+    while (off < len) {
+        ev = (const struct inotify_event *) (buf + off);
+        off += sizeof(*ev) + ev->len;
+        if (ev->wd != w->wd) {
+            continue;
+        }
+        if (ev->mask & (LEASE_DIR_MASK | IN_IGNORED)) {
+            rearm = true;
+        } else if (!w->armed) {
+            rearm |= !!(ev->mask & IN_ISDIR);
+        } else if ((ev->mask & LEASE_WATCH_MASK) && ev->len && !strcmp(ev->name, w->name)) {
+            changed = true;
+        }
+    }
+
+    if (rearm) {
+        /* Leaving the directory drops the file, reaching it finds one written meanwhile. */
+        changed |= w->armed;
+        changed |= SR_ERR_OK == lease_watcher_arm(w) && w->armed;
+    }
+
+    return changed;
+}
+
+static void *
+lease_watcher_thread(void *arg)
+{
+    struct lease_watcher *w = arg;
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct pollfd fds[2];
+    ssize_t len;
+
+    fds[0].fd = w->inotify_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = w->wake_fd[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Lease watcher poll failed: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+
+        /* One callback for all events read at once, a rewrite raises several. */
+        len = read(w->inotify_fd, buf, sizeof(buf));
+        if (len <= 0) {
+            continue;
+        }
+        if (watched_file_changed(w, buf, len)) {
+            w->changed(w->priv);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Start watching the lease file at path.
+ *
+ * The directory of the file does not need to exist yet, the file is reported
+ * changed once it appears.
+ *
+ * @return SR_ERR_OK on success, otherwise some Sysrepo error code.
+ */
+int
+lease_watcher_start(struct lease_watcher *w, const char *path,
+                    lease_changed_cb changed, void *priv)
+{
+    const char *slash = strrchr(path, '/');
+    int rc;
+
+    memset(w, 0, sizeof(*w));
+    w->inotify_fd = -1;
+    w->wake_fd[0] = w->wake_fd[1] = -1;
+    w->wd = -1;
+    w->changed = changed;
+    w->priv = priv;
+
+    if (!slash) {
+        w->dir = strdup(".");
+    } else {
+        w->dir = strndup(path, slash == path ? 1 : slash - path);
+    }
+    w->name = strdup(slash ? slash + 1 : path);
+    if (!w->dir || !w->name) {
+        lease_watcher_stop(w);
+        return SR_ERR_NOMEM;
+    }
+
+    w->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->inotify_fd < 0) {
+        fprintf(stderr, "Can't watch %s: %s\n", w->dir, strerror(errno));
+        goto error;
+    }
+    if (SR_ERR_OK != lease_watcher_arm(w)) {
+        goto error;
+    }
+    if (pipe(w->wake_fd)) {
+        fprintf(stderr, "Can't create lease watcher pipe: %s\n", strerror(errno));
+        goto error;
+    }
+
+    rc = pthread_create(&w->thread, NULL, lease_watcher_thread, w);
+    if (rc) {
+        fprintf(stderr, "Can't start lease watcher: %s\n", strerror(rc));
+        goto error;
+    }
+    w->running = true;
+
+    return SR_ERR_OK;
+
+  error:
+    lease_watcher_stop(w);
+    return SR_ERR_INTERNAL;
+}
+
+void
+lease_watcher_stop(struct lease_watcher *w)
+{
+    if (w->running) {
+        if (write(w->wake_fd[1], "", 1) < 0) {
+            fprintf(stderr, "Can't wake lease watcher: %s\n", strerror(errno));
+        }
+        pthread_join(w->thread, NULL);
+        w->running = false;
+    }
+
+    if (w->inotify_fd >= 0) {
+        close(w->inotify_fd);
+    }
+    if (w->wake_fd[0] >= 0) {
+        close(w->wake_fd[0]);
+        close(w->wake_fd[1]);
+    }
+    w->inotify_fd = w->wake_fd[0] = w->wake_fd[1] = w->wd = -1;
+    free(w->dir);
+    free(w->name);
+    w->dir = w->name = NULL;
+}
+
+static void
+lease_free(struct pool *pool, struct dhcp_lease *lease)
+{
+    pool_entry_free(pool, MODEL_DHCP_LEASES, lease);
+}
+
+static void
+lease_free_list(struct pool *pool, struct list_head *leases)
+{
+    struct dhcp_lease *lease, *tmp;
+
+    list_for_each_entry_safe(lease, tmp, leases, head) {
+        list_del(&lease->head);
+        lease_free(pool, lease);
+    }
+}
+
+/* The later expiry wins, 0 is an infinite lease. */
+static bool
+lease_outlives(const struct dhcp_lease *a, const struct dhcp_lease *b)
+{
+    long long ea = a->lease_expirey ? strtoll(a->lease_expirey, NULL, 10) : 0;
+    long long eb = b->lease_expirey ? strtoll(b->lease_expirey, NULL, 10) : 0;
+
+    return !ea ? eb != 0 : (eb && ea > eb);
+}
+
+/* Restore the heap order below slot i, the lease expiring first is on top. */
+static void
+table_sift_down(struct lease_table *table, size_t i)
+{
+    struct dhcp_lease *tmp;
+    size_t child;
+
+    while ((child = 2 * i + 1) < table->n) {
+        if (child + 1 < table->n && lease_outlives(table->heap[child], table->heap[child + 1])) {
+            child++;
+        }
+        if (!lease_outlives(table->heap[i], table->heap[child])) {
+            break;
+        }
+        tmp = table->heap[i];
+        table->heap[i] = table->heap[child];
+        table->heap[child] = tmp;
+        i = child;
+    }
+}
+
+static void
+table_push(struct lease_table *table, struct dhcp_lease *lease)
+{
+    size_t i = table->n++, parent;
+
+    table->heap[i] = lease;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!lease_outlives(table->heap[parent], table->heap[i])) {
+            break;
+        }
+        table->heap[i] = table->heap[parent];
+        table->heap[parent] = lease;
+        i = parent;
+    }
+}
+
+/* Drop the lease expiring first to make room for one that lasts longer. */
+static void
+table_evict(struct lease_table *table)
+{
+    struct dhcp_lease *lease = table->heap[0];
+
+    table->heap[0] = table->heap[--table->n];
+    table_sift_down(table, 0);
+    list_del(&lease->head);
+    lease_free(table->pool, lease);
+    table->evicted++;
+}
+
+/*
+ * Add a lease read from a file, NULL fields are left out. A full table keeps the
+ * leases that last longest; with a pool a lease that does not fit is dropped.
+ */
+static int
+lease_add(struct lease_table *table, const char *expiry, const char *mac, const char *ip,
+          const char *name, const char *id, const char *family)
+{
+    struct dhcp_lease lease = {
+        .lease_expirey = (char *) expiry,
+        .mac = (char *) mac,
+        .ip = (char *) ip,
+        .name = (char *) name,
+        .id = (char *) id,
+        .family = (char *) family,
+        .source = (char *) table->source,
+    };
+    struct dhcp_lease *copy;
+
+    if (!id || !*id) {
+        return SR_ERR_OK;
+    }
+    if (table->limit && table->n == table->limit) {
+        if (!lease_outlives(&lease, table->heap[0])) {
+            table->evicted++;
+            return SR_ERR_OK;
+        }
+        table_evict(table);
+    }
+
+    copy = pool_entry_dup(table->pool, MODEL_DHCP_LEASES, &lease);
+    if (!copy) {
+        if (!table->pool) {
+            return SR_ERR_NOMEM;
+        }
+        table->dropped++;
+        return SR_ERR_OK;
+    }
+    list_add_tail(&copy->head, table->leases);
+    if (table->limit) {
+        table_push(table, copy);
+    }
+
+    return SR_ERR_OK;
+}
+
+/*
+ * Add a DHCPv6 lease. A client holds one per IA, so it is keyed by DUID and the
+ * IAID in decimal, whichever base the server writes it in.
+ */
+static int
+lease_add_v6(struct lease_table *table, const char *expiry, const char *ip, const char *name,
+             const char *duid, const char *iaid, int base)
+{
+    char id[LEASE_SLOT_STRINGS];
+    unsigned long n;
+    char *end;
+
+    n = strtoul(iaid, &end, base);
+    if (end == iaid || *end) {
+        return SR_ERR_OK;
+    }
+    snprintf(id, sizeof(id), "%s/%lu", duid, n);
+
+    return lease_add(table, expiry, NULL, ip, name, id, "ipv6");
+}
+
+/*
+ * Split line at blanks into at most max tokens, the last token takes the rest
+ * of the line. Returns the number of tokens.
+ */
+static int
+split_line(char *line, char **tokens, int max)
+{
+    char *end;
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = 0;
+    while (*line && n < max) {
+        line += strspn(line, " \t");
+        if (!*line) {
+            break;
+        }
+        tokens[n++] = line;
+        if (n == max) {
+            end = line + strlen(line);
+            while (end > line && (end[-1] == ' ' || end[-1] == '\t')) {
+                *--end = 0;
+            }
+            break;
+        }
+        line += strcspn(line, " \t");
+        if (*line) {
+            *line++ = 0;
+        }
+    }
+
+    return n;
+}
+
+/*
+ * dnsmasq: "<expiry> <mac> <ip> <name> <client-id>" per IPv4 lease, the client
+ * id is "*" when the client sent none. A "duid <server-duid>" line starts the
+ * DHCPv6 leases: "<expiry> <iaid> <ip> <name> <client-duid>", the IAID in decimal.
+ */
+static int
+parse_dnsmasq(FILE *fd, struct lease_table *table)
+{
+    char *line = NULL, *tokens[5];
+    size_t len = 0;
+    bool v6 = false;
+    int n, rc = SR_ERR_OK;
+
+    while (SR_ERR_OK == rc && getline(&line, &len, fd) > 0) {
+        n = split_line(line, tokens, 5);
+        if (n == 2 && !strcmp(tokens[0], "duid")) {
+            v6 = true;
+            continue;
+        }
+        if (n < 5) {
+            continue;
+        }
+
+        if (v6) {
+            rc = lease_add_v6(table, tokens[0], tokens[2], tokens[3], tokens[4], tokens[1], 10);
+        } else {
+            rc = lease_add(table, tokens[0], tokens[1], tokens[2], tokens[3],
+                           strcmp(tokens[4], "*") ? tokens[4] : tokens[1], "ipv4");
+        }
+    }
+    free(line);
+
+    return rc;
+}
+
+/* Drop the prefix lengths of a space separated address list, in place. */
+static void
+strip_prefix_len(char *addrs)
+{
+    char *out = addrs;
+
+    while (*addrs) {
+        if (*addrs == '/') {
+            addrs += strcspn(addrs, " ");
+            continue;
+        }
+        *out++ = *addrs++;
+    }
+    *out = 0;
+}
+
+/*
+ * odhcpd state file, one line per assignment:
+ * "# <iface> <duid> <iaid> <hostname> <valid-until> <assigned> <length> <addr/len>..."
+ * with the IAID in hex. DHCPv4 assignments carry the MAC instead of the DUID and
+ * "ipv4" instead of the IAID. A valid-until of -1 is an infinite lease, stored as
+ * dnsmasq's 0. Other lines are hosts file entries.
+ */
+static int
+parse_odhcpd(FILE *fd, struct lease_table *table)
+{
+    char *line = NULL, *tokens[9];
+    const char *expiry, *name;
+    size_t len = 0;
+    bool v4;
+    int rc = SR_ERR_OK;
+
+    while (SR_ERR_OK == rc && getline(&line, &len, fd) > 0) {
+        if (split_line(line, tokens, 9) < 9 || strcmp(tokens[0], "#")) {
+            continue;
+        }
+
+        v4 = !strcmp(tokens[3], "ipv4");
+        expiry = strcmp(tokens[5], "-1") ? tokens[5] : "0";
+        name = strcmp(tokens[4], "-") ? tokens[4] : "*";
+        strip_prefix_len(tokens[8]);
+        if (v4) {
+            rc = lease_add(table, expiry, tokens[2], tokens[8], name, tokens[2], "ipv4");
+        } else {
+            rc = lease_add_v6(table, expiry, tokens[8], name, tokens[2], tokens[3], 16);
+        }
+    }
+    free(line);
+
+    return rc;
+}
+
+static const struct lease_parser lease_parsers[] = {
+    { "dnsmasq", parse_dnsmasq },
+    { "odhcpd", parse_odhcpd },
+};
+
+const struct lease_parser *
+lease_parser_find(const char *type)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(lease_parsers) / sizeof(lease_parsers[0]); i++) {
+        if (type && !strcmp(lease_parsers[i].type, type)) {
+            return &lease_parsers[i];
+        }
+    }
+
+    return NULL;
+}
+
+void
+lease_collector_init(struct lease_collector *c, lease_update_cb update, void *priv)
+{
+    memset(c, 0, sizeof(*c));
+    pthread_mutex_init(&c->lock, NULL);
+    INIT_LIST_HEAD(&c->feeds);
+    c->update = update;
+    c->priv = priv;
+}
+
+/**
+ * @brief Add a lease source of the given type.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_INVAL_ARG for an unknown type.
+ */
+int
+lease_collector_add(struct lease_collector *c, const char *name, const char *type,
+                    const char *path)
+{
+    const struct lease_parser *parser = lease_parser_find(type);
+    struct lease_feed *feed;
+
+    if (!parser || !name || !path) {
+        fprintf(stderr, "Unusable lease source %s (%s)\n", name ? name : "", type ? type : "");
+        return SR_ERR_INVAL_ARG;
+    }
+
+    feed = calloc(1, sizeof(*feed));
+    if (!feed) {
+        return SR_ERR_NOMEM;
+    }
+    feed->name = strdup(name);
+    feed->path = strdup(path);
+    if (!feed->name || !feed->path) {
+        free(feed->name);
+        free(feed->path);
+        free(feed);
+        return SR_ERR_NOMEM;
+    }
+    feed->parser = parser;
+    feed->collector = c;
+    INIT_LIST_HEAD(&feed->leases);
+    feed->watch.inotify_fd = -1;
+    feed->watch.wake_fd[0] = feed->watch.wake_fd[1] = -1;
+    list_add_tail(&feed->head, &c->feeds);
+
+    return SR_ERR_OK;
+}
+
+/*
+ * Replace the snapshot of one source, a missing file has no leases. With a
+ * lease limit only the leases that last longest are kept.
+ */
+static int
+feed_read(struct lease_feed *feed)
+{
+    struct lease_collector *c = feed->collector;
+    struct list_head fresh = LIST_HEAD_INIT(fresh);
+    struct lease_table table = {
+        .leases = &fresh,
+        .source = feed->name,
+        .pool = c->pool,
+        .limit = c->limit,
+    };
+    FILE *fd;
+    int rc = SR_ERR_OK;
+
+    if (table.limit) {
+        table.heap = malloc(table.limit * sizeof(*table.heap));
+        if (!table.heap) {
+            return SR_ERR_NOMEM;
+        }
+    }
+
+    fd = fopen(feed->path, "r");
+    if (fd) {
+        rc = feed->parser->parse(fd, &table);
+        fclose(fd);
+    }
+    free(table.heap);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Can't read lease source %s: %s\n", feed->name, sr_strerror(rc));
+        lease_free_list(c->pool, &fresh);
+        return rc;
+    }
+
+    lease_free_list(c->pool, &feed->leases);
+    list_splice_init(&fresh, &feed->leases);
+    feed->evicted = table.evicted;
+    feed->dropped = table.dropped;
+
+    return SR_ERR_OK;
+}
+
+static void *
+feed_read_thread(void *arg)
+{
+    feed_read(arg);
+
+    return NULL;
+}
+
+/**
+ * @brief Keep at most limit leases per source and after merging them.
+ *
+ * The pool is set up with a slot for every lease of the lists that can exist at
+ * once: the snapshot of each source and the one being read, the merged leases
+ * and the ones the update callback holds. The caller destroys it after freeing
+ * those. Called after the sources were added and before they are read, a limit
+ * of 0 leaves the leases on the heap.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_NOMEM otherwise.
+ */
+int
+lease_collector_set_limit(struct lease_collector *c, struct pool *pool, size_t limit)
+{
+    struct lease_feed *feed;
+    size_t n = 0;
+    int rc;
+
+    if (!limit) {
+        return SR_ERR_OK;
+    }
+    list_for_each_entry(feed, &c->feeds, head) {
+        n++;
+    }
+    if (limit > SIZE_MAX / (2 * n + 2)) {
+        return SR_ERR_NOMEM;
+    }
+    rc = pool_init(pool, sizeof(struct dhcp_lease) + LEASE_SLOT_STRINGS, limit * (2 * n + 2));
+    if (SR_ERR_OK != rc) {
+        return rc;
+    }
+    c->pool = pool;
+    c->limit = limit;
+
+    return SR_ERR_OK;
+}
+
+/* Sort order of the merged leases when some have to go, the longest lasting first. */
+static int
+lease_expiry_cmp(const void *a, const void *b)
+{
+    const struct dhcp_lease *la = *(const struct dhcp_lease * const *) a;
+    const struct dhcp_lease *lb = *(const struct dhcp_lease * const *) b;
+
+    return lease_outlives(la, lb) ? -1 : lease_outlives(lb, la);
+}
+
+/*
+ * Merge the snapshots of all sources into leases, one entry per client. A client
+ * seen by several sources keeps the lease that lasts longest. Beyond the lease
+ * limit the clients whose leases expire first are left out. The counters of
+ * the collector are replaced by the leases left out of this merge and of the
+ * snapshots it was made from.
+ */
+static int
+collector_merge(struct lease_collector *c, struct list_head *leases)
+{
+    struct lease_feed *feed;
+    struct dhcp_lease **all = NULL, *lease, *copy;
+    size_t n = 0, m = 0, i, best;
+    unsigned long evicted = 0, dropped = 0;
+    int rc = SR_ERR_OK;
+
+    list_for_each_entry(feed, &c->feeds, head) {
+        evicted += feed->evicted;
+        dropped += feed->dropped;
+        list_for_each_entry(lease, &feed->leases, head) {
+            n++;
+        }
+    }
+    if (!n) {
+        atomic_store(&c->evicted, evicted);
+        atomic_store(&c->dropped, dropped);
+        return SR_ERR_OK;
+    }
+
+    all = malloc(n * sizeof(*all));
+    if (!all) {
+        return SR_ERR_NOMEM;
+    }
+    n = 0;
+    list_for_each_entry(feed, &c->feeds, head) {
+        list_for_each_entry(lease, &feed->leases, head) {
+            all[n++] = lease;
+        }
+    }
+    qsort(all, n, sizeof(*all), lease_cmp);
+
+    /* The lease of each client moves to the front, m of them. */
+    for (i = 0; i < n; i = best + 1) {
+        all[m] = all[i];
+        best = i;
+        while (best + 1 < n && !lease_cmp(&all[i], &all[best + 1])) {
+            best++;
+            if (lease_outlives(all[best], all[m])) {
+                all[m] = all[best];
+            }
+        }
+        m++;
+    }
+    if (c->limit && m > c->limit) {
+        qsort(all, m, sizeof(*all), lease_expiry_cmp);
+        evicted += m - c->limit;
+        m = c->limit;
+        qsort(all, m, sizeof(*all), lease_cmp);
+    }
+
+    for (i = 0; i < m; i++) {
+        copy = pool_entry_dup(c->pool, MODEL_DHCP_LEASES, all[i]);
+        if (!copy && c->pool) {
+            dropped++;
+            continue;
+        }
+        if (!copy) {
+            rc = SR_ERR_NOMEM;
+            break;
+        }
+        list_add_tail(&copy->head, leases);
+    }
+    free(all);
+
+    if (SR_ERR_OK != rc) {
+        lease_free_list(c->pool, leases);
+        return rc;
+    }
+    atomic_store(&c->evicted, evicted);
+    atomic_store(&c->dropped, dropped);
+
+    return SR_ERR_OK;
+}
+
+/**
+ * @brief Read all sources in parallel and pass the merged leases to update.
+ *
+ * @return SR_ERR_OK on success, otherwise some Sysrepo error code.
+ */
+int
+lease_collector_reload(struct lease_collector *c)
+{
+    struct list_head merged = LIST_HEAD_INIT(merged);
+    struct lease_feed *feed;
+    pthread_t *threads;
+    bool *started;
+    size_t n = 0, i;
+    int rc;
+
+    list_for_each_entry(feed, &c->feeds, head) {
+        n++;
+    }
+    threads = calloc(n ? n : 1, sizeof(*threads));
+    started = calloc(n ? n : 1, sizeof(*started));
+    if (!threads || !started) {
+        free(threads);
+        free(started);
+        return SR_ERR_NOMEM;
+    }
+
+    pthread_mutex_lock(&c->lock);
+
+    /* One thread per source, a source that can't get one is read right here. */
+    i = 0;
+    list_for_each_entry(feed, &c->feeds, head) {
+        started[i] = !pthread_create(&threads[i], NULL, feed_read_thread, feed);
+        if (!started[i]) {
+            feed_read(feed);
+        }
+        i++;
+    }
+    for (i = 0; i < n; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    rc = collector_merge(c, &merged);
+    if (SR_ERR_OK == rc) {
+        c->update(&merged, c->priv);
+        lease_free_list(c->pool, &merged);
+    }
+
+    pthread_mutex_unlock(&c->lock);
+    free(threads);
+    free(started);
+
+    return rc;
+}
+
+static void
+feed_changed(void *priv)
+{
+    struct lease_feed *feed = priv;
+    struct lease_collector *c = feed->collector;
+    struct list_head merged = LIST_HEAD_INIT(merged);
+
+    pthread_mutex_lock(&c->lock);
+    if (SR_ERR_OK == feed_read(feed) && SR_ERR_OK == collector_merge(c, &merged)) {
+        c->update(&merged, c->priv);
+        lease_free_list(c->pool, &merged);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+/**
+ * @brief Watch all sources, update is called with the merged leases on changes.
+ *
+ * A source that can't be watched is only read on reloads.
+ *
+ * @return SR_ERR_OK
+ */
+int
+lease_collector_watch(struct lease_collector *c)
+{
+    struct lease_feed *feed;
+
+    list_for_each_entry(feed, &c->feeds, head) {
+        if (SR_ERR_OK != lease_watcher_start(&feed->watch, feed->path, feed_changed, feed)) {
+            fprintf(stderr, "Lease source %s is not watched\n", feed->name);
+        }
+    }
+
+    return SR_ERR_OK;
+}
+
+void
+lease_collector_free(struct lease_collector *c)
+{
+    struct lease_feed *feed, *tmp;
+
+    list_for_each_entry(feed, &c->feeds, head) {
+        lease_watcher_stop(&feed->watch);
+    }
+
+    list_for_each_entry_safe(feed, tmp, &c->feeds, head) {
+        list_del(&feed->head);
+        lease_free_list(c->pool, &feed->leases);
+        free(feed->name);
+        free(feed->path);
+        free(feed);
+    }
+    pthread_mutex_destroy(&c->lock);
+}
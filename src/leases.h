@@ -0,0 +1,124 @@
+#ifndef LEASES_H
+#define LEASES_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include "status.h"
+#include "pool.h"
+
+#define LEASE_SLOT_STRINGS 512      /* bytes for the leaves of a pooled lease */
+
+/* Order matches the enumeration of the dhcp-lease-event notification. */
+enum lease_event {
+    LEASE_ADDED,
+    LEASE_RENEWED,
+    LEASE_RELEASED,
+    LEASE_EXPIRED,
+};
+
+/* Called for each lease that differs between two snapshots. */
+typedef void (*lease_event_cb)(enum lease_event event, const struct dhcp_lease *lease, void *priv);
+
+const char *lease_event_name(enum lease_event event);
+int lease_diff(struct list_head *old, struct list_head *new, time_t now,
+               lease_event_cb cb, void *priv);
+
+/* Called by the watcher thread after the lease file was rewritten. */
+typedef void (*lease_changed_cb)(void *priv);
+
+/*
+ * Watches the directory of the lease file with inotify, dnsmasq rewrites the
+ * file in place while other servers replace it by a rename. Until the directory
+ * exists, e.g. before the server ran for the first time, its nearest existing
+ * parent is watched for it to appear.
+ */
+struct lease_watcher {
+    pthread_t thread;
+    int inotify_fd;
+    int wake_fd[2];                 /* written to stop the thread */
+    char *dir;                      /* directory of the lease file */
+    char *name;                     /* file name inside that directory */
+    int wd;                         /* watch of dir or of a parent, -1 for none */
+    bool armed;                     /* wd watches dir itself */
+    bool running;
+
+    lease_changed_cb changed;
+    void *priv;
+};
+
+int lease_watcher_start(struct lease_watcher *w, const char *path,
+                        lease_changed_cb changed, void *priv);
+void lease_watcher_stop(struct lease_watcher *w);
+
+/*
+ * Leases read from one source. With a limit the table holds the leases that
+ * last longest, ordered in a heap with the one expiring first on top.
+ */
+struct lease_table {
+    struct list_head *leases;
+    const char *source;             /* name of the source, stored in every lease */
+    struct pool *pool;              /* NULL to allocate from the heap */
+    size_t limit;                   /* 0 for no limit */
+    struct dhcp_lease **heap;
+    size_t n;
+    unsigned long evicted;          /* left out for leases that last longer */
+    unsigned long dropped;          /* did not fit into a pool slot */
+};
+
+/* Parser for one lease file format, named like the lease-source type enum. */
+struct lease_parser {
+    const char *type;
+    int (*parse)(FILE *fd, struct lease_table *table);
+};
+
+const struct lease_parser *lease_parser_find(const char *type);
+
+/* One configured lease source and the leases last read from it. */
+struct lease_feed {
+    struct list_head head;
+    char *name;
+    char *path;
+    const struct lease_parser *parser;
+    struct list_head leases;
+    struct lease_watcher watch;
+    struct lease_collector *collector;
+    unsigned long evicted;          /* left out of leases by the last read */
+    unsigned long dropped;
+};
+
+/*
+ * Called with the merged leases of all sources after one of them changed.
+ * The callback takes over the entries of the list.
+ */
+typedef void (*lease_update_cb)(struct list_head *leases, void *priv);
+
+/*
+ * Lease sources merged into one index keyed by client. Every source has its
+ * own parser and watcher; an update of one source is merged with the last
+ * snapshots of the others.
+ */
+struct lease_collector {
+    pthread_mutex_t lock;           /* serializes reading and merging the sources */
+    struct list_head feeds;
+
+    lease_update_cb update;
+    void *priv;
+
+    struct pool *pool;              /* slots of all lease lists, NULL without a limit */
+    size_t limit;                   /* leases per source and merged, 0 for no limit */
+    atomic_ulong evicted;           /* leases left out by the last merge and the reads it used */
+    atomic_ulong dropped;
+};
+
+void lease_collector_init(struct lease_collector *c, lease_update_cb update, void *priv);
+int lease_collector_add(struct lease_collector *c, const char *name, const char *type,
+                        const char *path);
+int lease_collector_set_limit(struct lease_collector *c, struct pool *pool, size_t limit);
+int lease_collector_reload(struct lease_collector *c);
+int lease_collector_watch(struct lease_collector *c);
+void lease_collector_free(struct lease_collector *c);
+
+#endif /* LEASES_H */
@@ -0,0 +1,413 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sysrepo/values.h"
+#include "netstats.h"
+#include "xpath.h"
+
+#define NETSTATS_DIR "/sys/class/net"
+#define NETSTATS_INTERVAL_MS 1000
+#define NETSTATS_RESCAN 10              /* samples between two scans for new interfaces */
+
+static const char *netstat_files[NETSTAT_COUNT] = {
+    [NETSTAT_RX_BYTES] = "rx_bytes",
+    [NETSTAT_TX_BYTES] = "tx_bytes",
+    [NETSTAT_RX_PACKETS] = "rx_packets",
+    [NETSTAT_TX_PACKETS] = "tx_packets",
+    [NETSTAT_RX_ERRORS] = "rx_errors",
+    [NETSTAT_TX_ERRORS] = "tx_errors",
+};
+
+/* Counter leaves of an interface entry. */
+static const char *counter_leaves[NETSTAT_COUNT] = {
+    [NETSTAT_RX_BYTES] = "rx-bytes",
+    [NETSTAT_TX_BYTES] = "tx-bytes",
+    [NETSTAT_RX_PACKETS] = "rx-packets",
+    [NETSTAT_TX_PACKETS] = "tx-packets",
+    [NETSTAT_RX_ERRORS] = "rx-errors",
+    [NETSTAT_TX_ERRORS] = "tx-errors",
+};
+
+/* Rate leaves, the window is counted in samples. */
+static const struct {
+    const char *leaf;
+    enum netstat stat;
+    unsigned int window;
+} rate_leaves[] = {
+    { "rx-rate-1s", NETSTAT_RX_BYTES, 1 },
+    { "rx-rate-10s", NETSTAT_RX_BYTES, 10 },
+    { "rx-rate-60s", NETSTAT_RX_BYTES, 60 },
+    { "tx-rate-1s", NETSTAT_TX_BYTES, 1 },
+    { "tx-rate-10s", NETSTAT_TX_BYTES, 10 },
+    { "tx-rate-60s", NETSTAT_TX_BYTES, 60 },
+};
+
+#define RATE_LEAVES (sizeof(rate_leaves) / sizeof(rate_leaves[0]))
+#define IFACE_LEAVES (1 + NETSTAT_COUNT + RATE_LEAVES)
+
+static int64_t
+monotonic_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000L;
+}
+
+static void
+netstats_close(struct netstats_iface *ifc)
+{
+    int i;
+
+    for (i = 0; i < NETSTAT_COUNT; i++) {
+        if (ifc->fd[i] >= 0) {
+            close(ifc->fd[i]);
+        }
+        ifc->fd[i] = -1;
+    }
+}
+
+static int
+netstats_open(struct netstats_iface *ifc, const char *name)
+{
+    char path[PATH_MAX];
+    int i;
+
+    memset(ifc, 0, sizeof(*ifc));
+    snprintf(ifc->name, sizeof(ifc->name), "%s", name);
+    for (i = 0; i < NETSTAT_COUNT; i++) {
+        ifc->fd[i] = -1;
+    }
+    for (i = 0; i < NETSTAT_COUNT; i++) {
+        snprintf(path, sizeof(path), NETSTATS_DIR "/%s/statistics/%s", name, netstat_files[i]);
+        ifc->fd[i] = open(path, O_RDONLY | O_CLOEXEC);
+        if (ifc->fd[i] < 0) {
+            netstats_close(ifc);
+            return -1;
+        }
+    }
+    ifc->seen = true;
+
+    return 0;
+}
+
+/*
+ * Open the counters of new interfaces and close those of vanished ones. The
+ * samples of interfaces still present are kept.
+ */
+static void
+netstats_scan(struct netstats *ns)
+{
+    struct netstats_iface *tmp;
+    struct dirent *de;
+    DIR *dir;
+    size_t i, j;
+
+    dir = opendir(NETSTATS_DIR);
+    if (!dir) {
+        fprintf(stderr, "Can't list %s: %s\n", NETSTATS_DIR, strerror(errno));
+        return;
+    }
+
+    pthread_mutex_lock(&ns->lock);
+    for (i = 0; i < ns->n_ifaces; i++) {
+        ns->ifaces[i].seen = false;
+    }
+
+    while ((de = readdir(dir))) {
+        if (de->d_name[0] == '.' || strlen(de->d_name) >= IF_NAMESIZE) {
+            continue;
+        }
+        for (i = 0; i < ns->n_ifaces; i++) {
+            if (!strcmp(ns->ifaces[i].name, de->d_name)) {
+                break;
+            }
+        }
+        if (i < ns->n_ifaces) {
+            /* Files closed after a failed read may belong to a replaced device. */
+            if (ns->ifaces[i].fd[0] >= 0 || !netstats_open(&ns->ifaces[i], de->d_name)) {
+                ns->ifaces[i].seen = true;
+            }
+            continue;
+        }
+
+        tmp = realloc(ns->ifaces, (ns->n_ifaces + 1) * sizeof(*tmp));
+        if (!tmp) {
+            break;
+        }
+        ns->ifaces = tmp;
+        if (!netstats_open(&ns->ifaces[ns->n_ifaces], de->d_name)) {
+            ns->n_ifaces++;
+        }
+    }
+    closedir(dir);
+
+    for (i = 0, j = 0; i < ns->n_ifaces; i++) {
+        if (!ns->ifaces[i].seen) {
+            netstats_close(&ns->ifaces[i]);
+            continue;
+        }
+        if (i != j) {
+            ns->ifaces[j] = ns->ifaces[i];
+        }
+        j++;
+    }
+    ns->n_ifaces = j;
+    ns->rescan = false;
+    pthread_mutex_unlock(&ns->lock);
+}
+
+/*
+ * Read every counter once. The slot written is the oldest of the ring, which no
+ * window reaches back to, so readers only need the lock to see the new count.
+ */
+static void
+netstats_sample(struct netstats *ns)
+{
+    struct netstats_iface *ifc;
+    struct netstats_sample *s;
+    char buf[32];
+    ssize_t len;
+    size_t i;
+    int k;
+    int64_t now = monotonic_ms();
+    bool failed = false;
+
+    for (i = 0; i < ns->n_ifaces; i++) {
+        ifc = &ns->ifaces[i];
+        s = &ifc->ring[ifc->n_samples % NETSTATS_RING_LEN];
+        s->ms = 0;
+        if (ifc->fd[0] < 0) {
+            continue;
+        }
+        for (k = 0; k < NETSTAT_COUNT; k++) {
+            len = pread(ifc->fd[k], buf, sizeof(buf) - 1, 0);
+            if (len <= 0) {
+                break;
+            }
+            buf[len] = '\0';
+            s->v[k] = strtoull(buf, NULL, 10);
+        }
+        if (k < NETSTAT_COUNT) {
+            /* Gone or replaced, the next scan tells. */
+            netstats_close(ifc);
+            failed = true;
+            continue;
+        }
+        s->ms = now;
+    }
+
+    pthread_mutex_lock(&ns->lock);
+    for (i = 0; i < ns->n_ifaces; i++) {
+        if (ns->ifaces[i].ring[ns->ifaces[i].n_samples % NETSTATS_RING_LEN].ms) {
+            ns->ifaces[i].n_samples++;
+        }
+    }
+    ns->rescan |= failed;
+    atomic_fetch_add(&ns->generation, 1);
+    pthread_mutex_unlock(&ns->lock);
+}
+
+static void *
+netstats_thread(void *arg)
+{
+    struct netstats *ns = arg;
+    struct pollfd fd = { .fd = ns->wake_fd[0], .events = POLLIN };
+    int64_t next = monotonic_ms(), now;
+    unsigned long ticks = 0;
+    int rc;
+
+    for (;;) {
+        if (ns->rescan || !(ticks % NETSTATS_RESCAN)) {
+            netstats_scan(ns);
+        }
+        netstats_sample(ns);
+        ticks++;
+
+        /* Keep the cadence, but do not catch up on samples missed while stalled. */
+        next += NETSTATS_INTERVAL_MS;
+        now = monotonic_ms();
+        if (next <= now) {
+            next = now + NETSTATS_INTERVAL_MS;
+        }
+
+        do {
+            rc = poll(&fd, 1, next > now ? (int) (next - now) : 0);
+            now = monotonic_ms();
+        } while (rc < 0 && errno == EINTR);
+        if (rc != 0) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+int
+netstats_start(struct netstats *ns)
+{
+    int rc;
+
+    memset(ns, 0, sizeof(*ns));
+    ns->wake_fd[0] = ns->wake_fd[1] = -1;
+    atomic_init(&ns->generation, 0);
+    pthread_mutex_init(&ns->lock, NULL);
+    ns->rescan = true;
+
+    if (pipe(ns->wake_fd)) {
+        fprintf(stderr, "Can't create netstats pipe: %s\n", strerror(errno));
+        goto error;
+    }
+    rc = pthread_create(&ns->thread, NULL, netstats_thread, ns);
+    if (rc) {
+        fprintf(stderr, "Can't start netstats sampler: %s\n", strerror(rc));
+        goto error;
+    }
+    ns->running = true;
+
+    return SR_ERR_OK;
+
+  error:
+    netstats_stop(ns);
+    return SR_ERR_INTERNAL;
+}
+
+void
+netstats_stop(struct netstats *ns)
+{
+    size_t i;
+
+    if (ns->running) {
+        if (write(ns->wake_fd[1], "", 1) < 0) {
+            fprintf(stderr, "Can't wake netstats sampler: %s\n", strerror(errno));
+        }
+        pthread_join(ns->thread, NULL);
+        ns->running = false;
+    }
+    if (ns->wake_fd[0] >= 0) {
+        close(ns->wake_fd[0]);
+        close(ns->wake_fd[1]);
+    }
+    ns->wake_fd[0] = ns->wake_fd[1] = -1;
+
+    for (i = 0; i < ns->n_ifaces; i++) {
+        netstats_close(&ns->ifaces[i]);
+    }
+    free(ns->ifaces);
+    ns->ifaces = NULL;
+    ns->n_ifaces = 0;
+    pthread_mutex_destroy(&ns->lock);
+}
+
+unsigned long
+netstats_generation(struct netstats *ns)
+{
+    return atomic_load(&ns->generation);
+}
+
+/*
+ * Bits per second of a byte counter over the last window samples, or over all
+ * samples while there are fewer. A counter that went back reads as 0.
+ */
+static uint64_t
+netstats_rate(const struct netstats_iface *ifc, enum netstat stat, unsigned int window)
+{
+    const struct netstats_sample *new, *old;
+    unsigned long back;
+
+    if (ifc->n_samples < 2) {
+        return 0;
+    }
+    back = window < ifc->n_samples - 1 ? window : ifc->n_samples - 1;
+    new = &ifc->ring[(ifc->n_samples - 1) % NETSTATS_RING_LEN];
+    old = &ifc->ring[(ifc->n_samples - 1 - back) % NETSTATS_RING_LEN];
+    if (new->ms <= old->ms || new->v[stat] < old->v[stat]) {
+        return 0;
+    }
+
+    return (new->v[stat] - old->v[stat]) * 8 * 1000 / (new->ms - old->ms);
+}
+
+/**
+ * @brief Build the interface list from the latest samples.
+ *
+ * Interfaces not sampled yet are left out.
+ */
+int
+netstats_build(const char *xpath, void *arg, sr_val_t **values, size_t *values_cnt)
+{
+    struct netstats *ns = arg;
+    const struct netstats_iface *ifc;
+    const struct netstats_sample *s;
+    struct xpath_buf xb = {0,};
+    sr_val_t *v = NULL;
+    size_t i, j, n = 0, cnt = 0, prefix;
+    int rc = SR_ERR_OK;
+
+    *values = NULL;
+    *values_cnt = 0;
+
+    if (strlen(xpath) < 10 || strcmp(xpath + strlen(xpath) - 10, "/interface")) {
+        return SR_ERR_OK;
+    }
+
+    pthread_mutex_lock(&ns->lock);
+    for (i = 0; i < ns->n_ifaces; i++) {
+        cnt += ns->ifaces[i].n_samples ? IFACE_LEAVES : 0;
+    }
+    if (!cnt) {
+        goto out;
+    }
+    rc = sr_new_values(cnt, &v);
+    if (SR_ERR_OK != rc) {
+        goto out;
+    }
+
+    for (i = 0; i < ns->n_ifaces && SR_ERR_OK == rc; i++) {
+        ifc = &ns->ifaces[i];
+        if (!ifc->n_samples) {
+            continue;
+        }
+        s = &ifc->ring[(ifc->n_samples - 1) % NETSTATS_RING_LEN];
+
+        xpath_buf_truncate(&xb, 0);
+        rc = xpath_buf_append(&xb, "%s", xpath);
+        if (SR_ERR_OK == rc) {
+            rc = xpath_buf_append_key(&xb, "name", ifc->name);
+        }
+        prefix = xb.len;
+
+        if (SR_ERR_OK == rc && SR_ERR_OK == (rc = xpath_set_leaf(&v[n], &xb, prefix, "name"))) {
+            rc = sr_val_set_str_data(&v[n++], SR_STRING_T, ifc->name);
+        }
+        for (j = 0; j < NETSTAT_COUNT && SR_ERR_OK == rc; j++) {
+            rc = xpath_set_leaf(&v[n], &xb, prefix, counter_leaves[j]);
+            v[n].type = SR_UINT64_T;
+            v[n++].data.uint64_val = s->v[j];
+        }
+        for (j = 0; j < RATE_LEAVES && SR_ERR_OK == rc; j++) {
+            rc = xpath_set_leaf(&v[n], &xb, prefix, rate_leaves[j].leaf);
+            v[n].type = SR_UINT64_T;
+            v[n++].data.uint64_val = netstats_rate(ifc, rate_leaves[j].stat, rate_leaves[j].window);
+        }
+    }
+    if (SR_ERR_OK != rc) {
+        sr_free_values(v, cnt);
+        goto out;
+    }
+    *values = v;
+    *values_cnt = n;
+
+  out:
+    pthread_mutex_unlock(&ns->lock);
+    xpath_buf_free(&xb);
+
+    return rc;
+}
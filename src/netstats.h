@@ -0,0 +1,61 @@
+#ifndef NETSTATS_H
+#define NETSTATS_H
+
+#include <net/if.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "sysrepo.h"
+
+#define NETSTATS_RING_LEN 64            /* samples kept, more than the longest window */
+
+/* Counters read from /sys/class/net/<if>/statistics. */
+enum netstat {
+    NETSTAT_RX_BYTES,
+    NETSTAT_TX_BYTES,
+    NETSTAT_RX_PACKETS,
+    NETSTAT_TX_PACKETS,
+    NETSTAT_RX_ERRORS,
+    NETSTAT_TX_ERRORS,
+    NETSTAT_COUNT
+};
+
+struct netstats_sample {
+    int64_t ms;                         /* CLOCK_MONOTONIC */
+    uint64_t v[NETSTAT_COUNT];
+};
+
+/* One interface, its counter files kept open and its latest samples. */
+struct netstats_iface {
+    char name[IF_NAMESIZE];
+    int fd[NETSTAT_COUNT];
+    struct netstats_sample ring[NETSTATS_RING_LEN];
+    unsigned long n_samples;            /* taken so far, the newest is at (n - 1) % len */
+    bool seen;                          /* still listed by the last scan */
+};
+
+/*
+ * Samples the traffic counters of all interfaces once a second. Each sample is
+ * one pread per counter, the files are only opened when an interface appears.
+ * Rates over a window compare the newest sample with the one that many slots
+ * back in the ring.
+ */
+struct netstats {
+    pthread_t thread;
+    bool running;
+    int wake_fd[2];                     /* written to stop the thread */
+
+    pthread_mutex_t lock;               /* guards the interfaces */
+    struct netstats_iface *ifaces;
+    size_t n_ifaces;
+    bool rescan;                        /* reading an interface failed */
+    atomic_ulong generation;            /* samples taken */
+};
+
+int netstats_start(struct netstats *ns);
+void netstats_stop(struct netstats *ns);
+unsigned long netstats_generation(struct netstats *ns);
+int netstats_build(const char *xpath, void *arg, sr_val_t **values, size_t *values_cnt);
+
+#endif /* NETSTATS_H */
@@ -0,0 +1,184 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sysrepo.h"
+#include "pool.h"
+
+/* Slots are handed out as structs, keep each one aligned for any of them. */
+#define POOL_ALIGN _Alignof(max_align_t)
+
+/**
+ * @brief Allocate n_slots slots of at least slot_size bytes.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_NOMEM otherwise.
+ */
+int
+pool_init(struct pool *p, size_t slot_size, size_t n_slots)
+{
+    memset(p, 0, sizeof(*p));
+    pthread_mutex_init(&p->lock, NULL);
+    if (slot_size < sizeof(void *)) {
+        slot_size = sizeof(void *);
+    }
+    p->slot_size = (slot_size + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN;
+    if (n_slots > SIZE_MAX / p->slot_size) {
+        goto error;
+    }
+
+    /* Slots are handed out in order before any is reused, pages never needed stay untouched. */
+    p->slots = malloc(n_slots * p->slot_size);
+    if (!p->slots && n_slots) {
+        goto error;
+    }
+    p->n_slots = n_slots;
+
+    return SR_ERR_OK;
+
+  error:
+    pool_destroy(p);
+    return SR_ERR_NOMEM;
+}
+
+/* Releases all slots, entries still taken from the pool become invalid. */
+void
+pool_destroy(struct pool *p)
+{
+    if (p->slot_size) {
+        free(p->slots);
+        pthread_mutex_destroy(&p->lock);
+    }
+    memset(p, 0, sizeof(*p));
+}
+
+/**
+ * @brief Take a zeroed slot.
+ *
+ * @return Slot or NULL when all of them are in use.
+ */
+void *
+pool_get(struct pool *p)
+{
+    void *slot;
+
+    pthread_mutex_lock(&p->lock);
+    slot = p->free;
+    if (slot) {
+        p->free = *(void **) slot;
+    } else if (p->n_touched < p->n_slots) {
+        slot = p->slots + p->n_touched++ * p->slot_size;
+    }
+    if (slot) {
+        p->used++;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (slot) {
+        memset(slot, 0, p->slot_size);
+    }
+
+    return slot;
+}
+
+void
+pool_put(struct pool *p, void *slot)
+{
+    pthread_mutex_lock(&p->lock);
+    *(void **) slot = p->free;
+    p->free = slot;
+    p->used--;
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* The pointer lies in a slot of the pool, false for a NULL pool. */
+bool
+pool_owns(const struct pool *p, const void *ptr)
+{
+    const char *c = ptr;
+
+    return p && p->slots && c >= p->slots && c < p->slots + p->n_slots * p->slot_size;
+}
+
+/**
+ * @brief Copy a model entry, into a slot of the pool or to the heap without one.
+ *
+ * Pooled copies hold their strings behind the struct. The entry is not
+ * linked into any list.
+ *
+ * @return Copy or NULL when the pool is exhausted, the strings do not fit into
+ * a slot or memory ran out.
+ */
+void *
+pool_entry_dup(struct pool *p, enum model_node_id id, const void *entry)
+{
+    const struct model_node *node = &model_nodes[id];
+    const struct model_leaf *leaf;
+    size_t i, len, need = node->size;
+    char *copy, *str;
+
+    if (p) {
+        for (i = 0; i < node->n_leaves; i++) {
+            leaf = &node->leaves[i];
+            if (MODEL_LEAF_IS_STR(leaf) && MODEL_LEAF_STR(entry, leaf)) {
+                need += strlen(MODEL_LEAF_STR(entry, leaf)) + 1;
+            }
+        }
+        if (need > p->slot_size) {
+            return NULL;
+        }
+        copy = pool_get(p);
+    } else {
+        copy = calloc(1, node->size);
+    }
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, entry, node->size);
+
+    str = copy + node->size;
+    for (i = 0; i < node->n_leaves; i++) {
+        leaf = &node->leaves[i];
+        if (!MODEL_LEAF_IS_STR(leaf) || !MODEL_LEAF_STR(entry, leaf)) {
+            continue;
+        }
+        if (p) {
+            len = strlen(MODEL_LEAF_STR(entry, leaf)) + 1;
+            memcpy(str, MODEL_LEAF_STR(entry, leaf), len);
+            MODEL_LEAF_STR(copy, leaf) = str;
+            str += len;
+            continue;
+        }
+        MODEL_LEAF_STR(copy, leaf) = strdup(MODEL_LEAF_STR(entry, leaf));
+        if (!MODEL_LEAF_STR(copy, leaf)) {
+            /* Leaves not copied yet still point into entry. */
+            for (; i < node->n_leaves; i++) {
+                if (MODEL_LEAF_IS_STR(&node->leaves[i])) {
+                    MODEL_LEAF_STR(copy, &node->leaves[i]) = NULL;
+                }
+            }
+            pool_entry_free(NULL, id, copy);
+            return NULL;
+        }
+    }
+
+    return copy;
+}
+
+/* Free an entry, whether it was taken from the pool or from the heap. */
+void
+pool_entry_free(struct pool *p, enum model_node_id id, void *entry)
+{
+    const struct model_node *node = &model_nodes[id];
+    size_t i;
+
+    if (pool_owns(p, entry)) {
+        pool_put(p, entry);
+        return;
+    }
+    for (i = 0; i < node->n_leaves; i++) {
+        if (MODEL_LEAF_IS_STR(&node->leaves[i])) {
+            free(MODEL_LEAF_STR(entry, &node->leaves[i]));
+        }
+    }
+    free(entry);
+}
@@ -0,0 +1,33 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "status.h"
+
+/*
+ * A fixed number of equally sized slots, allocated once. Model entries taken
+ * from a pool keep their strings in the slot behind the struct, so a list
+ * can never take more memory than its pool, however many entries are offered.
+ */
+struct pool {
+    pthread_mutex_t lock;
+    char *slots;
+    size_t slot_size;
+    size_t n_slots;
+    size_t n_touched;               /* slots handed out at least once */
+    void *free;                     /* returned slots, linked through their first word */
+    size_t used;
+};
+
+int pool_init(struct pool *p, size_t slot_size, size_t n_slots);
+void pool_destroy(struct pool *p);
+void *pool_get(struct pool *p);
+void pool_put(struct pool *p, void *slot);
+bool pool_owns(const struct pool *p, const void *ptr);
+
+void *pool_entry_dup(struct pool *p, enum model_node_id id, const void *entry);
+void pool_entry_free(struct pool *p, enum model_node_id id, void *entry);
+
+#endif /* POOL_H */
@@ -0,0 +1,614 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libubus.h>
+#include <libubox/blobmsg.h>
+#include "sysrepo/values.h"
+#include "bus.h"
+#include "runtime.h"
+#include "stations.h"
+#include "xpath.h"
+
+#define RUNTIME_UBUS_TIMEOUT 2000       /* ms for the replies of one collection */
+#define RUNTIME_STATIONS_MIN 64         /* first allocation of a station array */
+
+/* Requests sent per interface before any reply is awaited. */
+enum runtime_req {
+    REQ_INFO,                           /* iwinfo info */
+    REQ_ASSOCLIST,                      /* iwinfo assoclist */
+    REQ_CLIENTS,                        /* hostapd.<ifname> get_clients */
+    REQ_COUNT
+};
+
+/* State of one interface while its replies come in. */
+struct iface_collect {
+    struct iface_runtime *ifr;
+    struct station *clients;            /* hostapd clients, merged into the stations */
+    size_t n_clients;
+    size_t size;
+    struct ubus_request reqs[REQ_COUNT];
+    bool sent[REQ_COUNT];
+};
+
+void
+wifi_runtime_init(struct wifi_runtime *rt, struct bus *bus)
+{
+    memset(rt, 0, sizeof(*rt));
+    pthread_mutex_init(&rt->lock, NULL);
+    rt->bus = bus;
+}
+
+static void
+runtime_free_ifaces(struct iface_runtime *ifaces, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        free(ifaces[i].section);
+        free(ifaces[i].ifname);
+        free(ifaces[i].stations);
+    }
+    free(ifaces);
+}
+
+void
+wifi_runtime_free(struct wifi_runtime *rt)
+{
+    runtime_free_ifaces(rt->ifaces, rt->n_ifaces);
+    rt->ifaces = NULL;
+    rt->n_ifaces = 0;
+    pthread_mutex_destroy(&rt->lock);
+}
+
+/* Append a zeroed station, the array grows by doubling. */
+struct station *
+station_add(struct station **stations, size_t *n, size_t *size, const char *mac)
+{
+    struct station *tmp, *sta;
+    size_t new_size;
+
+    if (*n == *size) {
+        new_size = *size ? *size * 2 : RUNTIME_STATIONS_MIN;
+        tmp = realloc(*stations, new_size * sizeof(*tmp));
+        if (!tmp) {
+            return NULL;
+        }
+        *stations = tmp;
+        *size = new_size;
+    }
+
+    sta = &(*stations)[(*n)++];
+    memset(sta, 0, sizeof(*sta));
+    snprintf(sta->mac, sizeof(sta->mac), "%s", mac);
+
+    return sta;
+}
+
+/* qsort order of stations, by MAC regardless of case. */
+int
+station_cmp(const void *a, const void *b)
+{
+    return strcasecmp(((const struct station *) a)->mac, ((const struct station *) b)->mac);
+}
+
+/* network.wireless status: the ifname of every configured wifi-iface section. */
+static void
+wireless_status_cb(struct ubus_request *req, int type, struct blob_attr *msg)
+{
+    static const struct blobmsg_policy radio_policy[] = {
+        { "interfaces", BLOBMSG_TYPE_ARRAY },
+    };
+    static const struct blobmsg_policy iface_policy[] = {
+        { "section", BLOBMSG_TYPE_STRING },
+        { "ifname", BLOBMSG_TYPE_STRING },
+    };
+    struct wifi_runtime *fresh = req->priv;
+    struct blob_attr *radio, *iface, *tb_radio[1], *tb_iface[2];
+    struct iface_runtime *tmp, *ifr;
+    int rem, rem_if;
+
+    if (!msg) {
+        return;
+    }
+
+    blobmsg_for_each_attr(radio, msg, rem) {
+        blobmsg_parse(radio_policy, 1, tb_radio, blobmsg_data(radio), blobmsg_data_len(radio));
+        if (!tb_radio[0]) {
+            continue;
+        }
+        blobmsg_for_each_attr(iface, tb_radio[0], rem_if) {
+            blobmsg_parse(iface_policy, 2, tb_iface, blobmsg_data(iface), blobmsg_data_len(iface));
+            if (!tb_iface[0] || !tb_iface[1]) {
+                continue;
+            }
+            tmp = realloc(fresh->ifaces, (fresh->n_ifaces + 1) * sizeof(*tmp));
+            if (!tmp) {
+                return;
+            }
+            fresh->ifaces = tmp;
+            ifr = &fresh->ifaces[fresh->n_ifaces];
+            memset(ifr, 0, sizeof(*ifr));
+            ifr->section = strdup(blobmsg_get_string(tb_iface[0]));
+            ifr->ifname = strdup(blobmsg_get_string(tb_iface[1]));
+            if (!ifr->section || !ifr->ifname) {
+                free(ifr->section);
+                free(ifr->ifname);
+                return;
+            }
+            fresh->n_ifaces++;
+        }
+    }
+}
+
+/* iwinfo info: channel, frequency, tx power and noise of the interface. */
+static void
+iwinfo_info_cb(struct ubus_request *req, int type, struct blob_attr *msg)
+{
+    enum { INFO_CHANNEL, INFO_FREQUENCY, INFO_TXPOWER, INFO_NOISE, INFO_MAX };
+    static const struct blobmsg_policy policy[INFO_MAX] = {
+        [INFO_CHANNEL] = { "channel", BLOBMSG_TYPE_INT32 },
+        [INFO_FREQUENCY] = { "frequency", BLOBMSG_TYPE_INT32 },
+        [INFO_TXPOWER] = { "txpower", BLOBMSG_TYPE_INT32 },
+        [INFO_NOISE] = { "noise", BLOBMSG_TYPE_INT32 },
+    };
+    struct iface_collect *ic = req->priv;
+    struct blob_attr *tb[INFO_MAX];
+
+    if (!msg) {
+        return;
+    }
+
+    blobmsg_parse(policy, INFO_MAX, tb, blob_data(msg), blob_len(msg));
+    if (tb[INFO_CHANNEL]) {
+        ic->ifr->channel = blobmsg_get_u32(tb[INFO_CHANNEL]);
+    }
+    if (tb[INFO_FREQUENCY]) {
+        ic->ifr->frequency = blobmsg_get_u32(tb[INFO_FREQUENCY]);
+    }
+    if (tb[INFO_TXPOWER]) {
+        ic->ifr->tx_power = (int32_t) blobmsg_get_u32(tb[INFO_TXPOWER]);
+    }
+    if (tb[INFO_NOISE]) {
+        ic->ifr->noise = (int32_t) blobmsg_get_u32(tb[INFO_NOISE]);
+    }
+}
+
+/* Rate of an iwinfo "rx"/"tx" table, in kbit/s. */
+static uint32_t
+iwinfo_rate(struct blob_attr *attr)
+{
+    static const struct blobmsg_policy policy[] = {
+        { "rate", BLOBMSG_TYPE_INT32 },
+    };
+    struct blob_attr *tb[1];
+
+    if (!attr) {
+        return 0;
+    }
+    blobmsg_parse(policy, 1, tb, blobmsg_data(attr), blobmsg_data_len(attr));
+
+    return tb[0] ? blobmsg_get_u32(tb[0]) : 0;
+}
+
+/* iwinfo assoclist: signal, rates and times of every associated station. */
+static void
+iwinfo_assoclist_cb(struct ubus_request *req, int type, struct blob_attr *msg)
+{
+    enum { STA_MAC, STA_SIGNAL, STA_NOISE, STA_INACTIVE, STA_CONNECTED, STA_RX, STA_TX, STA_MAX };
+    static const struct blobmsg_policy policy[STA_MAX] = {
+        [STA_MAC] = { "mac", BLOBMSG_TYPE_STRING },
+        [STA_SIGNAL] = { "signal", BLOBMSG_TYPE_INT32 },
+        [STA_NOISE] = { "noise", BLOBMSG_TYPE_INT32 },
+        [STA_INACTIVE] = { "inactive", BLOBMSG_TYPE_INT32 },
+        [STA_CONNECTED] = { "connected_time", BLOBMSG_TYPE_INT32 },
+        [STA_RX] = { "rx", BLOBMSG_TYPE_TABLE },
+        [STA_TX] = { "tx", BLOBMSG_TYPE_TABLE },
+    };
+    static const struct blobmsg_policy results_policy[] = {
+        { "results", BLOBMSG_TYPE_ARRAY },
+    };
+    struct iface_collect *ic = req->priv;
+    struct iface_runtime *ifr = ic->ifr;
+    struct blob_attr *results[1], *entry, *tb[STA_MAX];
+    struct station *sta;
+    int rem;
+
+    if (!msg) {
+        return;
+    }
+
+    blobmsg_parse(results_policy, 1, results, blob_data(msg), blob_len(msg));
+    blobmsg_for_each_attr(entry, results[0], rem) {
+        blobmsg_parse(policy, STA_MAX, tb, blobmsg_data(entry), blobmsg_data_len(entry));
+        if (!tb[STA_MAC]) {
+            continue;
+        }
+        sta = station_add(&ifr->stations, &ifr->n_stations, &ifr->size,
+                          blobmsg_get_string(tb[STA_MAC]));
+        if (!sta) {
+            return;
+        }
+        sta->signal = tb[STA_SIGNAL] ? (int32_t) blobmsg_get_u32(tb[STA_SIGNAL]) : 0;
+        sta->noise = tb[STA_NOISE] ? (int32_t) blobmsg_get_u32(tb[STA_NOISE]) : 0;
+        sta->inactive = tb[STA_INACTIVE] ? blobmsg_get_u32(tb[STA_INACTIVE]) : 0;
+        sta->connected_time = tb[STA_CONNECTED] ? blobmsg_get_u32(tb[STA_CONNECTED]) : 0;
+        sta->rx_rate = iwinfo_rate(tb[STA_RX]);
+        sta->tx_rate = iwinfo_rate(tb[STA_TX]);
+    }
+}
+
+/* hostapd get_clients: the authorization state, keyed by station MAC. */
+static void
+hostapd_clients_cb(struct ubus_request *req, int type, struct blob_attr *msg)
+{
+    static const struct blobmsg_policy clients_policy[] = {
+        { "clients", BLOBMSG_TYPE_TABLE },
+    };
+    static const struct blobmsg_policy client_policy[] = {
+        { "authorized", BLOBMSG_TYPE_BOOL },
+    };
+    struct iface_collect *ic = req->priv;
+    struct blob_attr *clients[1], *client, *tb[1];
+    struct station *sta;
+    int rem;
+
+    if (!msg) {
+        return;
+    }
+
+    blobmsg_parse(clients_policy, 1, clients, blob_data(msg), blob_len(msg));
+    blobmsg_for_each_attr(client, clients[0], rem) {
+        blobmsg_parse(client_policy, 1, tb, blobmsg_data(client), blobmsg_data_len(client));
+        sta = station_add(&ic->clients, &ic->n_clients, &ic->size, blobmsg_name(client));
+        if (!sta) {
+            return;
+        }
+        sta->authorized = tb[0] && blobmsg_get_bool(tb[0]);
+    }
+}
+
+/*
+ * Merge the hostapd clients into the iwinfo stations. Both are sorted, clients
+ * iwinfo did not report are added with what hostapd knows.
+ */
+static void
+runtime_merge_clients(struct iface_collect *ic)
+{
+    struct iface_runtime *ifr = ic->ifr;
+    size_t i = 0, j = 0, n_stations;
+    struct station *sta;
+    int cmp;
+
+    qsort(ifr->stations, ifr->n_stations, sizeof(*ifr->stations), station_cmp);
+    qsort(ic->clients, ic->n_clients, sizeof(*ic->clients), station_cmp);
+
+    n_stations = ifr->n_stations;
+    while (j < ic->n_clients) {
+        cmp = i < n_stations ? station_cmp(&ifr->stations[i], &ic->clients[j]) : 1;
+        if (cmp < 0) {
+            i++;
+        } else if (cmp == 0) {
+            ifr->stations[i++].authorized = ic->clients[j++].authorized;
+        } else {
+            sta = station_add(&ifr->stations, &ifr->n_stations, &ifr->size, ic->clients[j].mac);
+            if (!sta) {
+                break;
+            }
+            sta->authorized = ic->clients[j++].authorized;
+        }
+    }
+
+    if (ifr->n_stations != n_stations) {
+        qsort(ifr->stations, ifr->n_stations, sizeof(*ifr->stations), station_cmp);
+    }
+}
+
+/* Send one request without waiting for its reply. */
+static void
+runtime_send(struct bus *bus, struct iface_collect *ic, enum runtime_req r,
+             const char *object, const char *method, ubus_data_handler_t cb)
+{
+    struct blob_buf buf = {0,};
+    uint32_t id;
+
+    if (UBUS_STATUS_OK != bus_lookup(bus, object, &id)) {
+        return;
+    }
+
+    blob_buf_init(&buf, 0);
+    if (r != REQ_CLIENTS) {
+        blobmsg_add_string(&buf, "device", ic->ifr->ifname);
+    }
+    if (UBUS_STATUS_OK == ubus_invoke_async(bus->ctx, id, method, buf.head, &ic->reqs[r])) {
+        ic->reqs[r].data_cb = cb;
+        ic->reqs[r].priv = ic;
+        ic->sent[r] = true;
+    }
+    blob_buf_free(&buf);
+}
+
+/**
+ * @brief Collect the live state of all wifi interfaces.
+ *
+ * All iwinfo and hostapd requests of all interfaces are sent before the first
+ * reply is awaited, so the daemons answer them while earlier replies are parsed.
+ * The shared ubus connection is held for the whole collection. The new
+ * snapshot replaces the previous one.
+ *
+ * @return SR_ERR_OK on success, otherwise some Sysrepo error code.
+ */
+int
+wifi_runtime_collect(struct wifi_runtime *rt)
+{
+    struct wifi_runtime fresh = {0,};
+    struct iface_collect *collect = NULL;
+    struct ubus_context *ctx;
+    struct iface_runtime *old;
+    char object[64];
+    uint32_t id;
+    size_t i, n_old;
+    bool monitored;
+    int r, rc;
+
+    pthread_mutex_lock(&rt->lock);
+    monitored = rt->monitor != NULL;
+    pthread_mutex_unlock(&rt->lock);
+
+    ctx = bus_get(rt->bus);
+    if (!ctx) {
+        return SR_ERR_DISCONNECT;
+    }
+
+    rc = bus_lookup(rt->bus, "network.wireless", &id);
+    if (UBUS_STATUS_OK == rc) {
+        rc = ubus_invoke(ctx, id, "status", NULL, wireless_status_cb, &fresh,
+                         RUNTIME_UBUS_TIMEOUT);
+    }
+    if (UBUS_STATUS_OK != rc) {
+        fprintf(stderr, "ubus [%d]: no wireless status\n", rc);
+        if (UBUS_STATUS_NOT_FOUND == rc) {
+            bus_forget(rt->bus, "network.wireless");
+        }
+        bus_put(rt->bus);
+        runtime_free_ifaces(fresh.ifaces, fresh.n_ifaces);
+        return UBUS_STATUS_CONNECTION_FAILED == rc ? SR_ERR_DISCONNECT : SR_ERR_INTERNAL;
+    }
+
+    collect = calloc(fresh.n_ifaces ? fresh.n_ifaces : 1, sizeof(*collect));
+    if (!collect) {
+        bus_put(rt->bus);
+        runtime_free_ifaces(fresh.ifaces, fresh.n_ifaces);
+        return SR_ERR_NOMEM;
+    }
+
+    for (i = 0; i < fresh.n_ifaces; i++) {
+        collect[i].ifr = &fresh.ifaces[i];
+        snprintf(object, sizeof(object), "hostapd.%s", fresh.ifaces[i].ifname);
+        runtime_send(rt->bus, &collect[i], REQ_INFO, "iwinfo", "info", iwinfo_info_cb);
+        if (monitored) {
+            /* The station monitor follows the associations. */
+            continue;
+        }
+        runtime_send(rt->bus, &collect[i], REQ_ASSOCLIST, "iwinfo", "assoclist", iwinfo_assoclist_cb);
+        runtime_send(rt->bus, &collect[i], REQ_CLIENTS, object, "get_clients", hostapd_clients_cb);
+    }
+
+    for (i = 0; i < fresh.n_ifaces; i++) {
+        for (r = 0; r < REQ_COUNT; r++) {
+            if (!collect[i].sent[r]) {
+                continue;
+            }
+            rc = ubus_complete_request(ctx, &collect[i].reqs[r], RUNTIME_UBUS_TIMEOUT);
+            if (UBUS_STATUS_NOT_FOUND == rc && r == REQ_CLIENTS) {
+                snprintf(object, sizeof(object), "hostapd.%s", fresh.ifaces[i].ifname);
+                bus_forget(rt->bus, object);
+            } else if (UBUS_STATUS_NOT_FOUND == rc) {
+                bus_forget(rt->bus, "iwinfo");
+            }
+        }
+        runtime_merge_clients(&collect[i]);
+        free(collect[i].clients);
+    }
+    free(collect);
+    bus_put(rt->bus);
+
+    pthread_mutex_lock(&rt->lock);
+    old = rt->ifaces;
+    n_old = rt->n_ifaces;
+    rt->ifaces = fresh.ifaces;
+    rt->n_ifaces = fresh.n_ifaces;
+    pthread_mutex_unlock(&rt->lock);
+    runtime_free_ifaces(old, n_old);
+
+    return SR_ERR_OK;
+}
+
+/**
+ * @brief Take the station lists from a station monitor instead of polling them.
+ *
+ * @param[in] monitor Running monitor, NULL polls iwinfo and hostapd again.
+ */
+void
+wifi_runtime_set_monitor(struct wifi_runtime *rt, struct station_monitor *monitor)
+{
+    pthread_mutex_lock(&rt->lock);
+    rt->monitor = monitor;
+    pthread_mutex_unlock(&rt->lock);
+}
+
+/* Leaves of the runtime container. */
+static int
+runtime_iface_values(const struct iface_runtime *ifr, struct xpath_buf *xb, sr_val_t *v, size_t *n)
+{
+    size_t prefix = xb->len;
+    int rc;
+
+    rc = xpath_set_leaf(&v[*n], xb, prefix, "ifname");
+    if (SR_ERR_OK == rc) {
+        rc = sr_val_set_str_data(&v[(*n)++], SR_STRING_T, ifr->ifname);
+    }
+    if (SR_ERR_OK == rc && SR_ERR_OK == (rc = xpath_set_leaf(&v[*n], xb, prefix, "channel"))) {
+        v[*n].type = SR_UINT32_T;
+        v[(*n)++].data.uint32_val = ifr->channel;
+    }
+    if (SR_ERR_OK == rc && SR_ERR_OK == (rc = xpath_set_leaf(&v[*n], xb, prefix, "frequency"))) {
+        v[*n].type = SR_UINT32_T;
+        v[(*n)++].data.uint32_val = ifr->frequency;
+    }
+    if (SR_ERR_OK == rc && SR_ERR_OK == (rc = xpath_set_leaf(&v[*n], xb, prefix, "tx-power"))) {
+        v[*n].type = SR_INT32_T;
+        v[(*n)++].data.int32_val = ifr->tx_power;
+    }
+    if (SR_ERR_OK == rc && SR_ERR_OK == (rc = xpath_set_leaf(&v[*n], xb, prefix, "noise"))) {
+        v[*n].type = SR_INT32_T;
+        v[(*n)++].data.int32_val = ifr->noise;
+    }
+    if (SR_ERR_OK == rc && SR_ERR_OK == (rc = xpath_set_leaf(&v[*n], xb, prefix, "station-count"))) {
+        v[*n].type = SR_UINT32_T;
+        v[(*n)++].data.uint32_val = ifr->n_stations;
+    }
+
+    return rc;
+}
+
+#define STATION_LEAVES 8
+
+/* Entries of the station list, one xpath prefix per station reused for its leaves. */
+static int
+runtime_station_values(const struct iface_runtime *ifr, struct xpath_buf *xb, sr_val_t *v, size_t *n)
+{
+    static const char *leaves[STATION_LEAVES] = {
+        "mac", "signal", "noise", "tx-rate", "rx-rate", "connected-time", "inactive", "authorized"
+    };
+    const struct station *sta;
+    size_t base = xb->len, prefix, i, j;
+    int rc = SR_ERR_OK;
+
+    for (i = 0; i < ifr->n_stations && SR_ERR_OK == rc; i++) {
+        sta = &ifr->stations[i];
+        xpath_buf_truncate(xb, base);
+        rc = xpath_buf_append_key(xb, "mac", sta->mac);
+        prefix = xb->len;
+
+        for (j = 0; j < STATION_LEAVES && SR_ERR_OK == rc; j++) {
+            rc = xpath_set_leaf(&v[*n], xb, prefix, leaves[j]);
+            if (SR_ERR_OK != rc) {
+                break;
+            }
+            switch (j) {
+            case 0:
+                rc = sr_val_set_str_data(&v[*n], SR_STRING_T, sta->mac);
+                break;
+            case 1:
+                v[*n].type = SR_INT32_T;
+                v[*n].data.int32_val = sta->signal;
+                break;
+            case 2:
+                v[*n].type = SR_INT32_T;
+                v[*n].data.int32_val = sta->noise;
+                break;
+            case 3:
+                v[*n].type = SR_UINT32_T;
+                v[*n].data.uint32_val = sta->tx_rate;
+                break;
+            case 4:
+                v[*n].type = SR_UINT32_T;
+                v[*n].data.uint32_val = sta->rx_rate;
+                break;
+            case 5:
+                v[*n].type = SR_UINT32_T;
+                v[*n].data.uint32_val = sta->connected_time;
+                break;
+            case 6:
+                v[*n].type = SR_UINT32_T;
+                v[*n].data.uint32_val = sta->inactive;
+                break;
+            default:
+                v[*n].type = SR_BOOL_T;
+                v[*n].data.bool_val = sta->authorized;
+                break;
+            }
+            (*n)++;
+        }
+    }
+
+    return rc;
+}
+
+/**
+ * @brief Build the runtime container or station list of one wifi-iface.
+ *
+ * The wifi-iface entry is taken from the key in xpath, interfaces without live
+ * state have no values.
+ */
+int
+wifi_runtime_build(const char *xpath, void *arg, sr_val_t **values, size_t *values_cnt)
+{
+    struct wifi_runtime *rt = arg;
+    const struct iface_runtime *ifr = NULL;
+    struct iface_runtime view;
+    struct station *copy = NULL;
+    struct xpath_buf xb = {0,};
+    bool stations;
+    const char *key;
+    sr_val_t *v = NULL;
+    size_t key_len = 0, i, n = 0, cnt;
+    int rc = SR_ERR_OK;
+
+    *values = NULL;
+    *values_cnt = 0;
+
+    key = xpath_list_key(xpath, "wifi-iface", &key_len);
+    if (!key) {
+        return SR_ERR_OK;
+    }
+    stations = strlen(xpath) > 8 && !strcmp(xpath + strlen(xpath) - 8, "/station");
+
+    pthread_mutex_lock(&rt->lock);
+    for (i = 0; i < rt->n_ifaces; i++) {
+        if (strlen(rt->ifaces[i].section) == key_len &&
+            !strncmp(rt->ifaces[i].section, key, key_len)) {
+            ifr = &rt->ifaces[i];
+            break;
+        }
+    }
+    if (ifr && rt->monitor) {
+        view = *ifr;
+        rc = station_monitor_copy(rt->monitor, ifr->ifname, &copy, &view.n_stations);
+        if (SR_ERR_OK != rc) {
+            goto out;
+        }
+        /* nl80211 has no noise per station, iwinfo reports the interface's too. */
+        for (i = 0; i < view.n_stations; i++) {
+            copy[i].noise = ifr->noise;
+        }
+        view.stations = copy;
+        ifr = &view;
+    }
+    if (!ifr || (stations && !ifr->n_stations)) {
+        goto out;
+    }
+
+    cnt = stations ? ifr->n_stations * STATION_LEAVES : 6;
+    rc = sr_new_values(cnt, &v);
+    if (SR_ERR_OK != rc) {
+        goto out;
+    }
+    rc = xpath_buf_append(&xb, "%s", xpath);
+    if (SR_ERR_OK == rc) {
+        rc = stations ? runtime_station_values(ifr, &xb, v, &n) : runtime_iface_values(ifr, &xb, v, &n);
+    }
+    if (SR_ERR_OK != rc) {
+        sr_free_values(v, cnt);
+        goto out;
+    }
+    *values = v;
+    *values_cnt = n;
+
+  out:
+    pthread_mutex_unlock(&rt->lock);
+    free(copy);
+    xpath_buf_free(&xb);
+
+    return rc;
+}
@@ -0,0 +1,61 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "sysrepo.h"
+
+#define RUNTIME_MAC_LEN 18              /* "aa:bb:cc:dd:ee:ff" */
+
+struct bus;
+struct station_monitor;
+
+/* One associated station, merged from iwinfo's assoclist and hostapd's clients. */
+struct station {
+    char mac[RUNTIME_MAC_LEN];
+    int32_t signal;
+    int32_t noise;
+    uint32_t tx_rate;
+    uint32_t rx_rate;
+    uint32_t connected_time;
+    uint32_t inactive;
+    bool authorized;
+};
+
+/* Live state of one wifi-iface, stations sorted by MAC. */
+struct iface_runtime {
+    char *section;                      /* wifi-iface key, the UCI section name */
+    char *ifname;
+    uint32_t channel;
+    uint32_t frequency;
+    int32_t tx_power;
+    int32_t noise;
+    struct station *stations;
+    size_t n_stations;
+    size_t size;
+};
+
+/*
+ * Runtime wifi state, collected over the plugin's shared ubus connection.
+ * The snapshot is replaced as a whole by each collection.
+ */
+struct wifi_runtime {
+    struct bus *bus;
+
+    pthread_mutex_t lock;               /* guards the snapshot and monitor */
+    struct station_monitor *monitor;    /* source of the station lists, NULL polls them */
+    struct iface_runtime *ifaces;
+    size_t n_ifaces;
+};
+
+struct station *station_add(struct station **stations, size_t *n, size_t *size, const char *mac);
+int station_cmp(const void *a, const void *b);
+
+void wifi_runtime_init(struct wifi_runtime *rt, struct bus *bus);
+void wifi_runtime_free(struct wifi_runtime *rt);
+int wifi_runtime_collect(struct wifi_runtime *rt);
+void wifi_runtime_set_monitor(struct wifi_runtime *rt, struct station_monitor *monitor);
+int wifi_runtime_build(const char *xpath, void *arg, sr_val_t **values, size_t *values_cnt);
+
+#endif /* RUNTIME_H */
@@ -0,0 +1,176 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "shm.h"
+
+/**
+ * @brief Create or take over the snapshot segment.
+ *
+ * A segment left by an earlier run keeps its sequence counter, so readers that
+ * still map it see the next update as a new generation.
+ *
+ * @return SR_ERR_OK on success, otherwise some Sysrepo error code.
+ */
+int
+shm_writer_open(struct shm_writer *w, const char *name)
+{
+    struct status_shm *shm;
+    int fd;
+
+    memset(w, 0, sizeof(*w));
+    w->name = strdup(name);
+    if (!w->name) {
+        return SR_ERR_NOMEM;
+    }
+
+    fd = shm_open(name, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Can't open shared memory %s: %s\n", name, strerror(errno));
+        goto error;
+    }
+    if (ftruncate(fd, sizeof(*shm))) {
+        fprintf(stderr, "Can't size shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        goto error;
+    }
+    shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        fprintf(stderr, "Can't map shared memory %s: %s\n", name, strerror(errno));
+        goto error;
+    }
+
+    if (shm->magic != STATUS_SHM_MAGIC || shm->version != STATUS_SHM_VERSION ||
+        shm->size != sizeof(*shm)) {
+        memset(&shm->data, 0, sizeof(shm->data));
+        shm->version = STATUS_SHM_VERSION;
+        shm->size = sizeof(*shm);
+        __atomic_store_n(&shm->magic, STATUS_SHM_MAGIC, __ATOMIC_RELEASE);
+    }
+    if (shm->seq & 1) {
+        /* The previous writer died while updating. */
+        __atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELEASE);
+    }
+    w->shm = shm;
+
+    return SR_ERR_OK;
+
+  error:
+    free(w->name);
+    w->name = NULL;
+    return SR_ERR_INTERNAL;
+}
+
+/* Readers that mapped the segment keep the last snapshot, new ones find none. */
+void
+shm_writer_close(struct shm_writer *w)
+{
+    if (w->shm) {
+        munmap(w->shm, sizeof(*w->shm));
+        shm_unlink(w->name);
+    }
+    free(w->name);
+    memset(w, 0, sizeof(*w));
+}
+
+static void
+shm_str(char *dst, size_t len, const char *src)
+{
+    snprintf(dst, len, "%s", src ? src : "");
+}
+
+static void
+shm_board(struct status_shm_board *b, const struct board *board)
+{
+    memset(b, 0, sizeof(*b));
+    if (!board) {
+        return;
+    }
+    shm_str(b->hostname, sizeof(b->hostname), board->hostname);
+    shm_str(b->kernel, sizeof(b->kernel), board->kernel);
+    shm_str(b->system, sizeof(b->system), board->system);
+    shm_str(b->distribution, sizeof(b->distribution), board->release.distribution);
+    shm_str(b->version, sizeof(b->version), board->release.version);
+    shm_str(b->revision, sizeof(b->revision), board->release.revision);
+    shm_str(b->target, sizeof(b->target), board->release.target);
+    shm_str(b->description, sizeof(b->description), board->release.description);
+}
+
+/**
+ * @brief Write the model into the segment.
+ *
+ * Called with the model lock held after the model changed. Readers that copy
+ * meanwhile see an odd sequence counter, or a different one afterwards, and retry.
+ */
+void
+shm_writer_publish(struct shm_writer *w, const struct model *model)
+{
+    struct status_shm *shm = w->shm;
+    struct status_shm_data *d;
+    struct status_shm_lease *l;
+    struct status_shm_wifi_device *dev;
+    struct status_shm_wifi_iface *ifc;
+    struct dhcp_lease *lease;
+    struct wifi_device *wdev;
+    struct wifi_iface *wif;
+    uint32_t seq;
+
+    if (!shm) {
+        return;
+    }
+    d = &shm->data;
+
+    seq = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    d->updated = time(NULL);
+    shm_board(&d->board, model->board);
+
+    d->n_leases = 0;
+    d->dropped_leases = 0;
+    list_for_each_entry(lease, model->leases, head) {
+        if (d->n_leases == STATUS_SHM_MAX_LEASES) {
+            d->dropped_leases++;
+            continue;
+        }
+        l = &d->leases[d->n_leases++];
+        l->expiry = lease->lease_expirey ? strtoll(lease->lease_expirey, NULL, 10) : 0;
+        l->family = lease->family && !strcmp(lease->family, "ipv6") ? 6 : 4;
+        shm_str(l->mac, sizeof(l->mac), lease->mac);
+        shm_str(l->ip, sizeof(l->ip), lease->ip);
+        shm_str(l->name, sizeof(l->name), lease->name);
+        shm_str(l->source, sizeof(l->source), lease->source);
+    }
+
+    d->n_wifi_devices = 0;
+    list_for_each_entry(wdev, model->wifi_devs, head) {
+        if (d->n_wifi_devices == STATUS_SHM_MAX_WIFI_DEVICES) {
+            break;
+        }
+        dev = &d->wifi_devices[d->n_wifi_devices++];
+        shm_str(dev->name, sizeof(dev->name), wdev->name);
+        shm_str(dev->type, sizeof(dev->type), wdev->type);
+        shm_str(dev->channel, sizeof(dev->channel), wdev->channel);
+        shm_str(dev->hwmode, sizeof(dev->hwmode), wdev->hwmode);
+        dev->disabled = wdev->disabled && !strcmp(wdev->disabled, "1");
+    }
+
+    d->n_wifi_ifaces = 0;
+    list_for_each_entry(wif, model->wifi_ifs, head) {
+        if (d->n_wifi_ifaces == STATUS_SHM_MAX_WIFI_IFACES) {
+            break;
+        }
+        ifc = &d->wifi_ifaces[d->n_wifi_ifaces++];
+        shm_str(ifc->name, sizeof(ifc->name), wif->name);
+        shm_str(ifc->device, sizeof(ifc->device), wif->device);
+        shm_str(ifc->network, sizeof(ifc->network), wif->network);
+        shm_str(ifc->mode, sizeof(ifc->mode), wif->mode);
+        shm_str(ifc->ssid, sizeof(ifc->ssid), wif->ssid);
+        shm_str(ifc->encryption, sizeof(ifc->encryption), wif->encryption);
+    }
+
+    __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,17 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "status.h"
+#include "status_shm.h"
+
+/* Writer side of the shared-memory snapshot, see status_shm.h. */
+struct shm_writer {
+    struct status_shm *shm;
+    char *name;
+};
+
+int shm_writer_open(struct shm_writer *w, const char *name);
+void shm_writer_close(struct shm_writer *w);
+void shm_writer_publish(struct shm_writer *w, const struct model *model);
+
+#endif /* SHM_H */
@@ -0,0 +1,106 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "status_shm.h"
+
+#define STATUS_SHM_READ_TRIES 1000      /* copies attempted while the writer keeps updating */
+
+/**
+ * @brief Map the snapshot segment read-only.
+ *
+ * @param[in] name Segment name, NULL for STATUS_SHM_NAME.
+ * @return 0 on success, -EPROTO for a segment of another layout version,
+ *         otherwise a negative errno.
+ */
+int
+status_shm_open(struct status_shm_reader *r, const char *name)
+{
+    const struct status_shm *shm;
+    struct stat st;
+    int fd, rc = 0;
+
+    memset(r, 0, sizeof(*r));
+
+    fd = shm_open(name ? name : STATUS_SHM_NAME, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (fstat(fd, &st)) {
+        rc = -errno;
+        goto out;
+    }
+    if (st.st_size < (off_t) sizeof(*shm)) {
+        rc = -EPROTO;
+        goto out;
+    }
+
+    shm = mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED) {
+        rc = -errno;
+        goto out;
+    }
+    if (shm->magic != STATUS_SHM_MAGIC || shm->version != STATUS_SHM_VERSION ||
+        shm->size != sizeof(*shm)) {
+        munmap((void *) shm, sizeof(*shm));
+        rc = -EPROTO;
+        goto out;
+    }
+    r->shm = shm;
+    r->size = sizeof(*shm);
+
+  out:
+    close(fd);
+    return rc;
+}
+
+void
+status_shm_close(struct status_shm_reader *r)
+{
+    if (r->shm) {
+        munmap((void *) r->shm, r->size);
+    }
+    memset(r, 0, sizeof(*r));
+}
+
+/* Number of updates so far; reading it is enough to tell whether to copy again. */
+uint32_t
+status_shm_generation(const struct status_shm_reader *r)
+{
+    return __atomic_load_n(&r->shm->seq, __ATOMIC_ACQUIRE) >> 1;
+}
+
+/**
+ * @brief Copy a consistent snapshot.
+ *
+ * The copy is retried while the writer updated the segment meanwhile.
+ *
+ * @param[out] generation Generation of the copy, may be NULL.
+ * @return 0 on success, -EAGAIN when every attempt raced with an update.
+ */
+int
+status_shm_read(const struct status_shm_reader *r, struct status_shm_data *data,
+                uint32_t *generation)
+{
+    uint32_t seq;
+    int i;
+
+    for (i = 0; i < STATUS_SHM_READ_TRIES; i++) {
+        seq = __atomic_load_n(&r->shm->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        memcpy(data, &r->shm->data, sizeof(*data));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&r->shm->seq, __ATOMIC_RELAXED) == seq) {
+            if (generation) {
+                *generation = seq >> 1;
+            }
+            return 0;
+        }
+    }
+
+    return -EAGAIN;
+}
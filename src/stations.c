@@ -0,0 +1,824 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <byteswap.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/nl80211.h>
+#include "sysrepo.h"
+#include "stations.h"
+
+#define NL_BUF_LEN 65536                /* largest message of an nl80211 dump */
+#define NL_EVENT_RCVBUF (1 << 20)       /* room for association bursts */
+#define NL_REPLY_TIMEOUT_S 2
+
+/* pcap of an nlmon interface: Linux cooked header in front of each message. */
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_LINKTYPE_NETLINK 253
+#define PCAP_SLL_LEN 16
+#define PCAP_SLL_PROTOCOL 14
+
+#define NLA_DATA(nla) ((void *) ((uint8_t *) (nla) + NLA_HDRLEN))
+#define NLA_LEN(nla) ((int) (nla)->nla_len - NLA_HDRLEN)
+
+#define nla_for_each(pos, head, len, rem) \
+    for (pos = (struct nlattr *) (head), rem = (len); \
+         rem >= (int) sizeof(*pos) && pos->nla_len >= sizeof(*pos) && pos->nla_len <= rem; \
+         rem -= NLA_ALIGN(pos->nla_len), pos = (struct nlattr *) ((uint8_t *) pos + NLA_ALIGN(pos->nla_len)))
+
+/* A request fits the generic netlink header and two small attributes. */
+struct nl_req {
+    struct nlmsghdr nlh;
+    struct genlmsghdr genl;
+    uint8_t attrs[64];
+};
+
+/* Called for every reply message of a request. */
+typedef void (*nl_reply_cb)(struct station_monitor *m, struct nlmsghdr *nlh, void *priv);
+
+static void
+nl_parse(struct nlattr **tb, int max, void *data, int len)
+{
+    struct nlattr *nla;
+    int rem, type;
+
+    memset(tb, 0, (max + 1) * sizeof(*tb));
+    nla_for_each(nla, data, len, rem) {
+        type = nla->nla_type & NLA_TYPE_MASK;
+        if (type <= max) {
+            tb[type] = nla;
+        }
+    }
+}
+
+/* Attributes of a generic netlink message, false when it is too short. */
+static bool
+nl_parse_genl(struct nlattr **tb, int max, struct nlmsghdr *nlh)
+{
+    if (nlh->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN)) {
+        return false;
+    }
+    nl_parse(tb, max, (uint8_t *) NLMSG_DATA(nlh) + GENL_HDRLEN,
+             nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN));
+
+    return true;
+}
+
+static uint32_t
+nla_u32(struct nlattr *nla)
+{
+    uint32_t v = 0;
+
+    if (NLA_LEN(nla) >= (int) sizeof(v)) {
+        memcpy(&v, NLA_DATA(nla), sizeof(v));
+    }
+    return v;
+}
+
+static uint16_t
+nla_u16(struct nlattr *nla)
+{
+    uint16_t v = 0;
+
+    if (NLA_LEN(nla) >= (int) sizeof(v)) {
+        memcpy(&v, NLA_DATA(nla), sizeof(v));
+    }
+    return v;
+}
+
+static void
+nl_req_init(struct nl_req *req, uint16_t type, uint8_t cmd, uint16_t flags)
+{
+    memset(req, 0, sizeof(*req));
+    req->nlh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    req->nlh.nlmsg_type = type;
+    req->nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    req->genl.cmd = cmd;
+    req->genl.version = 1;
+}
+
+static void
+nl_req_put(struct nl_req *req, uint16_t type, const void *data, uint16_t len)
+{
+    struct nlattr *nla = (struct nlattr *) ((uint8_t *) req + NLMSG_ALIGN(req->nlh.nlmsg_len));
+
+    nla->nla_type = type;
+    nla->nla_len = NLA_HDRLEN + len;
+    memcpy(NLA_DATA(nla), data, len);
+    req->nlh.nlmsg_len = NLMSG_ALIGN(req->nlh.nlmsg_len) + NLA_ALIGN(nla->nla_len);
+}
+
+/*
+ * Send a request on the dump socket and pass its replies to cb until the dump
+ * is done or the kernel acknowledged it. Returns 0 or a negative errno.
+ */
+static int
+nl_request(struct station_monitor *m, struct nl_req *req, nl_reply_cb cb, void *priv)
+{
+    struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+    struct nlmsghdr *nlh;
+    struct nlmsgerr *err;
+    ssize_t len;
+    int rc = 1;
+
+    req->nlh.nlmsg_seq = ++m->seq;
+    if (sendto(m->dump_fd, req, req->nlh.nlmsg_len, 0,
+               (struct sockaddr *) &kernel, sizeof(kernel)) < 0) {
+        return -errno;
+    }
+
+    while (rc > 0) {
+        len = recv(m->dump_fd, m->buf, NL_BUF_LEN, 0);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+
+        for (nlh = (struct nlmsghdr *) m->buf; rc > 0 && NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_seq != m->seq) {
+                continue;
+            }
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                rc = 0;
+            } else if (nlh->nlmsg_type == NLMSG_ERROR) {
+                err = NLMSG_DATA(nlh);
+                rc = nlh->nlmsg_len >= NLMSG_LENGTH(sizeof(*err)) ? err->error : -EPROTO;
+            } else {
+                cb(m, nlh, priv);
+            }
+        }
+    }
+
+    return rc;
+}
+
+static int
+nl_open(void)
+{
+    struct sockaddr_nl local = { .nl_family = AF_NETLINK };
+    int fd;
+
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *) &local, sizeof(local)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* CTRL_CMD_GETFAMILY reply: the nl80211 family id and its mlme group. */
+static void
+family_cb(struct station_monitor *m, struct nlmsghdr *nlh, void *priv)
+{
+    struct nlattr *tb[CTRL_ATTR_MAX + 1], *gtb[CTRL_ATTR_MCAST_GRP_MAX + 1], *grp;
+    uint32_t *group = priv;
+    int rem;
+
+    if (!nl_parse_genl(tb, CTRL_ATTR_MAX, nlh)) {
+        return;
+    }
+    if (tb[CTRL_ATTR_FAMILY_ID]) {
+        m->family = nla_u16(tb[CTRL_ATTR_FAMILY_ID]);
+    }
+    if (!tb[CTRL_ATTR_MCAST_GROUPS]) {
+        return;
+    }
+    nla_for_each(grp, NLA_DATA(tb[CTRL_ATTR_MCAST_GROUPS]), NLA_LEN(tb[CTRL_ATTR_MCAST_GROUPS]), rem) {
+        nl_parse(gtb, CTRL_ATTR_MCAST_GRP_MAX, NLA_DATA(grp), NLA_LEN(grp));
+        if (gtb[CTRL_ATTR_MCAST_GRP_NAME] && gtb[CTRL_ATTR_MCAST_GRP_ID] &&
+            !strncmp(NLA_DATA(gtb[CTRL_ATTR_MCAST_GRP_NAME]), NL80211_MULTICAST_GROUP_MLME,
+                     NLA_LEN(gtb[CTRL_ATTR_MCAST_GRP_NAME]))) {
+            *group = nla_u32(gtb[CTRL_ATTR_MCAST_GRP_ID]);
+        }
+    }
+}
+
+/* Rate of an NL80211_STA_INFO_*_BITRATE attribute, in kbit/s. */
+static uint32_t
+station_rate(struct nlattr *attr)
+{
+    struct nlattr *tb[NL80211_RATE_INFO_MAX + 1];
+
+    nl_parse(tb, NL80211_RATE_INFO_MAX, NLA_DATA(attr), NLA_LEN(attr));
+    if (tb[NL80211_RATE_INFO_BITRATE32]) {
+        return nla_u32(tb[NL80211_RATE_INFO_BITRATE32]) * 100;
+    }
+    if (tb[NL80211_RATE_INFO_BITRATE]) {
+        return nla_u16(tb[NL80211_RATE_INFO_BITRATE]) * 100;
+    }
+    return 0;
+}
+
+/* Fill sta from NL80211_ATTR_STA_INFO, fields missing in the message are kept. */
+static void
+station_parse_info(struct station *sta, struct nlattr *info)
+{
+    struct nlattr *tb[NL80211_STA_INFO_MAX + 1];
+    struct nl80211_sta_flag_update flags;
+
+    nl_parse(tb, NL80211_STA_INFO_MAX, NLA_DATA(info), NLA_LEN(info));
+    if (tb[NL80211_STA_INFO_SIGNAL] && NLA_LEN(tb[NL80211_STA_INFO_SIGNAL]) >= 1) {
+        sta->signal = *(int8_t *) NLA_DATA(tb[NL80211_STA_INFO_SIGNAL]);
+    }
+    if (tb[NL80211_STA_INFO_INACTIVE_TIME]) {
+        sta->inactive = nla_u32(tb[NL80211_STA_INFO_INACTIVE_TIME]);
+    }
+    if (tb[NL80211_STA_INFO_CONNECTED_TIME]) {
+        sta->connected_time = nla_u32(tb[NL80211_STA_INFO_CONNECTED_TIME]);
+    }
+    if (tb[NL80211_STA_INFO_TX_BITRATE]) {
+        sta->tx_rate = station_rate(tb[NL80211_STA_INFO_TX_BITRATE]);
+    }
+    if (tb[NL80211_STA_INFO_RX_BITRATE]) {
+        sta->rx_rate = station_rate(tb[NL80211_STA_INFO_RX_BITRATE]);
+    }
+    if (tb[NL80211_STA_INFO_STA_FLAGS] && NLA_LEN(tb[NL80211_STA_INFO_STA_FLAGS]) >= (int) sizeof(flags)) {
+        memcpy(&flags, NLA_DATA(tb[NL80211_STA_INFO_STA_FLAGS]), sizeof(flags));
+        if (flags.mask & (1 << NL80211_STA_FLAG_AUTHORIZED)) {
+            sta->authorized = !!(flags.set & (1 << NL80211_STA_FLAG_AUTHORIZED));
+        }
+    }
+}
+
+static bool
+station_mac(struct nlattr *attr, char *mac)
+{
+    const uint8_t *a;
+
+    if (!attr || NLA_LEN(attr) < 6) {
+        return false;
+    }
+    a = NLA_DATA(attr);
+    snprintf(mac, RUNTIME_MAC_LEN, "%02x:%02x:%02x:%02x:%02x:%02x", a[0], a[1], a[2], a[3], a[4], a[5]);
+
+    return true;
+}
+
+/* Position of mac in the sorted stations, found tells whether it is there. */
+static size_t
+station_pos(struct sta_iface *ifc, const char *mac, bool *found)
+{
+    size_t lo = 0, hi = ifc->n_stations, mid;
+    int cmp;
+
+    *found = false;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = strcasecmp(ifc->stations[mid].mac, mac);
+        if (!cmp) {
+            *found = true;
+            return mid;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static struct station *
+station_insert(struct sta_iface *ifc, const char *mac)
+{
+    struct station sta;
+    size_t pos;
+    bool found;
+
+    pos = station_pos(ifc, mac, &found);
+    if (found) {
+        return &ifc->stations[pos];
+    }
+    if (!station_add(&ifc->stations, &ifc->n_stations, &ifc->size, mac)) {
+        return NULL;
+    }
+    sta = ifc->stations[ifc->n_stations - 1];
+    memmove(&ifc->stations[pos + 1], &ifc->stations[pos],
+            (ifc->n_stations - 1 - pos) * sizeof(sta));
+    ifc->stations[pos] = sta;
+
+    return &ifc->stations[pos];
+}
+
+static void
+station_remove(struct sta_iface *ifc, const char *mac)
+{
+    size_t pos;
+    bool found;
+
+    pos = station_pos(ifc, mac, &found);
+    if (found) {
+        memmove(&ifc->stations[pos], &ifc->stations[pos + 1],
+                (--ifc->n_stations - pos) * sizeof(*ifc->stations));
+    }
+}
+
+static void
+sta_ifaces_free(struct sta_iface *ifaces, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        free(ifaces[i].stations);
+    }
+    free(ifaces);
+}
+
+static struct sta_iface *
+sta_iface_add(struct sta_iface **ifaces, size_t *n, int ifindex, const char *ifname)
+{
+    struct sta_iface *tmp, *ifc;
+
+    tmp = realloc(*ifaces, (*n + 1) * sizeof(*tmp));
+    if (!tmp) {
+        return NULL;
+    }
+    *ifaces = tmp;
+    ifc = &tmp[(*n)++];
+    memset(ifc, 0, sizeof(*ifc));
+    ifc->ifindex = ifindex;
+    if (ifname) {
+        snprintf(ifc->ifname, sizeof(ifc->ifname), "%s", ifname);
+    } else if (!if_indextoname(ifindex, ifc->ifname)) {
+        /* Replayed events may name interfaces this host does not have. */
+        snprintf(ifc->ifname, sizeof(ifc->ifname), "if%d", ifindex);
+    }
+
+    return ifc;
+}
+
+/* NEW_STATION or DEL_STATION, from the event socket or a replay. */
+static void
+station_event(struct station_monitor *m, struct nlmsghdr *nlh)
+{
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    struct genlmsghdr *genl = NLMSG_DATA(nlh);
+    struct sta_iface *ifc = NULL;
+    struct station *sta;
+    char mac[RUNTIME_MAC_LEN];
+    int ifindex;
+    size_t i;
+
+    if (!m->family || nlh->nlmsg_type != m->family) {
+        return;
+    }
+    if (!nl_parse_genl(tb, NL80211_ATTR_MAX, nlh) ||
+        (genl->cmd != NL80211_CMD_NEW_STATION && genl->cmd != NL80211_CMD_DEL_STATION) ||
+        !tb[NL80211_ATTR_IFINDEX] || !station_mac(tb[NL80211_ATTR_MAC], mac)) {
+        return;
+    }
+    ifindex = nla_u32(tb[NL80211_ATTR_IFINDEX]);
+
+    pthread_mutex_lock(&m->lock);
+    for (i = 0; i < m->n_ifaces; i++) {
+        if (m->ifaces[i].ifindex == ifindex) {
+            ifc = &m->ifaces[i];
+            break;
+        }
+    }
+
+    if (genl->cmd == NL80211_CMD_NEW_STATION) {
+        if (!ifc) {
+            ifc = sta_iface_add(&m->ifaces, &m->n_ifaces, ifindex, NULL);
+        }
+        sta = ifc ? station_insert(ifc, mac) : NULL;
+        if (sta && tb[NL80211_ATTR_STA_INFO]) {
+            station_parse_info(sta, tb[NL80211_ATTR_STA_INFO]);
+        }
+    } else if (ifc) {
+        station_remove(ifc, mac);
+    }
+    atomic_fetch_add(&m->generation, 1);
+    pthread_mutex_unlock(&m->lock);
+}
+
+/* GET_INTERFACE dump: every AP interface gets an empty table. */
+static void
+iface_dump_cb(struct station_monitor *m, struct nlmsghdr *nlh, void *priv)
+{
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    struct station_monitor *fresh = priv;
+    char ifname[IF_NAMESIZE];
+    uint32_t type;
+
+    if (!nl_parse_genl(tb, NL80211_ATTR_MAX, nlh) || !tb[NL80211_ATTR_IFINDEX] ||
+        !tb[NL80211_ATTR_IFTYPE] || !tb[NL80211_ATTR_IFNAME]) {
+        return;
+    }
+    type = nla_u32(tb[NL80211_ATTR_IFTYPE]);
+    if (type != NL80211_IFTYPE_AP && type != NL80211_IFTYPE_P2P_GO) {
+        return;
+    }
+    snprintf(ifname, sizeof(ifname), "%.*s", NLA_LEN(tb[NL80211_ATTR_IFNAME]),
+             (char *) NLA_DATA(tb[NL80211_ATTR_IFNAME]));
+    sta_iface_add(&fresh->ifaces, &fresh->n_ifaces, nla_u32(tb[NL80211_ATTR_IFINDEX]), ifname);
+}
+
+/* GET_STATION dump of one interface, sorted once the dump is complete. */
+static void
+station_dump_cb(struct station_monitor *m, struct nlmsghdr *nlh, void *priv)
+{
+    struct nlattr *tb[NL80211_ATTR_MAX + 1];
+    struct sta_iface *ifc = priv;
+    struct station *sta;
+    char mac[RUNTIME_MAC_LEN];
+
+    if (!nl_parse_genl(tb, NL80211_ATTR_MAX, nlh) || !station_mac(tb[NL80211_ATTR_MAC], mac)) {
+        return;
+    }
+    sta = station_add(&ifc->stations, &ifc->n_stations, &ifc->size, mac);
+    if (sta && tb[NL80211_ATTR_STA_INFO]) {
+        station_parse_info(sta, tb[NL80211_ATTR_STA_INFO]);
+    }
+}
+
+/*
+ * Replace the tables by a full dump. Events that arrived during the dump are
+ * still queued on the event socket and applied on top of it afterwards.
+ */
+static int
+station_reconcile(struct station_monitor *m)
+{
+    struct station_monitor fresh = {0,};
+    struct sta_iface *old;
+    struct nl_req req;
+    uint32_t ifindex;
+    size_t i, n_old;
+    int rc;
+
+    nl_req_init(&req, m->family, NL80211_CMD_GET_INTERFACE, NLM_F_DUMP);
+    rc = nl_request(m, &req, iface_dump_cb, &fresh);
+
+    for (i = 0; !rc && i < fresh.n_ifaces; i++) {
+        ifindex = fresh.ifaces[i].ifindex;
+        nl_req_init(&req, m->family, NL80211_CMD_GET_STATION, NLM_F_DUMP);
+        nl_req_put(&req, NL80211_ATTR_IFINDEX, &ifindex, sizeof(ifindex));
+        rc = nl_request(m, &req, station_dump_cb, &fresh.ifaces[i]);
+        if (rc == -ENODEV) {
+            /* Went away meanwhile, the next dump drops it. */
+            rc = 0;
+        }
+        qsort(fresh.ifaces[i].stations, fresh.ifaces[i].n_stations,
+              sizeof(*fresh.ifaces[i].stations), station_cmp);
+    }
+    if (rc) {
+        fprintf(stderr, "nl80211 station dump failed: %s\n", strerror(-rc));
+        sta_ifaces_free(fresh.ifaces, fresh.n_ifaces);
+        return SR_ERR_INTERNAL;
+    }
+
+    pthread_mutex_lock(&m->lock);
+    old = m->ifaces;
+    n_old = m->n_ifaces;
+    m->ifaces = fresh.ifaces;
+    m->n_ifaces = fresh.n_ifaces;
+    atomic_fetch_add(&m->generation, 1);
+    pthread_mutex_unlock(&m->lock);
+    sta_ifaces_free(old, n_old);
+
+    return SR_ERR_OK;
+}
+
+/* Apply all queued events, false when the socket overran and events were lost. */
+static bool
+station_recv(struct station_monitor *m)
+{
+    struct nlmsghdr *nlh;
+    ssize_t len;
+
+    for (;;) {
+        len = recv(m->event_fd, m->buf, NL_BUF_LEN, MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS) {
+                fprintf(stderr, "nl80211 events lost, dumping stations\n");
+                return false;
+            }
+            return true;
+        }
+        for (nlh = (struct nlmsghdr *) m->buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            station_event(m, nlh);
+        }
+    }
+}
+
+/* A recorded CTRL_CMD_GETFAMILY reply for nl80211 tells the family id of the capture. */
+static void
+replay_family(struct station_monitor *m, struct nlmsghdr *nlh)
+{
+    struct nlattr *tb[CTRL_ATTR_MAX + 1];
+    struct genlmsghdr *genl = NLMSG_DATA(nlh);
+    uint32_t group = 0;
+
+    if (nlh->nlmsg_type != GENL_ID_CTRL || !nl_parse_genl(tb, CTRL_ATTR_MAX, nlh) ||
+        genl->cmd != CTRL_CMD_NEWFAMILY || !tb[CTRL_ATTR_FAMILY_NAME] ||
+        NLA_LEN(tb[CTRL_ATTR_FAMILY_NAME]) != sizeof(NL80211_GENL_NAME) ||
+        memcmp(NLA_DATA(tb[CTRL_ATTR_FAMILY_NAME]), NL80211_GENL_NAME, sizeof(NL80211_GENL_NAME))) {
+        return;
+    }
+    family_cb(m, nlh, &group);
+}
+
+/*
+ * Apply the generic netlink messages of a pcap captured on an nlmon interface.
+ * Station events count only once the GETFAMILY reply of nl80211 was seen, so
+ * commands of other families with the same numbers are not taken for them.
+ */
+static int
+station_replay(struct station_monitor *m, FILE *replay)
+{
+    struct {
+        uint32_t magic;
+        uint16_t version_major;
+        uint16_t version_minor;
+        int32_t thiszone;
+        uint32_t sigfigs;
+        uint32_t snaplen;
+        uint32_t linktype;
+    } hdr;
+    struct {
+        uint32_t ts_sec;
+        uint32_t ts_frac;
+        uint32_t caplen;
+        uint32_t len;
+    } rec;
+    struct nlmsghdr *nlh;
+    uint16_t protocol;
+    uint32_t caplen;
+    bool swap;
+    int len;
+
+    if (1 != fread(&hdr, sizeof(hdr), 1, replay)) {
+        return SR_ERR_INTERNAL;
+    }
+    swap = hdr.magic == bswap_32(PCAP_MAGIC) || hdr.magic == bswap_32(PCAP_MAGIC_NS);
+    if (swap) {
+        hdr.linktype = bswap_32(hdr.linktype);
+    } else if (hdr.magic != PCAP_MAGIC && hdr.magic != PCAP_MAGIC_NS) {
+        fprintf(stderr, "Station replay is no pcap file\n");
+        return SR_ERR_INTERNAL;
+    }
+    if (hdr.linktype != PCAP_LINKTYPE_NETLINK) {
+        fprintf(stderr, "Station replay is no netlink capture\n");
+        return SR_ERR_INTERNAL;
+    }
+
+    while (1 == fread(&rec, sizeof(rec), 1, replay)) {
+        caplen = swap ? bswap_32(rec.caplen) : rec.caplen;
+        if (caplen > NL_BUF_LEN || caplen < PCAP_SLL_LEN) {
+            fprintf(stderr, "Station replay has a record of %" PRIu32 " bytes\n", caplen);
+            return SR_ERR_INTERNAL;
+        }
+        len = caplen;
+        if (1 != fread(m->buf, len, 1, replay)) {
+            break;
+        }
+        memcpy(&protocol, m->buf + PCAP_SLL_PROTOCOL, sizeof(protocol));
+        if (ntohs(protocol) != NETLINK_GENERIC) {
+            continue;
+        }
+        len -= PCAP_SLL_LEN;
+        for (nlh = (struct nlmsghdr *) (m->buf + PCAP_SLL_LEN); NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            replay_family(m, nlh);
+            station_event(m, nlh);
+        }
+    }
+
+    return SR_ERR_OK;
+}
+
+static long long
+monotonic_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000L;
+}
+
+static void *
+station_monitor_thread(void *arg)
+{
+    struct station_monitor *m = arg;
+    struct pollfd fds[2];
+    long long last = 0, now, wait;
+    uint32_t interval_s;
+    bool dump = true;
+    int timeout;
+
+    fds[0].fd = m->wake_fd[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = m->event_fd;
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        now = monotonic_ms();
+        interval_s = atomic_load(&m->interval_s);
+        if (dump || (interval_s && now - last >= interval_s * 1000LL)) {
+            station_reconcile(m);
+            last = now = monotonic_ms();
+            dump = false;
+        }
+        /* Intervals beyond what poll() takes are waited for in several rounds. */
+        wait = last + interval_s * 1000LL - now;
+        timeout = !interval_s ? -1 : wait > INT_MAX ? INT_MAX : (int) wait;
+
+        if (poll(fds, 2, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Station monitor poll failed: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[0].revents) {
+            break;
+        }
+        if (fds[1].revents && !station_recv(m)) {
+            dump = true;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Start following the stations of all AP interfaces.
+ *
+ * @param[in] replay pcap file to replay instead of listening to the kernel, or NULL.
+ * @param[in] interval_s Seconds between two full dumps, 0 dumps only at start
+ *                       and after lost events.
+ * @return SR_ERR_OK on success, otherwise some Sysrepo error code.
+ */
+int
+station_monitor_start(struct station_monitor *m, const char *replay, uint32_t interval_s)
+{
+    uint32_t group = 0;
+    int rcvbuf = NL_EVENT_RCVBUF;
+    struct timeval timeout = { .tv_sec = NL_REPLY_TIMEOUT_S };
+    struct nl_req req;
+    FILE *f;
+    int rc;
+
+    memset(m, 0, sizeof(*m));
+    m->event_fd = m->dump_fd = -1;
+    m->wake_fd[0] = m->wake_fd[1] = -1;
+    atomic_init(&m->interval_s, interval_s);
+    atomic_init(&m->generation, 0);
+    pthread_mutex_init(&m->lock, NULL);
+
+    m->buf = malloc(NL_BUF_LEN);
+    if (!m->buf) {
+        rc = SR_ERR_NOMEM;
+        goto error;
+    }
+    rc = SR_ERR_INTERNAL;
+
+    if (replay) {
+        f = fopen(replay, "r");
+        if (!f) {
+            fprintf(stderr, "Can't open station replay %s: %s\n", replay, strerror(errno));
+            goto error;
+        }
+        rc = station_replay(m, f);
+        fclose(f);
+        if (rc) {
+            goto error;
+        }
+        /* The tables stay as replayed, no thread follows them. */
+        return SR_ERR_OK;
+    }
+
+    m->event_fd = nl_open();
+    m->dump_fd = nl_open();
+    if (m->event_fd < 0 || m->dump_fd < 0) {
+        fprintf(stderr, "Can't open netlink socket: %s\n", strerror(errno));
+        goto error;
+    }
+    setsockopt(m->dump_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(m->event_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    nl_req_init(&req, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0);
+    nl_req_put(&req, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME, sizeof(NL80211_GENL_NAME));
+    if (nl_request(m, &req, family_cb, &group) || !m->family || !group) {
+        fprintf(stderr, "nl80211 is not available\n");
+        goto error;
+    }
+    if (setsockopt(m->event_fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group))) {
+        fprintf(stderr, "Can't join nl80211 mlme events: %s\n", strerror(errno));
+        goto error;
+    }
+
+    if (pipe(m->wake_fd)) {
+        fprintf(stderr, "Can't create station monitor pipe: %s\n", strerror(errno));
+        goto error;
+    }
+    rc = pthread_create(&m->thread, NULL, station_monitor_thread, m);
+    if (rc) {
+        fprintf(stderr, "Can't start station monitor: %s\n", strerror(rc));
+        rc = SR_ERR_INTERNAL;
+        goto error;
+    }
+    m->running = true;
+
+    return SR_ERR_OK;
+
+  error:
+    station_monitor_stop(m);
+    return rc;
+}
+
+void
+station_monitor_stop(struct station_monitor *m)
+{
+    if (m->running) {
+        if (write(m->wake_fd[1], "", 1) < 0) {
+            fprintf(stderr, "Can't wake station monitor: %s\n", strerror(errno));
+        }
+        pthread_join(m->thread, NULL);
+        m->running = false;
+    }
+
+    if (m->wake_fd[0] >= 0) {
+        close(m->wake_fd[0]);
+        close(m->wake_fd[1]);
+    }
+    if (m->event_fd >= 0) {
+        close(m->event_fd);
+    }
+    if (m->dump_fd >= 0) {
+        close(m->dump_fd);
+    }
+    m->wake_fd[0] = m->wake_fd[1] = m->event_fd = m->dump_fd = -1;
+
+    sta_ifaces_free(m->ifaces, m->n_ifaces);
+    m->ifaces = NULL;
+    m->n_ifaces = 0;
+    free(m->buf);
+    m->buf = NULL;
+    pthread_mutex_destroy(&m->lock);
+}
+
+void
+station_monitor_set_interval(struct station_monitor *m, uint32_t interval_s)
+{
+    atomic_store(&m->interval_s, interval_s);
+}
+
+unsigned long
+station_monitor_generation(struct station_monitor *m)
+{
+    return atomic_load(&m->generation);
+}
+
+/**
+ * @brief Copy the stations of one interface, sorted by MAC.
+ *
+ * The caller frees the copy; an interface without stations gives NULL.
+ */
+int
+station_monitor_copy(struct station_monitor *m, const char *ifname,
+                     struct station **stations, size_t *n_stations)
+{
+    int rc = SR_ERR_OK;
+    size_t i;
+
+    *stations = NULL;
+    *n_stations = 0;
+
+    pthread_mutex_lock(&m->lock);
+    for (i = 0; i < m->n_ifaces; i++) {
+        if (strcmp(m->ifaces[i].ifname, ifname) || !m->ifaces[i].n_stations) {
+            continue;
+        }
+        *stations = malloc(m->ifaces[i].n_stations * sizeof(**stations));
+        if (!*stations) {
+            rc = SR_ERR_NOMEM;
+            break;
+        }
+        memcpy(*stations, m->ifaces[i].stations, m->ifaces[i].n_stations * sizeof(**stations));
+        *n_stations = m->ifaces[i].n_stations;
+        break;
+    }
+    pthread_mutex_unlock(&m->lock);
+
+    return rc;
+}
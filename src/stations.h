@@ -0,0 +1,53 @@
+#ifndef STATIONS_H
+#define STATIONS_H
+
+#include <net/if.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "runtime.h"
+
+/* Stations of one AP interface, sorted by MAC. */
+struct sta_iface {
+    int ifindex;
+    char ifname[IF_NAMESIZE];
+    struct station *stations;
+    size_t n_stations;
+    size_t size;
+};
+
+/*
+ * Station tables kept up to date from nl80211 NEW_STATION and DEL_STATION
+ * events. A full dump of all AP interfaces replaces the tables periodically and
+ * after the event socket overran, so lost events are repaired.
+ *
+ * Instead of the kernel the events can be replayed from a pcap file captured on
+ * an nlmon interface. The replay is applied once at start; no thread runs and
+ * no dumps are made then.
+ */
+struct station_monitor {
+    pthread_t thread;
+    bool running;
+    int event_fd;                   /* nl80211 socket joined to the mlme group */
+    int dump_fd;                    /* nl80211 socket for requests and dumps */
+    int wake_fd[2];                 /* written to stop the thread */
+    uint16_t family;                /* nl80211 family id */
+    uint32_t seq;
+    uint8_t *buf;                   /* receive buffer of the thread */
+    atomic_uint interval_s;         /* between two full dumps */
+
+    pthread_mutex_t lock;           /* guards the tables */
+    struct sta_iface *ifaces;
+    size_t n_ifaces;
+    atomic_ulong generation;        /* bumped by every change of the tables */
+};
+
+int station_monitor_start(struct station_monitor *m, const char *replay, uint32_t interval_s);
+void station_monitor_stop(struct station_monitor *m);
+void station_monitor_set_interval(struct station_monitor *m, uint32_t interval_s);
+unsigned long station_monitor_generation(struct station_monitor *m);
+int station_monitor_copy(struct station_monitor *m, const char *ifname,
+                         struct station **stations, size_t *n_stations);
+
+#endif /* STATIONS_H */
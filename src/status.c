@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <inttypes.h>
+#include <sys/wait.h>
 #include <uci.h>
 #include <libubus.h>
 #include <libubox/blobmsg.h>
@@ -12,44 +13,263 @@
 #include "sysrepo/plugins.h"
 #include "sysrepo/values.h"
 #include "status.h"
+#include "xpath.h"
+#include "apply.h"
+#include "classify.h"
+#include "leases.h"
+#include "cache.h"
+#include "collector.h"
+#include "bus.h"
+#include "confwatch.h"
+#include "runtime.h"
+#include "stations.h"
+#include "netstats.h"
+#include "health.h"
+#include "shm.h"
+#include "trace.h"
+#include "pool.h"
 #include <libubox/list.h>
 
 #define XPATH_MAX_LEN 100
-#define XPATH_MAX_LEN 100
-#define UCIPATH_MAX_LEN 100
+
+/* Settings used until the data-store provides them. */
+#define DEFAULT_APPLY_QUIET_WINDOW_MS 1000
+#define DEFAULT_STATION_DUMP_INTERVAL_S 60
+#define DEFAULT_HEALTH_INTERVAL_MS 5000
+
+#define RELOAD_CMD "/etc/init.d/network restart"
+
+/* Room for the leaves of a pooled wifi section, a long maclist included. */
+#define WIFI_SLOT_STRINGS 1024
+
+/* Station lists change constantly, requests within this time share one collection. */
+#define RUNTIME_TTL_MS 2000
+
+#define APPLY_STATUS_XPATH "/status:apply-status"
+#define LEASE_EVENT_XPATH "/status:dhcp-lease-event"
+#define WIFI_RUNTIME_XPATH "/status:wifi/wifi-iface/runtime"
+#define INTERFACES_XPATH "/status:interfaces"
+#define HEALTH_XPATH "/status:board/health"
+#define MEMORY_XPATH "/status:memory"
+#define DUMP_TRACE_XPATH "/status:dump-trace"
+#define DEFAULT_TRACE_FILE "status-trace.json"
 
 static const char *config_file = "wireless";
-static const char *lease_file_path = "/tmp/dhcp.leases";
+
+/* Lease sources used when none are configured. */
+static const struct {
+    const char *name;
+    const char *type;
+    const char *path;
+} default_lease_sources[] = {
+    { "dnsmasq", "dnsmasq", "/tmp/dhcp.leases" },
+    { "odhcpd", "odhcpd", "/tmp/hosts/odhcpd" },
+};
 
 struct list_head leases = LIST_HEAD_INIT(leases);
 struct list_head ifs = LIST_HEAD_INIT(ifs);
 struct list_head devs = LIST_HEAD_INIT(devs);
-struct  board *board;
 
-/* Remove quotes from a string: */
-/* Example: '"kernel"' -> 'kernel' */
+/* Writable lists get their own subscriptions, read-only data is only verified. */
+static const char *subscribed_subtrees[] = {
+    "/status:board",
+    "/status:dhcp",
+    "/status:settings",
+    "/status:wifi/wifi-device",
+    "/status:wifi/wifi-iface",
+};
+
+static struct change_classifier classifier;
+
+/* Pools the entries of a model list may come from, NULL for heap-only lists. */
+static struct pool *entry_pools[MODEL_NODE_COUNT];
+
+/**
+ * @brief Look up a leaf of a model node by its YANG name.
+ *
+ * @return Leaf description or NULL if the node has no such leaf.
+ */
+static const struct model_leaf *
+model_find_leaf(const struct model_node *node, const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < node->n_leaves; i++) {
+        if (!strcmp(node->leaves[i].name, name)) {
+            return &node->leaves[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Key value of a list entry, NULL for containers.
+ */
 static char *
-remove_quotes(const char *str)
+model_key_value(const struct model_node *node, void *entry)
+{
+    const struct model_leaf *leaf;
+
+    if (!node->key) {
+        return NULL;
+    }
+    leaf = model_find_leaf(node, node->key);
+
+    return leaf ? MODEL_LEAF_STR(entry, leaf) : NULL;
+}
+
+/* Dump a collected entry in debug builds, sections are collected on every config change. */
+static void
+print_node(enum model_node_id id, void *entry)
+{
+#ifdef DEBUG
+    const struct model_node *node = &model_nodes[id];
+    const struct model_leaf *leaf;
+    size_t i;
+
+    printf("%s:\n", node->name);
+    for (i = 0; i < node->n_leaves; i++) {
+        leaf = &node->leaves[i];
+        printf("\t%s:%s\n", leaf->path,
+               MODEL_LEAF_STR(entry, leaf) ? MODEL_LEAF_STR(entry, leaf) : "");
+    }
+#endif
+}
+
+static void
+model_free_entry(enum model_node_id id, void *entry)
+{
+    pool_entry_free(entry_pools[id], id, entry);
+}
+
+static void
+model_free_list(enum model_node_id id, struct list_head *list)
+{
+    struct list_head *pos, *tmp;
+
+    list_for_each_safe(pos, tmp, list) {
+        list_del(pos);
+        model_free_entry(id, pos);
+    }
+}
+
+/* Entry of a model list by its key, NULL if there is none. */
+static void *
+model_find_entry(enum model_node_id id, struct list_head *list, const char *key)
+{
+    const struct model_node *node = &model_nodes[id];
+    struct list_head *pos;
+    char *value;
+
+    if (!key) {
+        return NULL;
+    }
+    list_for_each(pos, list) {
+        value = model_key_value(node, pos);
+        if (value && !strcmp(value, key)) {
+            return pos;
+        }
+    }
+
+    return NULL;
+}
+
+/* String leaves of both entries hold the same values. */
+static bool
+model_entry_equal(enum model_node_id id, void *a, void *b)
+{
+    const struct model_node *node = &model_nodes[id];
+    const struct model_leaf *leaf;
+    const char *va, *vb;
+    size_t i;
+
+    for (i = 0; i < node->n_leaves; i++) {
+        leaf = &node->leaves[i];
+        if (!MODEL_LEAF_IS_STR(leaf)) {
+            continue;
+        }
+        va = MODEL_LEAF_STR(a, leaf);
+        vb = MODEL_LEAF_STR(b, leaf);
+        if (!va != !vb || (va && strcmp(va, vb))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Merge freshly read entries into a model list, matched by their key.
+ *
+ * Unchanged entries stay as they are, changed ones are replaced and missing ones
+ * removed. The list takes the order of the fresh entries, which are consumed.
+ *
+ * @return Number of entries added, changed or removed.
+ */
+static size_t
+model_merge_list(enum model_node_id id, struct list_head *list, struct list_head *fresh)
 {
-    char *unquoted;
-    unquoted = strdup(str);
-    unquoted = unquoted + 1;
-    unquoted[strlen(unquoted) - 1] = '\0';
+    const struct model_node *node = &model_nodes[id];
+    struct list_head merged = LIST_HEAD_INIT(merged);
+    struct list_head *pos, *tmp, *old;
+    size_t changes = 0;
+
+    list_for_each_safe(pos, tmp, fresh) {
+        list_del(pos);
+        old = model_find_entry(id, list, model_key_value(node, pos));
+        if (old && model_entry_equal(id, old, pos)) {
+            list_move_tail(old, &merged);
+            model_free_entry(id, pos);
+            continue;
+        }
+        if (old) {
+            list_del(old);
+            model_free_entry(id, old);
+        }
+        list_add_tail(pos, &merged);
+        changes++;
+    }
+
+    list_for_each_safe(pos, tmp, list) {
+        list_del(pos);
+        model_free_entry(id, pos);
+        changes++;
+    }
+    list_splice_init(&merged, list);
+
+    return changes;
+}
 
-    return strdup(unquoted);
+/* Hand the model to local readers of the shared-memory snapshot, called with the model lock held. */
+static void
+publish_shm(struct model *model)
+{
+    if (model->shm) {
+        shm_writer_publish(model->shm, model);
+    }
 }
 
 /**
- * Take pointer to string and return new string without quotes.
- * ubus call returns quotes strings and unquoted are needed.
+ * Fill a board leaf from the ubus reply. The leaf's relative path
+ * ("release/version") is followed through the nested json objects.
  */
 static void
-fill_board(char **ref, char *name, struct json_object *r)
+fill_board(struct board *board, const struct model_leaf *leaf, struct json_object *r)
 {
-    struct json_object *o;
+    char path[XPATH_MAX_LEN];
+    char *component, *saveptr = NULL;
+    struct json_object *o = r;
+
+    snprintf(path, XPATH_MAX_LEN, "%s", leaf->path);
+    for (component = strtok_r(path, "/", &saveptr); component != NULL;
+         component = strtok_r(NULL, "/", &saveptr)) {
+        if (!json_object_object_get_ex(o, component, &o)) {
+            return;
+        }
+    }
 
-    json_object_object_get_ex(r, name, &o);
-    *ref = remove_quotes(json_object_to_json_string(o));
+    MODEL_LEAF_STR(board, leaf) = strdup(json_object_get_string(o));
 }
 
 /**
@@ -58,37 +278,26 @@ fill_board(char **ref, char *name, struct json_object *r)
 static void
 system_board_cb(struct ubus_request *req, int type, struct blob_attr *msg)
 {
+    const struct model_node *node = &model_nodes[MODEL_BOARD];
     char *json_string;
-    struct json_object *r, *t;
+    struct json_object *r;
+    size_t i;
+
+    struct board *board = req->priv;
 
     fprintf(stderr, "systemboard cb\n");
     if (!msg) {
         return;
     }
 
-    board = calloc(1, sizeof(*board));
     json_string = blobmsg_format_json(msg, true);
     r = json_tokener_parse(json_string);
 
-    fill_board(&board->kernel, "kernel", r);
-    fill_board(&board->hostname, "hostname", r);
-    fill_board(&board->system, "system", r);
-
-    struct release *release;
-    release = calloc(1, sizeof(*release));
-
-    json_object_object_get_ex(r, "release", &t);
-
-    fill_board(&release->distribution, "distribution", t);
-    fill_board(&release->version, "version", t);
-    fill_board(&release->revision, "revision", t);
-    fill_board(&release->codename, "codename", t);
-    fill_board(&release->target, "target", t);
-    fill_board(&release->description, "description", t);
-
-    board->release = release;
+    for (i = 0; i < node->n_leaves; i++) {
+        fill_board(board, &node->leaves[i], r);
+    }
 
-    print_board(board);
+    print_node(MODEL_BOARD, board);
 
     json_object_put(r);
     free(json_string);
@@ -96,168 +305,126 @@ system_board_cb(struct ubus_request *req, int type, struct blob_attr *msg)
 
 /* Fill board with ubus information. */
 static int
-parse_board(struct ubus_context *ctx, struct board *board)
+parse_board(struct bus *bus, struct board *board)
 {
-    uint32_t id = 0;
     struct blob_buf buf = {0,};
     int rc = SR_ERR_OK;
 
     blob_buf_init(&buf, 0);
 
-    rc = ubus_lookup_id(ctx, "system", &id);
-
+    rc = bus_invoke(bus, "system", "board", buf.head, system_board_cb, board, 5000);
     if (rc) {
-        fprintf(stderr, "ubus [%d]: no object system\n", rc);
-        goto out;
-    }
-    rc = ubus_invoke(ctx, id, "board", buf.head, system_board_cb, NULL, 5000);
-    if (rc) {
-        fprintf(stderr, "ubus [%d]: no object board\n", rc);
-        goto out;
+        fprintf(stderr, "ubus [%d]: no system board\n", rc);
     }
 
-  out:
     blob_buf_free(&buf);
 
     return rc;
 }
 
-static void
-parse_lease(char *line, struct dhcp_lease *leases)
-{
-    char *ptr;
-    char *tokens[5];
-    int i;
-
-    ptr = strtok(line, " ");
-    tokens[0] = ptr;
-    for(i = 1; ptr != NULL && i < 5; i++) {
-        ptr = strtok(NULL, " ");
-        tokens[i] = ptr;
-    }
-
-    i = 0;
-    leases->lease_expirey = strdup(tokens[i++]);
-    leases->mac = strdup(tokens[i++]);
-    leases->ip = strdup(tokens[i++]);
-    leases->name = strdup(tokens[i++]);
-    leases->id = strdup(tokens[i++]);
-    leases->id[strcspn(leases->id, "\n")] = 0;
-}
-
-/**
- * @brief Parse OpenWRTs dhcpcd.leases file.
- */
-static int
-parse_leases_file(FILE *lease_fd, struct list_head *leases)
+/* Value of an UCI option, list options are joined with spaces. */
+static char *
+uci_option_value(struct uci_option *o)
 {
-    struct dhcp_lease *lease;
-    size_t n_lease = 0;
-    char *line = NULL;
-    int n_read = 0;
+    struct uci_element *e;
+    char *value = NULL;
     size_t len = 0;
 
-    while((n_read = getline(&line, &len, lease_fd)) > 0) {
-        lease = calloc(1, sizeof(*lease));
-        parse_lease(line, lease);
-        list_add(&lease->head, leases);
-        n_lease++;
-    }
-
-    if (n_lease < 1) {
-        fprintf(stderr, "Lease file is empty.\n");
-        return -1;
+    if (o->type == UCI_TYPE_STRING) {
+        return strdup(o->v.string);
     }
 
-    if (line) {
-        free(line);
+    uci_foreach_element(&o->v.list, e) {
+        size_t n = strlen(e->name);
+        char *tmp = realloc(value, len + n + 2);
+        if (!tmp) {
+            break;
+        }
+        value = tmp;
+        if (len) {
+            value[len++] = ' ';
+        }
+        memcpy(value + len, e->name, n + 1);
+        len += n;
     }
 
-    return 0;
+    return value;
 }
 
+/**
+ * @brief Fill a wifi-device or wifi-iface entry from its UCI section.
+ *
+ * Options are stored in the leaf of the same name, the list key is the section name.
+ */
 static void
-parse_wifi_device(struct uci_section *s, struct wifi_device *wifi_dev)
+parse_wifi_section(struct uci_section *s, enum model_node_id id, void *entry)
 {
+    const struct model_node *node = &model_nodes[id];
+    const struct model_leaf *leaf;
     struct uci_element *e;
     struct uci_option *o;
-    char *name, *value;
+
+    leaf = model_find_leaf(node, node->key);
+    MODEL_LEAF_STR(entry, leaf) = strdup(s->e.name);
 
     uci_foreach_element(&s->options, e) {
         o = uci_to_option(e);
-        name = e->name;
-        value = o->v.string;
-        if        (!strcmp("name", name)) {
-            wifi_dev->name = strdup(value);
-        } else if (!strcmp("type", name)) {
-            wifi_dev->type = strdup(value);
-        } else if (!strcmp("channel", name)) {
-            wifi_dev->channel = strdup(value);
-        } else if (!strcmp("macaddr", name)) {
-            wifi_dev->macaddr = strdup(value);
-        } else if (!strcmp("hwmode", name)) {
-            wifi_dev->hwmode = strdup(value);
-        } else if (!strcmp("disabled", name)) {
-            wifi_dev->disabled = strdup(value);
+        leaf = model_find_leaf(node, e->name);
+        if (!leaf || (leaf->flags & MODEL_LEAF_KEY)) {
+            fprintf(stderr, "unexpected option: %s\n", e->name);
+            continue;
         }
+        MODEL_LEAF_STR(entry, leaf) = uci_option_value(o);
     }
 }
 
-static void
-parse_wifi_iface(struct uci_section *s, struct wifi_iface *wifi_if)
+/**
+ * @brief Keep a parsed wifi section within the memory budget.
+ *
+ * With a wifi pool the section is moved into a slot, unless its list is full
+ * or the leaves don't fit.
+ *
+ * @return Entry to add to the list, NULL if the section is left out.
+ */
+static void *
+wifi_section_budget(struct model *model, enum model_node_id id, void *entry, size_t n)
 {
-    struct uci_element *e;
-    struct uci_option *o;
-    char *name, *value;
-
-    wifi_if->name = strdup(s->e.name);
+    void *copy;
 
-    uci_foreach_element(&s->options, e) {
-        o = uci_to_option(e);
-        name = o->e.name;
-        value = o->v.string;
-        if        (!strcmp("name", name)) {
-            wifi_if->name = strdup(value);
-        } else if (!strcmp("device", name)) {
-            wifi_if->device= strdup(value);
-        } else if (!strcmp("network", name)) {
-            wifi_if->network = strdup(value);
-        } else if (!strcmp("mode", name)) {
-            wifi_if->mode = strdup(value);
-        } else if (!strcmp("ssid", name)) {
-            wifi_if->ssid = strdup(value);
-        } else if (!strcmp("encryption", name)) {
-            wifi_if->encryption = strdup(value);
-        } else if (!strcmp("maclist", name)) {
-            wifi_if->maclist = strdup(value);
-        } else if (!strcmp("macfilter", name)) {
-            wifi_if->macfilter = strdup(value);
-        } else if (!strcmp("key", name)) {
-            wifi_if->key = strdup(value);
-        } else {
-            fprintf(stderr, "unexpected option: %s:%s\n", name, value);
-        }
+    if (!model->wifi_pool) {
+        return entry;
     }
+    copy = n < model->wifi_limit ? pool_entry_dup(model->wifi_pool, id, entry) : NULL;
+    if (!copy) {
+        fprintf(stderr, "Wifi section %s exceeds the memory budget\n",
+                model_key_value(&model_nodes[id], entry));
+    }
+    pool_entry_free(NULL, id, entry);
+
+    return copy;
 }
 
 /**
  * @breif Get information about WIFI devices and interfaces.
  *
- * @param[in] ctx UCI context needed for iterating over configurations.
+ * @param[in] model Model with the UCI context and the memory budget.
  * @param[out] ifs List of interfaces.
  * @param[out] devs List of devices.
  */
 static int
-status_wifi(struct uci_context *ctx, struct list_head *ifs, struct list_head *devs)
+status_wifi(struct model *model, struct list_head *ifs, struct list_head *devs)
 {
     struct uci_package *package = NULL;
-    struct wifi_iface *wifi_if;
-    struct wifi_device *wifi_dev;
+    enum model_node_id id;
+    struct list_head *list;
     struct uci_element *e;
     struct uci_section *s;
+    size_t n_ifs = 0, n_devs = 0, *n;
+    unsigned long dropped = 0;
+    void *entry;
     int rc;
 
-    rc = uci_load(ctx, config_file, &package);
+    rc = uci_load(model->uci_ctx, config_file, &package);
     if (rc != UCI_OK) {
         fprintf(stderr, "No configuration (package): %s\n", config_file);
         goto out;
@@ -265,352 +432,1052 @@ status_wifi(struct uci_context *ctx, struct list_head *ifs, struct list_head *de
 
     uci_foreach_element(&package->sections, e) {
         s = uci_to_section(e);
-        wifi_if = calloc(1, sizeof(*wifi_if));
-        wifi_dev = calloc(1, sizeof(*wifi_dev));
 
         if (!strcmp(s->type, "wifi-iface") || !strcmp(s->type, "'wifi-iface'")) {
-            parse_wifi_iface(s, wifi_if);
-            list_add(&wifi_if->head, ifs);
+            id = MODEL_WIFI_IFACE;
+            list = ifs;
+            n = &n_ifs;
         } else if (!strcmp("wifi-device", s->type) || !strcmp(s->type, "'wifi-device'")) {
-            parse_wifi_device(s, wifi_dev);
-            list_add(&wifi_dev->head, devs);
-
+            id = MODEL_WIFI_DEVICE;
+            list = devs;
+            n = &n_devs;
         } else {
             fprintf(stderr, "Unexpected section: %s\n", s->type);
+            continue;
         }
-    }
-
-    struct wifi_iface *if_it;
-    list_for_each_entry(if_it, ifs, head) {
-        print_wifi_iface(wifi_if);
-    }
 
-    struct wifi_device *dev_it;
-    list_for_each_entry(dev_it, devs, head) {
-        print_wifi_device(wifi_dev);
+        entry = calloc(1, model_nodes[id].size);
+        if (!entry) {
+            continue;
+        }
+        parse_wifi_section(s, id, entry);
+        print_node(id, entry);
+        entry = wifi_section_budget(model, id, entry, *n);
+        if (!entry) {
+            dropped++;
+            continue;
+        }
+        list_add(entry, list);
+        (*n)++;
     }
+    atomic_store(&model->wifi_dropped, dropped);
 
   out:
     if (package) {
-        uci_unload(ctx, package);
+        uci_unload(model->uci_ctx, package);
     }
 
-    return true;
+    return rc;
 }
 
 
+/* Sort order of a value batch, list entries precede their leaves. */
 static int
-set_value_str(sr_session_ctx_t *sess, char *val_str, char *set_path)
+value_cmp(const void *a, const void *b)
 {
-    sr_val_t val = { 0, };
-
-    val.type = SR_STRING_T;
-    val.data.string_val = val_str;
+    return strcmp(((const sr_val_t *) a)->xpath, ((const sr_val_t *) b)->xpath);
+}
 
-    int rc = sr_set_item(sess, set_path, &val, SR_EDIT_DEFAULT);
+static bool
+value_equal(const sr_val_t *a, const sr_val_t *b)
+{
+    if (a->type != b->type) {
+        return false;
+    }
+    if (a->type == SR_LIST_T) {
+        return true;
+    }
 
-    return rc;
+    return !strcmp(a->data.string_val, b->data.string_val);
 }
 
 /**
- * Update Sysrepo data-store with given run-time values.
+ * @brief Append one value to the batch.
+ *
+ * @param[in] value String data of a leaf, NULL for list entries.
  */
 static int
-set_values(sr_session_ctx_t *sess, struct board *board,
-           struct list_head *wifi_dev,
-           struct list_head *wifi_if,
-           struct list_head *leases)
-
+batch_add(struct value_batch *batch, const char *xpath, sr_type_t type, const char *value)
 {
+    sr_val_t *val;
+    size_t size;
     int rc = SR_ERR_OK;
-    char xpath[XPATH_MAX_LEN];
 
-    /* Setting kernel values. */
-    if (board->kernel){
-        snprintf(xpath, XPATH_MAX_LEN, "/status:board/kernel");
-        if (SR_ERR_OK != set_value_str(sess, board->kernel, xpath)) {
-            goto cleanup;
+    if (batch->cnt == batch->size) {
+        size = batch->size ? 2 * batch->size : 64;
+        rc = sr_realloc_values(batch->size, size, &batch->values);
+        if (SR_ERR_OK != rc) {
+            return rc;
         }
+        batch->size = size;
     }
 
-    if (board->hostname){
-        snprintf(xpath, XPATH_MAX_LEN, "/status:board/hostname");
-        if (SR_ERR_OK != set_value_str(sess, board->hostname, xpath)) {
-            goto cleanup;
-        }
+    val = &batch->values[batch->cnt];
+    rc = sr_val_set_xpath(val, xpath);
+    if (SR_ERR_OK != rc) {
+        return rc;
     }
-
-    if (board->system){
-        snprintf(xpath, XPATH_MAX_LEN, "/status:board/system");
-        if (SR_ERR_OK != set_value_str(sess, board->system, xpath)) {
-            goto cleanup;
+    if (value) {
+        rc = sr_val_set_str_data(val, type, value);
+        if (SR_ERR_OK != rc) {
+            return rc;
         }
+    } else {
+        val->type = type;
     }
+    batch->cnt++;
 
-    if (board->release->distribution){
-        snprintf(xpath, XPATH_MAX_LEN, "/status:board/release/distribution");
-        if (SR_ERR_OK != set_value_str(sess, board->release->distribution, xpath)) {
-            goto cleanup;
-        }
-    }
+    return rc;
+}
 
-    if (board->release->version){
-        snprintf(xpath, XPATH_MAX_LEN, "/status:board/release/version");
-        if (SR_ERR_OK != set_value_str(sess, board->release->version, xpath)) {
-            goto cleanup;
-        }
+static void
+batch_free(struct value_batch *batch)
+{
+    if (batch->values) {
+        sr_free_values(batch->values, batch->size);
     }
+    batch->values = NULL;
+    batch->cnt = 0;
+    batch->size = 0;
+}
 
-    if (board->release->revision){
-        snprintf(xpath, XPATH_MAX_LEN, "/status:board/release/revision");
-        if (SR_ERR_OK != set_value_str(sess, board->release->revision, xpath)) {
-            goto cleanup;
-        }
-    }
-    if (board->release->codename){
-        snprintf(xpath, XPATH_MAX_LEN, "/status:board/release/codename");
-        if (SR_ERR_OK != set_value_str(sess, board->release->codename, xpath)) {
-            goto cleanup;
-        }
-    }
+/**
+ * @brief Add all leaves of one model node entry to the batch.
+ *
+ * The entry prefix (including the key predicate) is built once and reused for every leaf.
+ */
+static int
+batch_add_node(struct value_batch *batch, struct xpath_buf *xb, enum model_node_id id, void *entry)
+{
+    const struct model_node *node = &model_nodes[id];
+    const struct model_leaf *leaf;
+    char *key, *value;
+    size_t prefix, i;
+    int rc = SR_ERR_OK;
 
-    if (board->release->target){
-        snprintf(xpath, XPATH_MAX_LEN, "/status:board/release/target");
-        if (SR_ERR_OK != set_value_str(sess, board->release->target, xpath)) {
-            goto cleanup;
-        }
+    key = model_key_value(node, entry);
+    if (node->key && (!key || !strcmp("", key))) {
+        return SR_ERR_OK;
     }
 
-    /* Setting leases values. */
-    struct dhcp_lease *l;
-    list_for_each_entry(l, leases, head) {
-        if (!l->id || !strcmp("", l->id) ) break;
-
-        if (l->lease_expirey){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:dhcp/dhcp-leases[id='%s']/lease-expirey", l->id);
-            if (SR_ERR_OK != set_value_str(sess, l->lease_expirey, xpath)) {
-                goto cleanup;
-            }
+    xpath_buf_truncate(xb, 0);
+    rc = xpath_buf_append(xb, "%s", node->xpath);
+    if (SR_ERR_OK == rc && node->key) {
+        rc = xpath_buf_append_key(xb, node->key, key);
+        if (SR_ERR_OK == rc) {
+            rc = batch_add(batch, xb->buf, SR_LIST_T, NULL);
         }
+    }
+    if (SR_ERR_OK != rc) {
+        return rc;
+    }
+    prefix = xb->len;
 
-        if (l->mac){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:dhcp/dhcp-leases[id='%s']/mac", l->id);
-            if (SR_ERR_OK != set_value_str(sess, l->mac, xpath)) {
-                goto cleanup;
-            }
+    for (i = 0; i < node->n_leaves; i++) {
+        leaf = &node->leaves[i];
+        value = MODEL_LEAF_STR(entry, leaf);
+        if (!value || (leaf->flags & MODEL_LEAF_KEY)) {
+            continue;
         }
 
-        if (l->ip){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:dhcp/dhcp-leases[id='%s']/ip", l->id);
-            if (SR_ERR_OK != set_value_str(sess, l->ip, xpath)) {
-                goto cleanup;
-            }
+        xpath_buf_truncate(xb, prefix);
+        rc = xpath_buf_append(xb, "/%s", leaf->path);
+        if (SR_ERR_OK != rc) {
+            break;
         }
-
-        if (l->name){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:dhcp/dhcp-leases[id='%s']/name", l->id);
-            if (SR_ERR_OK != set_value_str(sess, l->name, xpath)) {
-                goto cleanup;
-            }
+        rc = batch_add(batch, xb->buf, leaf->type, value);
+        if (SR_ERR_OK != rc) {
+            break;
         }
-
     }
 
-    /* Setting wifi values. */
-    struct wifi_device *d;
-    list_for_each_entry(d, wifi_dev , head) {
-        if (!d->name|| !strcmp("", d->name) ) break;
+    return rc;
+}
 
-        if (d->type){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-device[name='%s']/type", d->name);
-            if (SR_ERR_OK != set_value_str(sess, d->type, xpath)) {
-                goto cleanup;
-            }
-        }
+/* Generated list structs start with their list_head, so a list position is its entry. */
+static int
+batch_add_list(struct value_batch *batch, struct xpath_buf *xb, enum model_node_id id,
+               struct list_head *list)
+{
+    struct list_head *pos;
+    int rc = SR_ERR_OK;
 
-        if (d->channel){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-device[name='%s']/type", d->name);
-            if (SR_ERR_OK != set_value_str(sess, d->channel, xpath)) {
-                goto cleanup;
-            }
+    list_for_each(pos, list) {
+        rc = batch_add_node(batch, xb, id, pos);
+        if (SR_ERR_OK != rc) {
+            break;
         }
+    }
 
-        if (d->macaddr){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-device[name='%s']/macaddr", d->name);
-            if (SR_ERR_OK != set_value_str(sess, d->macaddr, xpath)) {
-                goto cleanup;
-            }
-        }
+    return rc;
+}
 
-        if (d->hwmode){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-device[name='%s']/hwmode", d->name);
-            if (SR_ERR_OK != set_value_str(sess, d->hwmode, xpath)) {
-                goto cleanup;
-            }
-        }
+/**
+ * @brief Assemble the whole model as one sorted batch of values.
+ */
+static int
+build_batch(struct model *model, struct value_batch *batch)
+{
+    struct xpath_buf xb = {0,};
+    int rc = SR_ERR_OK;
 
-        if (d->disabled){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-device[name='%s']/disabled", d->name);
-            if (SR_ERR_OK != set_value_str(sess, d->disabled, xpath)) {
-                goto cleanup;
-            }
-        }
+    if (model->board) {
+        rc = batch_add_node(batch, &xb, MODEL_BOARD, model->board);
+    }
+    if (SR_ERR_OK == rc) {
+        rc = batch_add_list(batch, &xb, MODEL_DHCP_LEASES, model->leases);
+    }
+    if (SR_ERR_OK == rc) {
+        rc = batch_add_list(batch, &xb, MODEL_WIFI_DEVICE, model->wifi_devs);
     }
+    if (SR_ERR_OK == rc) {
+        rc = batch_add_list(batch, &xb, MODEL_WIFI_IFACE, model->wifi_ifs);
+    }
+    xpath_buf_free(&xb);
 
+    if (SR_ERR_OK == rc) {
+        qsort(batch->values, batch->cnt, sizeof(*batch->values), value_cmp);
+    }
 
-    /* Setting wifi interfaces values. */
-    struct wifi_iface *i;
-    list_for_each_entry(i, wifi_if, head) {
-        if (!i->name|| !strcmp("", i->name) ) break;
+    return rc;
+}
 
-        print_wifi_iface(i);
-        if (i->device){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-iface[name='%s']/device", i->name);
-            if (SR_ERR_OK != set_value_str(sess, i->device, xpath)) {
-                goto cleanup;
-            }
+/**
+ * @brief Edit the data-store from the previously published batch to the new one.
+ *
+ * Both batches are sorted, so a single merge pass finds the values that were added,
+ * changed or removed. Leaves of a removed list entry are deleted together with it.
+ *
+ * @return SR_ERR_OK on success, number of edits is stored in n_edits.
+ */
+static int
+submit_batch(sr_session_ctx_t *sess, struct value_batch *old, struct value_batch *new,
+             size_t *n_edits)
+{
+    const char *deleted = NULL;
+    size_t deleted_len = 0;
+    size_t i = 0, j = 0;
+    sr_val_t *v;
+    int cmp, rc = SR_ERR_OK;
+
+    *n_edits = 0;
+    while (SR_ERR_OK == rc && (i < old->cnt || j < new->cnt)) {
+        if (i == old->cnt) {
+            cmp = 1;
+        } else if (j == new->cnt) {
+            cmp = -1;
+        } else {
+            cmp = strcmp(old->values[i].xpath, new->values[j].xpath);
         }
 
-        if (i->network){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-iface[name='%s']/network", i->name);
-            if (SR_ERR_OK != set_value_str(sess, i->network, xpath)) {
-                goto cleanup;
+        if (cmp < 0) {
+            v = &old->values[i++];
+            if (deleted && !strncmp(v->xpath, deleted, deleted_len) && v->xpath[deleted_len] == '/') {
+                continue;
             }
-        }
-
-        if (i->mode){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-iface[name='%s']/mode", i->name);
-            if (SR_ERR_OK != set_value_str(sess, i->mode, xpath)) {
-                goto cleanup;
+            rc = sr_delete_item(sess, v->xpath, SR_EDIT_DEFAULT);
+            if (v->type == SR_LIST_T) {
+                deleted = v->xpath;
+                deleted_len = strlen(deleted);
             }
+            (*n_edits)++;
+            continue;
         }
 
-        if (i->ssid){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-iface[name='%s']/ssid", i->name);
-            if (SR_ERR_OK != set_value_str(sess, i->ssid, xpath)) {
-                goto cleanup;
+        v = &new->values[j++];
+        if (cmp == 0) {
+            i++;
+            if (value_equal(&old->values[i - 1], v)) {
+                continue;
             }
         }
-
-        if (i->encryption){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-iface[name='%s']/encryption", i->name);
-            if (SR_ERR_OK != set_value_str(sess, i->encryption, xpath)) {
-                goto cleanup;
-            }
+        /* List entries are created along with their leaves. */
+        if (v->type == SR_LIST_T) {
+            continue;
         }
+        rc = sr_set_item(sess, v->xpath, v, SR_EDIT_DEFAULT);
+        (*n_edits)++;
+    }
 
-        if (i->maclist){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-iface[name='%s']/maclist", i->name);
-            if (SR_ERR_OK != set_value_str(sess, i->maclist, xpath)) {
-                goto cleanup;
-            }
-        }
+    return rc;
+}
 
-        if (i->macfilter){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-iface[name='%s']/macfilter", i->name);
-            if (SR_ERR_OK != set_value_str(sess, i->macfilter, xpath)) {
-                goto cleanup;
-            }
-        }
+/**
+ * Update Sysrepo data-store with given run-time values.
+ *
+ * The model is assembled into one batch and only its difference to the last
+ * published batch is edited, followed by a single commit. Publishers on other
+ * threads wait for each other.
+ */
+static int
+set_values(sr_session_ctx_t *sess, struct model *model)
+{
+    struct value_batch batch = {0,};
+    size_t n_edits = 0;
+    int rc = SR_ERR_OK;
 
-        if (i->key){
-            snprintf(xpath, XPATH_MAX_LEN,
-                     "/status:wifi/wifi-iface[name='%s']/key", i->name);
-            if (SR_ERR_OK != set_value_str(sess, i->key, xpath)) {
-                goto cleanup;
-            }
-        }
+    trace_begin("publish", "set_values");
+    pthread_mutex_lock(&model->publish_lock);
+    pthread_mutex_lock(&model->lock);
+    rc = build_batch(model, &batch);
+    pthread_mutex_unlock(&model->lock);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Error building values: %s\n", sr_strerror(rc));
+        goto cleanup;
     }
 
-    /* Commit values set. */
-    rc = sr_commit(sess);
+    rc = submit_batch(sess, &model->published, &batch, &n_edits);
     if (SR_ERR_OK != rc) {
-        fprintf(stderr, "Error by sr_commit: %s\n", sr_strerror(rc));
+        fprintf(stderr, "Error by edit: %s\n", sr_strerror(rc));
+        sr_discard_changes(sess);
         goto cleanup;
     }
 
+    if (n_edits) {
+        /* Our own subscriptions let the changes of this batch pass. */
+        pthread_mutex_lock(&model->lock);
+        model->committing = &batch;
+        pthread_mutex_unlock(&model->lock);
+        rc = sr_commit(sess);
+        pthread_mutex_lock(&model->lock);
+        model->committing = NULL;
+        pthread_mutex_unlock(&model->lock);
+        if (SR_ERR_OK != rc) {
+            fprintf(stderr, "Error by sr_commit: %s\n", sr_strerror(rc));
+            sr_discard_changes(sess);
+            goto cleanup;
+        }
+    }
+
+    batch_free(&model->published);
+    model->published = batch;
+    batch.values = NULL;
+
   cleanup:
+    batch_free(&batch);
+    pthread_mutex_unlock(&model->publish_lock);
+    trace_end("publish", "set_values");
     return rc;
 }
 
-/**
- * @brief Initialize necessary information describing the model.
- *
- * @param[out] ctx Model to fill.
- */
+static struct lease_source *
+lease_source_get(struct list_head *sources, const char *name, size_t len)
+{
+    struct lease_source *src;
+
+    list_for_each_entry(src, sources, head) {
+        if (strlen(src->name) == len && !strncmp(src->name, name, len)) {
+            return src;
+        }
+    }
+
+    src = calloc(1, sizeof(*src));
+    if (!src) {
+        return NULL;
+    }
+    src->name = strndup(name, len);
+    if (!src->name) {
+        free(src);
+        return NULL;
+    }
+    list_add_tail(&src->head, sources);
+
+    return src;
+}
+
+/**
+ * @brief Add the configured lease sources to the collector.
+ *
+ * Entries are assembled from the leaves of the lease-source list, located by the
+ * change classifier. Without usable entries the default sources are added.
+ */
+static int
+load_lease_sources(sr_session_ctx_t *session, struct lease_collector *c)
+{
+    const struct model_node *node = &model_nodes[MODEL_LEASE_SOURCE];
+    struct list_head sources = LIST_HEAD_INIT(sources);
+    struct lease_source *src;
+    struct change_info info;
+    char xpath[XPATH_MAX_LEN];
+    sr_val_t *values = NULL;
+    size_t cnt = 0, i;
+    char *value;
+    int rc = SR_ERR_OK;
+
+    snprintf(xpath, XPATH_MAX_LEN, "%s//*", node->xpath);
+    if (SR_ERR_OK == sr_get_items(session, xpath, &values, &cnt)) {
+        for (i = 0; i < cnt; i++) {
+            classify_change(&classifier, values[i].xpath, &info);
+            if (info.node != MODEL_LEASE_SOURCE || !info.leaf || !info.key ||
+                (info.leaf->flags & MODEL_LEAF_KEY) || !MODEL_LEAF_IS_STR(info.leaf)) {
+                continue;
+            }
+
+            src = lease_source_get(&sources, info.key, info.key_len);
+            value = values[i].type == SR_ENUM_T ? values[i].data.enum_val : values[i].data.string_val;
+            if (!src || !value) {
+                rc = src ? SR_ERR_OK : SR_ERR_NOMEM;
+                continue;
+            }
+            free(MODEL_LEAF_STR(src, info.leaf));
+            MODEL_LEAF_STR(src, info.leaf) = strdup(value);
+        }
+        sr_free_values(values, cnt);
+    }
+
+    list_for_each_entry(src, &sources, head) {
+        lease_collector_add(c, src->name, src->type, src->path);
+    }
+    model_free_list(MODEL_LEASE_SOURCE, &sources);
+
+    if (list_empty(&c->feeds)) {
+        for (i = 0; i < sizeof(default_lease_sources) / sizeof(default_lease_sources[0]); i++) {
+            lease_collector_add(c, default_lease_sources[i].name, default_lease_sources[i].type,
+                                default_lease_sources[i].path);
+        }
+    }
+
+    return rc;
+}
+
+/**
+ * @brief Send one dhcp-lease-event notification.
+ */
 static void
-init_data(struct model *ctx)
+send_lease_event(enum lease_event event, const struct dhcp_lease *lease, void *priv)
+{
+    const struct model_node *node = &model_nodes[MODEL_DHCP_LEASES];
+    const struct model_leaf *leaf;
+    struct model *model = priv;
+    char xpath[XPATH_MAX_LEN];
+    sr_val_t *v = NULL;
+    size_t i, n = 0;
+    char *value;
+    int rc;
+
+    rc = sr_new_values(node->n_leaves + 1, &v);
+    if (SR_ERR_OK != rc) {
+        return;
+    }
+
+    sr_val_set_xpath(&v[n], LEASE_EVENT_XPATH "/event");
+    rc = sr_val_set_str_data(&v[n++], SR_ENUM_T, lease_event_name(event));
+    for (i = 0; i < node->n_leaves && SR_ERR_OK == rc; i++) {
+        leaf = &node->leaves[i];
+        value = MODEL_LEAF_STR(lease, leaf);
+        if (!value) {
+            continue;
+        }
+        snprintf(xpath, XPATH_MAX_LEN, "%s/%s", LEASE_EVENT_XPATH, leaf->path);
+        rc = sr_val_set_xpath(&v[n], xpath);
+        if (SR_ERR_OK == rc) {
+            rc = sr_val_set_str_data(&v[n++], leaf->type, value);
+        }
+    }
+
+    if (SR_ERR_OK == rc) {
+        rc = sr_event_notif_send(model->lease_session, LEASE_EVENT_XPATH, v, n,
+                                 SR_EV_NOTIF_DEFAULT);
+    }
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Can't send lease event %s for %s: %s\n",
+                lease_event_name(event), lease->id ? lease->id : "", sr_strerror(rc));
+    }
+    sr_free_values(v, node->n_leaves + 1);
+}
+
+/*
+ * The board is read once at start. If ubusd was not up then, it is read again
+ * whenever the model is refreshed, until it can be read.
+ */
+static void
+retry_board(struct model *model)
+{
+    bool missing;
+
+    pthread_mutex_lock(&model->lock);
+    missing = !model->board;
+    pthread_mutex_unlock(&model->lock);
+
+    if (missing) {
+        collector_refresh(&model->sources[SOURCE_BOARD], true);
+    }
+}
+
+/**
+ * @brief Take over the merged leases after a lease source changed.
+ *
+ * The new snapshot is compared to the published one and every difference is sent
+ * as a notification, then the lease list is replaced and republished. Updates
+ * are serialized by the collector, so the diff does not need the model lock.
+ */
+static void
+leases_changed(struct list_head *merged, void *priv)
+{
+    struct model *model = priv;
+    int rc;
+
+    retry_board(model);
+
+    /* The first snapshot is published by the plugin init, without events. */
+    if (model->lease_session) {
+        rc = lease_diff(model->leases, merged, time(NULL), send_lease_event, model);
+        if (SR_ERR_OK != rc) {
+            fprintf(stderr, "Can't compare leases: %s\n", sr_strerror(rc));
+        }
+    }
+
+    pthread_mutex_lock(&model->lock);
+    model_free_list(MODEL_DHCP_LEASES, model->leases);
+    list_splice_init(merged, model->leases);
+    publish_shm(model);
+    pthread_mutex_unlock(&model->lock);
+
+    if (model->lease_session) {
+        set_values(model->lease_session, model);
+    }
+}
+
+/**
+ * @brief Set up the lease sources and read the leases of all of them.
+ */
+static int
+start_lease_sources(sr_session_ctx_t *session, struct model *model)
+{
+    int rc;
+
+    model->collector = calloc(1, sizeof(*model->collector));
+    if (!model->collector) {
+        return SR_ERR_NOMEM;
+    }
+    lease_collector_init(model->collector, leases_changed, model);
+
+    rc = load_lease_sources(session, model->collector);
+    if (SR_ERR_OK != rc) {
+        return rc;
+    }
+
+    if (model->settings.lease_limit) {
+        model->lease_pool = calloc(1, sizeof(*model->lease_pool));
+        if (!model->lease_pool) {
+            return SR_ERR_NOMEM;
+        }
+        rc = lease_collector_set_limit(model->collector, model->lease_pool,
+                                       model->settings.lease_limit);
+        if (SR_ERR_OK != rc) {
+            free(model->lease_pool);
+            model->lease_pool = NULL;
+            return rc;
+        }
+        entry_pools[MODEL_DHCP_LEASES] = model->lease_pool;
+    }
+
+    return collector_refresh(&model->sources[SOURCE_LEASES], true);
+}
+
+/**
+ * @brief Watch the lease sources with their own sysrepo session.
+ *
+ * The plugin session belongs to the engine's thread, the watcher publishes and
+ * sends notifications from its own.
+ */
+static int
+start_lease_watch(struct model *model)
+{
+    int rc;
+
+    rc = sr_connect("status-leases", SR_CONN_DEFAULT, &model->lease_conn);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Error by sr_connect: %s\n", sr_strerror(rc));
+        return rc;
+    }
+    rc = sr_session_start(model->lease_conn, SR_DS_RUNNING, SR_SESS_DEFAULT, &model->lease_session);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Error by sr_session_start: %s\n", sr_strerror(rc));
+        return rc;
+    }
+
+    return lease_collector_watch(model->collector);
+}
+
+static void
+stop_lease_watch(struct model *model)
+{
+    if (model->collector) {
+        lease_collector_free(model->collector);
+        free(model->collector);
+        model->collector = NULL;
+    }
+    if (model->lease_session) {
+        sr_session_stop(model->lease_session);
+        model->lease_session = NULL;
+    }
+    if (model->lease_conn) {
+        sr_disconnect(model->lease_conn);
+        model->lease_conn = NULL;
+    }
+}
+
+/**
+ * @brief Take over an edit of the wireless package made by another tool.
+ *
+ * Only the sections that changed are replaced in the model and published, an
+ * event for the plugin's own commit finds nothing to do. The watcher also calls
+ * this once ubusd is back, when a board missing since start can be read.
+ */
+static void
+wireless_changed(void *priv)
+{
+    struct model *model = priv;
+    unsigned long changes;
+    int rc;
+
+    pthread_mutex_lock(&model->lock);
+    changes = model->wifi_changes;
+    pthread_mutex_unlock(&model->lock);
+
+    retry_board(model);
+    rc = collector_refresh(&model->sources[SOURCE_WIFI], true);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Can't reload %s: %s\n", config_file, sr_strerror(rc));
+        return;
+    }
+
+    pthread_mutex_lock(&model->lock);
+    changes = model->wifi_changes - changes;
+    pthread_mutex_unlock(&model->lock);
+
+    if (changes) {
+        fprintf(stderr, "%s changed in %lu sections\n", config_file, changes);
+        set_values(model->config_session, model);
+    }
+}
+
+/**
+ * @brief Follow edits of the wireless package by other tools.
+ *
+ * The watcher publishes from its own thread with its own session on the lease
+ * watcher's connection.
+ */
+static int
+start_config_watch(struct model *model)
+{
+    int rc;
+
+    rc = sr_session_start(model->lease_conn, SR_DS_RUNNING, SR_SESS_DEFAULT, &model->config_session);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Error by sr_session_start: %s\n", sr_strerror(rc));
+        return rc;
+    }
+
+    model->config_watch = calloc(1, sizeof(*model->config_watch));
+    if (!model->config_watch) {
+        return SR_ERR_NOMEM;
+    }
+    rc = config_watch_start(model->config_watch, config_file, wireless_changed, model);
+    if (SR_ERR_OK != rc) {
+        free(model->config_watch);
+        model->config_watch = NULL;
+    }
+
+    return rc;
+}
+
+static void
+stop_config_watch(struct model *model)
+{
+    if (model->config_watch) {
+        config_watch_stop(model->config_watch);
+        free(model->config_watch);
+        model->config_watch = NULL;
+    }
+    if (model->config_session) {
+        sr_session_stop(model->config_session);
+        model->config_session = NULL;
+    }
+}
+
+/* Read the board from ubus and swap it into the model. */
+static int
+collect_board(void *priv)
+{
+    struct model *model = priv;
+    struct board *fresh, *old;
+    int rc;
+
+    fresh = calloc(1, sizeof(*fresh));
+    if (!fresh) {
+        return SR_ERR_NOMEM;
+    }
+    rc = parse_board(model->bus, fresh);
+    if (rc) {
+        model_free_entry(MODEL_BOARD, fresh);
+        return UBUS_STATUS_CONNECTION_FAILED == rc ? SR_ERR_DISCONNECT : SR_ERR_INTERNAL;
+    }
+
+    pthread_mutex_lock(&model->lock);
+    old = model->board;
+    model->board = fresh;
+    publish_shm(model);
+    pthread_mutex_unlock(&model->lock);
+    if (old) {
+        model_free_entry(MODEL_BOARD, old);
+    }
+
+    return SR_ERR_OK;
+}
+
+/*
+ * Read the wifi devices and interfaces from UCI and merge them into the model
+ * section by section, counting the sections that changed.
+ */
+static int
+collect_wifi(void *priv)
+{
+    struct model *model = priv;
+    struct list_head fresh_ifs = LIST_HEAD_INIT(fresh_ifs);
+    struct list_head fresh_devs = LIST_HEAD_INIT(fresh_devs);
+    size_t changes;
+
+    if (!model->uci_ctx) {
+        return SR_ERR_INTERNAL;
+    }
+    if (UCI_OK != status_wifi(model, &fresh_ifs, &fresh_devs)) {
+        model_free_list(MODEL_WIFI_IFACE, &fresh_ifs);
+        model_free_list(MODEL_WIFI_DEVICE, &fresh_devs);
+        return SR_ERR_INTERNAL;
+    }
+
+    pthread_mutex_lock(&model->lock);
+    changes = model_merge_list(MODEL_WIFI_IFACE, model->wifi_ifs, &fresh_ifs);
+    changes += model_merge_list(MODEL_WIFI_DEVICE, model->wifi_devs, &fresh_devs);
+    if (changes) {
+        model->wifi_changes += changes;
+        publish_shm(model);
+    }
+    pthread_mutex_unlock(&model->lock);
+
+    return SR_ERR_OK;
+}
+
+/* Re-read all lease sources, the collector hands the result to leases_changed. */
+static int
+collect_leases(void *priv)
+{
+    struct model *model = priv;
+
+    if (!model->collector) {
+        return SR_ERR_INTERNAL;
+    }
+
+    return lease_collector_reload(model->collector);
+}
+
+/* Ask iwinfo and hostapd for the live state of the wifi interfaces. */
+static int
+collect_runtime(void *priv)
+{
+    struct model *model = priv;
+
+    if (!model->runtime) {
+        return SR_ERR_INTERNAL;
+    }
+
+    return wifi_runtime_collect(model->runtime);
+}
+
+/* Sample load, memory and CPU usage of the board. */
+static int
+collect_health(void *priv)
+{
+    struct model *model = priv;
+
+    if (!model->health) {
+        return SR_ERR_INTERNAL;
+    }
+
+    return health_collect(model->health);
+}
+
+/*
+ * Single-flight collectors in front of the model's data sources. Board, wifi and
+ * leases are published to the data-store and collected only when they changed, so
+ * without a TTL; their collector lets a watcher and an apply that refresh at the
+ * same time share one collection. Runtime and health serve data provider reads,
+ * which reuse a result younger than the TTL.
+ */
+static const struct {
+    const char *name;
+    uint32_t ttl_ms;
+    collect_cb collect;
+} model_sources[SOURCE_COUNT] = {
+    [SOURCE_BOARD] = { "board", 0, collect_board },
+    [SOURCE_WIFI] = { "wifi", 0, collect_wifi },
+    [SOURCE_LEASES] = { "leases", 0, collect_leases },
+    [SOURCE_RUNTIME] = { "runtime", RUNTIME_TTL_MS, collect_runtime },
+    [SOURCE_HEALTH] = { "health", DEFAULT_HEALTH_INTERVAL_MS, collect_health },
+};
+
+static int
+start_collectors(struct model *model)
+{
+    size_t i;
+
+    model->sources = calloc(SOURCE_COUNT, sizeof(*model->sources));
+    if (!model->sources) {
+        return SR_ERR_NOMEM;
+    }
+    for (i = 0; i < SOURCE_COUNT; i++) {
+        collector_init(&model->sources[i], model_sources[i].name, model_sources[i].ttl_ms,
+                       model_sources[i].collect, model);
+    }
+
+    return SR_ERR_OK;
+}
+
+static void
+stop_collectors(struct model *model)
 {
-    FILE *fd_lease = NULL;
+    size_t i;
 
+    if (!model->sources) {
+        return;
+    }
+    for (i = 0; i < SOURCE_COUNT; i++) {
+        collector_destroy(&model->sources[i]);
+    }
+    free(model->sources);
+    model->sources = NULL;
+}
+
+/*
+ * Follow station associations over nl80211. Without it, e.g. on a kernel
+ * without wifi, the station lists are polled from iwinfo and hostapd.
+ */
+static void
+start_station_monitor(struct model *model)
+{
+    model->stations = calloc(1, sizeof(*model->stations));
+    if (!model->stations) {
+        return;
+    }
+    if (SR_ERR_OK != station_monitor_start(model->stations, model->settings.station_replay,
+                                           model->settings.station_dump_interval)) {
+        fprintf(stderr, "Station monitor unavailable, polling stations.\n");
+        free(model->stations);
+        model->stations = NULL;
+        return;
+    }
+    if (model->runtime) {
+        wifi_runtime_set_monitor(model->runtime, model->stations);
+    }
+}
+
+static void
+stop_station_monitor(struct model *model)
+{
+    if (!model->stations) {
+        return;
+    }
+    if (model->runtime) {
+        wifi_runtime_set_monitor(model->runtime, NULL);
+    }
+    station_monitor_stop(model->stations);
+    free(model->stations);
+    model->stations = NULL;
+}
+
+/**
+ * @brief Set aside the slots of the wifi lists when a wifi-section-limit is set.
+ *
+ * Each list holds up to the limit, a collection reads as many sections again
+ * before the old ones are released.
+ */
+static int
+start_wifi_budget(struct model *model)
+{
+    size_t slot = sizeof(struct wifi_iface) > sizeof(struct wifi_device) ?
+                  sizeof(struct wifi_iface) : sizeof(struct wifi_device);
+    int rc;
+
+    if (!model->settings.wifi_section_limit) {
+        return SR_ERR_OK;
+    }
+    model->wifi_pool = calloc(1, sizeof(*model->wifi_pool));
+    if (!model->wifi_pool) {
+        return SR_ERR_NOMEM;
+    }
+    rc = pool_init(model->wifi_pool, slot + WIFI_SLOT_STRINGS,
+                   4 * (size_t) model->settings.wifi_section_limit);
+    if (SR_ERR_OK != rc) {
+        free(model->wifi_pool);
+        model->wifi_pool = NULL;
+        return rc;
+    }
+    model->wifi_limit = model->settings.wifi_section_limit;
+    entry_pools[MODEL_WIFI_IFACE] = model->wifi_pool;
+    entry_pools[MODEL_WIFI_DEVICE] = model->wifi_pool;
+
+    return SR_ERR_OK;
+}
+
+/* Release the slots, after the lists taken from them were freed. */
+static void
+stop_memory_budget(struct model *model)
+{
+    memset(entry_pools, 0, sizeof(entry_pools));
+    if (model->lease_pool) {
+        pool_destroy(model->lease_pool);
+        free(model->lease_pool);
+        model->lease_pool = NULL;
+    }
+    if (model->wifi_pool) {
+        pool_destroy(model->wifi_pool);
+        free(model->wifi_pool);
+        model->wifi_pool = NULL;
+    }
+}
+
+/**
+ * @brief Initialize necessary information describing the model.
+ *
+ * @param[out] ctx Model to fill.
+ */
+static void
+init_data(struct model *ctx)
+{
     ctx->uci_ctx = uci_alloc_context();
     if (!ctx->uci_ctx) {
         fprintf(stderr, "Cant allocate uci\n");
-        goto out;
+        return;
     }
 
-    ctx->ubus_ctx = ubus_connect(NULL);
-    if (ctx->ubus_ctx == NULL) {
-        fprintf(stderr, "Cant allocate ubus\n");
-        goto out;
-    }
+    collector_refresh(&ctx->sources[SOURCE_BOARD], true);
+    collector_refresh(&ctx->sources[SOURCE_WIFI], true);
+}
+
+/**
+ * @brief Read plugin settings, leaves missing in the data-store keep their value.
+ */
+static void
+load_settings(sr_session_ctx_t *session, struct settings *settings)
+{
+    const struct model_node *node = &model_nodes[MODEL_SETTINGS];
+    const struct model_leaf *leaf;
+    sr_val_t *val = NULL;
+    size_t i;
+
+    for (i = 0; i < node->n_leaves; i++) {
+        leaf = &node->leaves[i];
+        if (SR_ERR_OK != sr_get_item(session, leaf->xpath, &val)) {
+            continue;
+        }
 
-    parse_board(ctx->ubus_ctx, board);
-    status_wifi(ctx->uci_ctx, ctx->wifi_ifs, ctx->wifi_devs);
+        if (val->type == leaf->type) {
+            switch (leaf->type) {
+            case SR_UINT32_T:
+                *(uint32_t *) ((char *) settings + leaf->offset) = val->data.uint32_val;
+                break;
+            case SR_BOOL_T:
+                *(bool *) ((char *) settings + leaf->offset) = val->data.bool_val;
+                break;
+            case SR_STRING_T:
+                free(MODEL_LEAF_STR(settings, leaf));
+                MODEL_LEAF_STR(settings, leaf) = strdup(val->data.string_val);
+                break;
+            default:
+                break;
+            }
+        }
+        sr_free_val(val);
+        val = NULL;
+    }
+}
 
-    fd_lease = fopen(lease_file_path, "r");
-    if (fd_lease == NULL) {
+/**
+ * @brief Tell whether a change is part of the plugin's commit in flight.
+ *
+ * Sysrepo does not name the session behind a commit to the change callbacks.
+ * The plugin's commit is recognized by its contents instead: a set value must
+ * be in the batch being committed with the same value, a deleted node must be
+ * missing from it. Containers match the values below them.
+ */
+static bool
+own_change(struct model *model, const sr_val_t *old_value, const sr_val_t *new_value)
+{
+    const sr_val_t *val = new_value ? new_value : old_value;
+    struct value_batch *batch;
+    sr_val_t *found;
+    size_t len, lo, hi, mid;
+    bool own = false, below;
+
+    pthread_mutex_lock(&model->lock);
+    batch = model->committing;
+    if (!batch) {
         goto out;
     }
-    parse_leases_file(fd_lease, ctx->leases);
 
-    ctx->board = board;
-    struct wifi_iface *if_it;
-    list_for_each_entry(if_it, ctx->wifi_ifs, head) {
-        print_wifi_iface(if_it);
+    found = bsearch(val, batch->values, batch->cnt, sizeof(*batch->values), value_cmp);
+    if (val->type == SR_CONTAINER_T || val->type == SR_CONTAINER_PRESENCE_T) {
+        /* First value sorting after the container, its descendants follow it. */
+        len = strlen(val->xpath);
+        lo = 0;
+        hi = batch->cnt;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (strcmp(batch->values[mid].xpath, val->xpath) <= 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        below = lo < batch->cnt && !strncmp(batch->values[lo].xpath, val->xpath, len) &&
+                batch->values[lo].xpath[len] == '/';
+        own = new_value ? below : !below;
+    } else if (new_value) {
+        own = found && value_equal(found, new_value);
+    } else {
+        own = !found;
     }
 
   out:
-    if (fd_lease) {
-        fclose(fd_lease);
-    }
+    pthread_mutex_unlock(&model->lock);
+
+    return own;
 }
 
 /**
- * @brief Client-defined validation check triggered on Sysrepo module change.
+ * @brief Client-defined validation check triggered on Sysrepo subtree change.
+ *
+ * Every change is classified by the compiled trie. Read-only data may only be
+ * written by the plugin's own publish and nodes unknown to the model are refused.
  *
  * @param[in] session
  * @param[in] change_path xpath for change events.
+ * @param[in] model
+ * @param[out] own Set when all changes belong to the plugin's own commit.
  *
  * @return[out] SR_ERR_OK on success otherwise some Sysepo error code.
  */
 static int
-validate_changes(sr_session_ctx_t *session, char *change_path)
+validate_changes(sr_session_ctx_t *session, const char *change_path, struct model *model,
+                 bool *own)
 {
     int rc = SR_ERR_OK;
     sr_val_t *old_value = NULL;
     sr_val_t *new_value = NULL;
     sr_change_oper_t oper;
     sr_change_iter_t *it = NULL;
+    struct change_info info;
+    sr_val_t *val;
+    bool mine;
 
+#ifdef DEBUG
     fprintf(stderr, "=============== validating changes ================" "\n");
+#endif
 
+    *own = true;
+    trace_begin("verify", "validate_changes");
     rc = sr_get_changes_iter(session, change_path , &it);
     if (SR_ERR_OK != rc) {
         fprintf(stderr, "Get changes iter failed for xpath %s", change_path);
@@ -618,284 +1485,1065 @@ validate_changes(sr_session_ctx_t *session, char *change_path)
     }
 
     while (SR_ERR_OK == sr_get_change_next(session, it, &oper, &old_value, &new_value)) {
+        val = new_value ? new_value : old_value;
+        classify_change(&classifier, val->xpath, &info);
+        mine = own_change(model, old_value, new_value);
+        *own = *own && mine;
+
+        if (mine) {
+            /* Published by the plugin, read-only data included. */
+        } else if (info.cls == CHANGE_READ_ONLY) {
+            fprintf(stderr, "Can not change read-only data %s.\n", val->xpath);
+            rc = SR_ERR_VALIDATION_FAILED;
+        } else if (info.cls == CHANGE_UNKNOWN) {
+            fprintf(stderr, "Unexpected change %s.\n", val->xpath);
+            rc = SR_ERR_VALIDATION_FAILED;
+        }
+
+        sr_free_val(old_value);
+        sr_free_val(new_value);
+        old_value = NULL;
+        new_value = NULL;
+        if (SR_ERR_OK != rc) {
+            break;
+        }
+    }
 
-        if (strstr(new_value->xpath, "board") || strstr(new_value->xpath, "dhcp_leases")) {
-            fprintf(stderr, "Can not change board information.\n");
+  cleanup:
+    sr_free_change_iter(it);
+    trace_end("verify", "validate_changes");
 
-            rc = SR_ERR_VALIDATION_FAILED;
+    return rc;
+}
+
+/**
+ * @brief Collect the changes of a commit into an apply set.
+ *
+ * @param[out] settings_changed Set when plugin settings were changed.
+ */
+static int
+collect_changes(sr_session_ctx_t *session, const char *change_path, struct apply_set *set,
+                bool *settings_changed)
+{
+    struct change_info info;
+    sr_val_t *old_value = NULL;
+    sr_val_t *new_value = NULL;
+    sr_change_oper_t oper;
+    sr_change_iter_t *it = NULL;
+    sr_val_t *val;
+    char *key = NULL;
+    int rc = SR_ERR_OK;
+
+    rc = sr_get_changes_iter(session, change_path, &it);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Get changes iter failed for xpath %s", change_path);
+        return rc;
+    }
+
+    while (SR_ERR_OK == sr_get_change_next(session, it, &oper, &old_value, &new_value)) {
+        val = new_value ? new_value : old_value;
+        classify_change(&classifier, val->xpath, &info);
+
+        if (info.cls == CHANGE_SETTINGS) {
+            *settings_changed = true;
+        } else if ((info.cls == CHANGE_WIFI_DEVICE || info.cls == CHANGE_WIFI_IFACE) &&
+                   info.key && oper != SR_OP_MOVED) {
+            key = strndup(info.key, info.key_len);
+            rc = key ? SR_ERR_OK : SR_ERR_NOMEM;
+            if (SR_ERR_OK == rc) {
+                rc = apply_set_add(set, info.node, key, info.leaf, oper,
+                                   val->type == SR_STRING_T ? val->data.string_val : NULL);
+            }
+            free(key);
+            key = NULL;
+        }
+
+        sr_free_val(old_value);
+        sr_free_val(new_value);
+        old_value = NULL;
+        new_value = NULL;
+        if (SR_ERR_OK != rc) {
+            break;
+        }
+    }
+
+    sr_free_change_iter(it);
+
+    return rc;
+}
+
+/* A verified commit to a writable list, waiting for its apply or abort. */
+struct verified_commit {
+    struct list_head head;
+    sr_session_ctx_t *session;      /* sysrepo's session of the commit, shared by its events */
+    struct apply_set *set;
+    bool own;                       /* the plugin's publish, not written back to UCI */
+    bool reserved;                  /* holds a slot of the apply queue */
+};
+
+static void
+verified_free(struct model *model, struct verified_commit *commit)
+{
+    if (commit->reserved) {
+        apply_queue_release(model->apply);
+    }
+    apply_set_free(commit->set);
+    free(commit);
+}
+
+/**
+ * @brief Remember a verified commit to a writable list until it is applied.
+ *
+ * The commit is known to be the plugin's own while it is verified. Other
+ * commits reserve a slot of the apply queue, unless they bring nothing to
+ * apply. Sysrepo delivers apply and abort on the session of the verify, with
+ * the same changes, which find the record again.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_OPERATION_FAILED when the queue is full.
+ */
+static int
+verify_commit(sr_session_ctx_t *session, const char *change_path, struct model *model,
+              bool own)
+{
+    struct verified_commit *commit, *oldest;
+    bool settings_changed = false;
+    int rc;
+
+    commit = calloc(1, sizeof(*commit));
+    if (!commit) {
+        return SR_ERR_NOMEM;
+    }
+    commit->session = session;
+    commit->own = own;
+    commit->set = apply_set_new();
+    if (!commit->set) {
+        free(commit);
+        return SR_ERR_NOMEM;
+    }
+    rc = collect_changes(session, change_path, commit->set, &settings_changed);
+    if (SR_ERR_OK != rc || list_empty(&commit->set->changes)) {
+        verified_free(model, commit);
+        return rc;
+    }
+
+    if (!own) {
+        rc = apply_queue_reserve(model->apply);
+        if (SR_ERR_OK != rc) {
+            fprintf(stderr, "Apply queue is full, refusing changes.\n");
+            verified_free(model, commit);
+            return rc;
+        }
+        commit->reserved = true;
+    }
+
+    pthread_mutex_lock(&model->lock);
+    list_add_tail(&commit->head, &model->verified);
+    if (++model->n_verified > 2 * APPLY_QUEUE_LEN) {
+        /* Neither applied nor aborted, its slot is given back. */
+        oldest = list_entry(model->verified.next, struct verified_commit, head);
+        list_del(&oldest->head);
+        model->n_verified--;
+        verified_free(model, oldest);
+    }
+    pthread_mutex_unlock(&model->lock);
+
+    return SR_ERR_OK;
+}
+
+/*
+ * Take the verified commit of session with the changes of set, NULL if there is
+ * none. Identical commits of other sessions keep their records.
+ */
+static struct verified_commit *
+take_verified(struct model *model, sr_session_ctx_t *session, const struct apply_set *set)
+{
+    struct verified_commit *commit, *found = NULL;
+
+    pthread_mutex_lock(&model->lock);
+    list_for_each_entry(commit, &model->verified, head) {
+        if (commit->session == session && apply_set_equal(commit->set, set)) {
+            list_del(&commit->head);
+            model->n_verified--;
+            found = commit;
             break;
         }
+    }
+    pthread_mutex_unlock(&model->lock);
+
+    return found;
+}
+
+/* An aborted commit gives back the slot it reserved. */
+static void
+abort_commit(sr_session_ctx_t *session, const char *change_path, struct model *model)
+{
+    struct verified_commit *commit;
+    struct apply_set *set;
+    bool settings_changed = false;
+
+    set = apply_set_new();
+    if (!set) {
+        return;
+    }
+    if (SR_ERR_OK == collect_changes(session, change_path, set, &settings_changed) &&
+        !list_empty(&set->changes)) {
+        commit = take_verified(model, session, set);
+        if (commit) {
+            verified_free(model, commit);
+        }
+    }
+    apply_set_free(set);
+}
+
+static void
+free_verified(struct model *model)
+{
+    struct verified_commit *commit, *tmp;
+
+    list_for_each_entry_safe(commit, tmp, &model->verified, head) {
+        list_del(&commit->head);
+        commit->reserved = false;
+        verified_free(model, commit);
+    }
+    model->n_verified = 0;
+}
+
+/**
+ * @brief Hand the changes of a commit over to the apply worker.
+ *
+ * Only commits to the writable lists are queued, in the slot reserved when
+ * they were verified. The plugin's own commits are not queued.
+ */
+static int
+queue_changes(sr_session_ctx_t *session, const char *change_path, struct model *model,
+              bool writable)
+{
+    struct verified_commit *commit;
+    struct apply_set *set;
+    bool settings_changed = false;
+    int rc;
+
+    set = apply_set_new();
+    if (!set) {
+        return SR_ERR_NOMEM;
+    }
+
+    rc = collect_changes(session, change_path, set, &settings_changed);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Can't collect changes: %s\n", sr_strerror(rc));
+        apply_set_free(set);
+        return rc;
+    }
+
+    if (settings_changed) {
+        load_settings(session, &model->settings);
+        apply_queue_set_window(model->apply, model->settings.apply_quiet_window);
+        if (model->stations) {
+            station_monitor_set_interval(model->stations, model->settings.station_dump_interval);
+        }
+        collector_set_ttl(&model->sources[SOURCE_HEALTH], model->settings.health_interval);
+    }
+
+    if (!writable || list_empty(&set->changes)) {
+        apply_set_free(set);
+        return SR_ERR_OK;
+    }
+
+    commit = take_verified(model, session, set);
+    if (commit && commit->own) {
+        /* Published by the plugin itself, UCI already holds it. */
+        verified_free(model, commit);
+        apply_set_free(set);
+        return SR_ERR_OK;
+    }
+    if (commit) {
+        /* The push takes over the slot reserved at verification. */
+        commit->reserved = false;
+        verified_free(model, commit);
+    } else if (SR_ERR_OK != apply_queue_reserve(model->apply)) {
+        fprintf(stderr, "Apply queue is full, changes of an unverified commit are lost.\n");
+        apply_set_free(set);
+        return SR_ERR_OPERATION_FAILED;
+    }
+    apply_queue_push(model->apply, set);
+
+    return SR_ERR_OK;
+}
+
+/**
+ * @brief Write one change to the wireless package.
+ *
+ * Entries map to named sections of the list's type, leaves to options of the same
+ * name and leaf-list items to UCI list values.
+ *
+ * @return UCI error code, UCI_OK on success.
+ */
+static int
+change_to_uci(struct uci_context *ctx, struct apply_change *change)
+{
+    struct uci_ptr ptr = {0,};
+    int rc;
+
+    ptr.package = config_file;
+    ptr.section = change->key;
+    ptr.option = change->leaf ? change->leaf->name : NULL;
+
+    rc = uci_lookup_ptr(ctx, &ptr, NULL, false);
+    if (UCI_OK != rc) {
+        fprintf(stderr, "Nothing found on UCI path %s.%s.\n", config_file, change->key);
+        return rc;
+    }
+
+    if (change->oper == SR_OP_DELETED) {
+        if (!(ptr.flags & UCI_LOOKUP_COMPLETE)) {
+            /* Removed together with its section. */
+            return UCI_OK;
+        }
+        if (change->leaf && (change->leaf->flags & MODEL_LEAF_LIST) && change->value) {
+            ptr.value = change->value;
+            return uci_del_list(ctx, &ptr);
+        }
+        return uci_delete(ctx, &ptr);
+    }
+
+    if (!change->leaf) {
+        ptr.value = model_nodes[change->node].name;
+        return uci_set(ctx, &ptr);
+    }
+    if (!change->value) {
+        return UCI_OK;
+    }
+
+    ptr.value = change->value;
+    if (change->leaf->flags & MODEL_LEAF_LIST) {
+        return uci_add_list(ctx, &ptr);
+    }
+    rc = uci_set(ctx, &ptr);
+    if (UCI_OK != rc) {
+        fprintf(stderr, "Could not set UCI value [%s] for option [%s].\n", change->value, ptr.option);
+    }
+
+    return rc;
+}
 
-        sr_free_val(old_value);
-        sr_free_val(new_value);
+/* Sysrepo error code reported for a failed UCI call. */
+static int
+uci_to_sr_err(int rc)
+{
+    switch (rc) {
+    case UCI_OK:
+        return SR_ERR_OK;
+    case UCI_ERR_MEM:
+        return SR_ERR_NOMEM;
+    case UCI_ERR_INVAL:
+        return SR_ERR_INVAL_ARG;
+    case UCI_ERR_NOTFOUND:
+        return SR_ERR_NOT_FOUND;
+    case UCI_ERR_IO:
+        return SR_ERR_IO;
+    default:
+        return SR_ERR_OPERATION_FAILED;
     }
+}
 
-  cleanup:
-    sr_free_change_iter(it);
-    sr_free_val(old_value);
-    sr_free_val(new_value);
+/**
+ * @brief Take the committed configuration as the published state.
+ *
+ * Applied changes came from the data-store, which already holds them. The model
+ * collected after the commit becomes the batch the next publish is compared to.
+ */
+static void
+refresh_published(struct model *model)
+{
+    struct value_batch batch = {0,};
+    int rc;
 
-    return rc;
+    pthread_mutex_lock(&model->publish_lock);
+    pthread_mutex_lock(&model->lock);
+    rc = build_batch(model, &batch);
+    pthread_mutex_unlock(&model->lock);
+    if (SR_ERR_OK == rc) {
+        batch_free(&model->published);
+        model->published = batch;
+    } else {
+        fprintf(stderr, "Error building values: %s\n", sr_strerror(rc));
+        batch_free(&batch);
+    }
+    pthread_mutex_unlock(&model->publish_lock);
 }
 
 /**
- * @brief Submit UCI option.
+ * @brief Commit queued changes to UCI configuration files.
  *
- * @param[in] ctx Context used for looking up and setting UCI objects.
- * @param[in] str_opt Options key.
- * @param[in] str_val Options value.
- * @param[fmt] fmt Format for path identifier used in UCI.
+ * All change sets collected during the quiet window are written in order, so the
+ * last write to an option wins, then committed once and followed by one reload.
+ * A change UCI refuses fails the whole apply, nothing is committed then.
  *
- * @return UCI error code, UCI_OK on success. UCI_ERR_INVAL on empty str_val parameter.
+ * @param[in] sets Change sets to apply, failed ones get their rc set.
+ * @param[in] priv Model, refreshed from the committed configuration.
+ * @return SR_ERR_OK on success, otherwise some Sysrepo error code.
  */
 static int
-submit_to_uci(struct uci_context *ctx, char *str_opt, char *str_val, char *fmt)
+commit_to_uci(struct list_head *sets, void *priv)
 {
+    struct model *model = priv;
+    struct apply_set *set;
+    struct apply_change *change;
+    struct uci_package *up = NULL;
+    struct uci_context *ctx;
     int rc = UCI_OK;
-    struct uci_ptr up;
-    char ucipath[UCIPATH_MAX_LEN];
 
-    if (!str_val) {
-        return UCI_ERR_INVAL;
+    trace_begin("apply", "commit_to_uci");
+    ctx = uci_alloc_context();
+    if (!ctx) {
+        fprintf(stderr, "Cant allocate uci\n");
+        rc = SR_ERR_NOMEM;
+        goto out;
+    }
+
+    rc = uci_load(ctx, config_file, &up);
+    if (rc != UCI_OK) {
+        fprintf(stderr, "No configuration (package): %s\n", config_file);
+        uci_free_context(ctx);
+        rc = uci_to_sr_err(rc);
+        goto out;
+    }
+
+    list_for_each_entry(set, sets, head) {
+        list_for_each_entry(change, &set->changes, head) {
+            rc = change_to_uci(ctx, change);
+            if (UCI_OK != rc) {
+                fprintf(stderr, "apply #%lu: UCI error %d for %s\n", set->id, rc, change->key);
+                set->rc = uci_to_sr_err(rc);
+                /* Unsaved changes go with the context. */
+                uci_free_context(ctx);
+                rc = SR_ERR_OPERATION_FAILED;
+                goto out;
+            }
+        }
     }
 
-    sprintf(ucipath, fmt, str_opt, str_val);
+    rc = uci_commit(ctx, &up, false);
+    uci_free_context(ctx);
+    if (UCI_OK != rc) {
+        fprintf(stderr, "uci_commit error %d\n", rc);
+        rc = uci_to_sr_err(rc);
+        goto out;
+    }
 
-    if ((rc = uci_lookup_ptr(ctx, &up, ucipath, true)) != UCI_OK) {
-        fprintf(stderr, "Nothing found on UCI path.\n");
-        goto exit;
+    /* Keep the model in sync with the committed configuration. */
+    retry_board(model);
+    if (SR_ERR_OK == collector_refresh(&model->sources[SOURCE_WIFI], true)) {
+        refresh_published(model);
     }
 
-    if ((rc = uci_set(ctx, &up)) != UCI_OK) {
-        fprintf(stderr, "Could not set UCI value [%s] for path [%s].\n", str_val, ucipath);
-        goto exit;
+    /* Restart network service, once for all merged change sets. */
+    trace_begin("apply", "reload");
+    rc = system(RELOAD_CMD);
+    trace_end("apply", "reload");
+    if (rc == -1 || !WIFEXITED(rc) || WEXITSTATUS(rc)) {
+        fprintf(stderr, "Can't restart 'network service' %d\n", rc);
+        rc = SR_ERR_OPERATION_FAILED;
+    } else {
+        rc = SR_ERR_OK;
     }
 
-  exit:
+  out:
+    trace_end("apply", "commit_to_uci");
     return rc;
 }
 
+/*
+ * Function is called by engine two times for each subscribed subtree, first time to
+ * validate the changes, and second time to apply validated. Only commits of other
+ * clients to the wifi lists take a slot of the apply queue.
+ */
 static int
-wifi_devs_to_uci(struct uci_context *ctx, struct list_head *devs)
+subtree_change_cb(sr_session_ctx_t *session, const char *xpath,
+                  sr_notif_event_t event, void *private_ctx)
 {
-    int rc = UCI_OK;
-    const char *fmt = "wireless.@wifi-device[%d].%s=%s";
-    char fmt_named[UCIPATH_MAX_LEN];
-    int n_ifs = 0;
-
-    struct wifi_device *d;
-    list_for_each_entry(d, devs, head) {
+    struct model *model = private_ctx;
+    struct change_info info;
+    bool writable, own;
+    int rc;
 
-        sprintf(fmt_named, fmt, n_ifs, "%s", "%s");
+    fprintf(stderr, "=============== subtree has changed ================" "%d:%s\n", event, xpath);
+    classify_change(&classifier, xpath, &info);
+    writable = info.cls == CHANGE_WIFI_DEVICE || info.cls == CHANGE_WIFI_IFACE;
 
-        rc = submit_to_uci(ctx, "name", d->name, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
+    switch (event) {
+    case SR_EV_VERIFY:
+        rc = validate_changes(session, xpath, model, &own);
+        if (SR_ERR_OK == rc && writable) {
+            rc = verify_commit(session, xpath, model, own);
         }
-
-        rc = submit_to_uci(ctx, "type", d->type, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
+        return rc;
+    case SR_EV_APPLY:
+        return queue_changes(session, xpath, model, writable);
+    default:
+        printf("Changes aborted with event %d\n", event);
+        if (writable) {
+            abort_commit(session, xpath, model);
         }
+        return SR_ERR_OK;
+    }
+}
 
-        rc = submit_to_uci(ctx, "channel", d->channel, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+/* Completion time of a change set in RFC 3339. */
+static void
+format_time(char *buf, size_t len, time_t t)
+{
+    struct tm tm;
 
-        rc = submit_to_uci(ctx, "macaddr", d->macaddr, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+    gmtime_r(&t, &tm);
+    strftime(buf, len, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
 
-        rc = submit_to_uci(ctx, "hwmode", d->hwmode, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+/**
+ * @brief Build the apply-status container or its result list from a status snapshot.
+ */
+static int
+build_apply_status(const char *xpath, void *arg, sr_val_t **values, size_t *values_cnt)
+{
+    struct apply_status *status = arg;
+    struct apply_result *result;
+    struct xpath_buf xb = {0,};
+    static const char *result_leaves[] = { "id", "status", "error-code", "merged", "completed" };
+    char completed[32];
+    sr_val_t *v = NULL;
+    size_t i, j, n = 0, prefix = 0;
+    int rc = SR_ERR_OK;
 
-        rc = submit_to_uci(ctx, "disabled", d->disabled, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
+    if (!strcmp(xpath, APPLY_STATUS_XPATH)) {
+        rc = sr_new_values(4, &v);
+        if (SR_ERR_OK != rc) {
+            return rc;
+        }
+        sr_val_set_xpath(&v[0], APPLY_STATUS_XPATH "/pending");
+        v[0].type = SR_UINT32_T;
+        v[0].data.uint32_val = status->pending;
+        sr_val_set_xpath(&v[1], APPLY_STATUS_XPATH "/applying");
+        v[1].type = SR_BOOL_T;
+        v[1].data.bool_val = status->applying;
+        sr_val_set_xpath(&v[2], APPLY_STATUS_XPATH "/applied");
+        v[2].type = SR_UINT64_T;
+        v[2].data.uint64_val = status->applied;
+        sr_val_set_xpath(&v[3], APPLY_STATUS_XPATH "/failed");
+        v[3].type = SR_UINT64_T;
+        v[3].data.uint64_val = status->failed;
+        n = 4;
+    } else if (!strcmp(xpath, APPLY_STATUS_XPATH "/result") && status->n_results) {
+        rc = sr_new_values(status->n_results * 5, &v);
+        if (SR_ERR_OK != rc) {
+            return rc;
+        }
+        for (i = 0; i < status->n_results && SR_ERR_OK == rc; i++) {
+            result = &status->results[i];
+            xpath_buf_truncate(&xb, 0);
+            rc = xpath_buf_append(&xb, "%s/result[id='%lu']", APPLY_STATUS_XPATH, result->id);
+            prefix = xb.len;
+
+            for (j = 0; j < sizeof(result_leaves) / sizeof(result_leaves[0]) && SR_ERR_OK == rc; j++) {
+                rc = xpath_set_leaf(&v[n], &xb, prefix, result_leaves[j]);
+                if (SR_ERR_OK != rc) {
+                    break;
+                }
+                switch (j) {
+                case 0:
+                    v[n].type = SR_UINT64_T;
+                    v[n].data.uint64_val = result->id;
+                    break;
+                case 1:
+                    rc = sr_val_set_str_data(&v[n], SR_ENUM_T, result->rc ? "failed" : "applied");
+                    break;
+                case 2:
+                    v[n].type = SR_INT32_T;
+                    v[n].data.int32_val = result->rc;
+                    break;
+                case 3:
+                    v[n].type = SR_UINT32_T;
+                    v[n].data.uint32_val = result->merged;
+                    break;
+                default:
+                    format_time(completed, sizeof(completed), result->completed);
+                    rc = sr_val_set_str_data(&v[n], SR_STRING_T, completed);
+                    break;
+                }
+                n++;
+            }
+        }
+        xpath_buf_free(&xb);
+        if (SR_ERR_OK != rc) {
+            sr_free_values(v, status->n_results * 5);
+            return rc;
         }
     }
 
-  exit:
-    return rc;
+    *values = v;
+    *values_cnt = n;
+
+    return SR_ERR_OK;
 }
 
+/**
+ * @brief Provide the operational apply-status container and its result list.
+ *
+ * Answers are cached until the apply queue reports a new generation.
+ */
 static int
-wifi_ifs_to_uci(struct uci_context *ctx, struct list_head *ifs)
+apply_status_dp_cb(const char *xpath, sr_val_t **values, size_t *values_cnt,
+                   uint64_t request_id, const char *original_xpath, void *private_ctx)
 {
-    int rc = UCI_OK;
-    const char *fmt = "wireless.@wifi-iface[%d].%s=%s";
-    char fmt_named[UCIPATH_MAX_LEN];
-    int n_ifs = 0;
+    struct model *model = private_ctx;
+    struct apply_status status;
 
-    struct wifi_iface *i;
-    list_for_each_entry(i, ifs, head) {
+    apply_queue_status(model->apply, &status);
 
-        sprintf(fmt_named, fmt, n_ifs, "%s", "%s");
+    return response_cache_get(model->cache, xpath, status.generation, build_apply_status,
+                              &status, values, values_cnt);
+}
 
-        rc = submit_to_uci(ctx, "name", i->name, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+/**
+ * @brief Provide the runtime container and station list of a wifi-iface.
+ *
+ * Answers are cached per xpath until the runtime collector finishes another
+ * collection or the station monitor saw a change.
+ */
+static int
+wifi_runtime_dp_cb(const char *xpath, sr_val_t **values, size_t *values_cnt,
+                   uint64_t request_id, const char *original_xpath, void *private_ctx)
+{
+    struct model *model = private_ctx;
+    struct collector *c = &model->sources[SOURCE_RUNTIME];
+    unsigned long generation;
+    int rc;
 
-        rc = submit_to_uci(ctx, "device", i->device, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+    rc = collector_refresh(c, false);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Wifi runtime error: %s\n", sr_strerror(rc));
+    }
 
-        rc = submit_to_uci(ctx, "network", i->network, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+    /* Both only grow, their sum changes whenever one of them does. */
+    generation = collector_generation(c);
+    if (model->stations) {
+        generation += station_monitor_generation(model->stations);
+    }
 
-        rc = submit_to_uci(ctx, "mode", i->mode, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+    return response_cache_get(model->cache, xpath, generation, wifi_runtime_build,
+                              model->runtime, values, values_cnt);
+}
 
-        rc = submit_to_uci(ctx, "ssid", i->ssid, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+/**
+ * @brief Provide the traffic counters and rates of all interfaces.
+ *
+ * Answers are cached until the sampler took the next sample.
+ */
+static int
+interfaces_dp_cb(const char *xpath, sr_val_t **values, size_t *values_cnt,
+                 uint64_t request_id, const char *original_xpath, void *private_ctx)
+{
+    struct model *model = private_ctx;
 
-        rc = submit_to_uci(ctx, "encryption", i->encryption, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+    if (!model->netstats) {
+        *values = NULL;
+        *values_cnt = 0;
+        return SR_ERR_OK;
+    }
 
-        rc = submit_to_uci(ctx, "maclist", i->maclist, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+    return response_cache_get(model->cache, xpath, netstats_generation(model->netstats),
+                              netstats_build, model->netstats, values, values_cnt);
+}
 
-        rc = submit_to_uci(ctx, "macfilter", i->macfilter, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+/**
+ * @brief Provide the board health container and its cpu list.
+ *
+ * A sample younger than the health interval is reused, concurrent requests
+ * share one sample.
+ */
+static int
+health_dp_cb(const char *xpath, sr_val_t **values, size_t *values_cnt,
+             uint64_t request_id, const char *original_xpath, void *private_ctx)
+{
+    struct model *model = private_ctx;
+    struct collector *c = &model->sources[SOURCE_HEALTH];
+    int rc;
 
-        rc = submit_to_uci(ctx, "key", i->key, fmt_named);
-        if (UCI_OK != rc) {
-            goto exit;
-        }
+    if (!model->health) {
+        *values = NULL;
+        *values_cnt = 0;
+        return SR_ERR_OK;
+    }
+    rc = collector_refresh(c, false);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Board health error: %s\n", sr_strerror(rc));
     }
 
-  exit:
-    return rc;
+    return response_cache_get(model->cache, xpath, collector_generation(c), health_build,
+                              model->health, values, values_cnt);
 }
 
 /**
- * @brief Commit run-time data to UCI configuration files.
+ * @brief Provide the memory container, counters of the budgeted model lists.
  *
- * @param[in] model Model with current run-time data
- * @return UCI error code. UCI_OK on success.
+ * The leaves are read directly, there is nothing worth caching.
  */
 static int
-commit_to_uci(struct model *model)
+memory_dp_cb(const char *xpath, sr_val_t **values, size_t *values_cnt,
+             uint64_t request_id, const char *original_xpath, void *private_ctx)
 {
-    int rc = UCI_OK;
-
-    struct uci_package *up = NULL;
-    struct uci_context *ctx = uci_alloc_context();
+    static const char *const leaves[] = {
+        MEMORY_XPATH "/leases",
+        MEMORY_XPATH "/leases-evicted",
+        MEMORY_XPATH "/leases-dropped",
+        MEMORY_XPATH "/wifi-sections-dropped",
+        MEMORY_XPATH "/reserved",
+    };
+    struct model *model = private_ctx;
+    struct list_head *pos;
+    uint64_t reserved = 0, evicted = 0, dropped = 0;
+    uint32_t n_leases = 0;
+    sr_val_t *v = NULL;
+    size_t i;
+    int rc;
 
-    rc = uci_load(ctx, "asterisk", &up);
-    if (rc != UCI_OK) {
-        fprintf(stderr, "No configuration (package): %s\n", "asterisk");
-        return rc;
+    if (strcmp(xpath, MEMORY_XPATH)) {
+        *values = NULL;
+        *values_cnt = 0;
+        return SR_ERR_OK;
     }
 
-    rc = wifi_ifs_to_uci(ctx, model->wifi_ifs);
-    if (UCI_OK != rc) {
-        fprintf(stderr, "wifi_ifs_to_uci error %d\n", rc);
+    pthread_mutex_lock(&model->lock);
+    list_for_each(pos, model->leases) {
+        n_leases++;
     }
-
-    rc = wifi_devs_to_uci(ctx, model->wifi_devs);
-    if (UCI_OK != rc) {
-        fprintf(stderr, "wifi_devs_to_uci error %d\n", rc);
+    pthread_mutex_unlock(&model->lock);
+    if (model->collector) {
+        evicted = atomic_load(&model->collector->evicted);
+        dropped = atomic_load(&model->collector->dropped);
     }
-
-    rc = uci_commit(ctx, &up, false);
-    if (UCI_OK != rc) {
-        fprintf(stderr, "trunk_to_uci error %d\n", rc);
+    if (model->lease_pool) {
+        reserved += model->lease_pool->n_slots * model->lease_pool->slot_size;
+    }
+    if (model->wifi_pool) {
+        reserved += model->wifi_pool->n_slots * model->wifi_pool->slot_size;
     }
 
-    /* Restart network service. */
-    rc = system("/etc/init.d/network restart");
-    if (0 > rc) {
-      fprintf(stderr, "Can't restart 'network service' %d\n", rc);
+    rc = sr_new_values(5, &v);
+    if (SR_ERR_OK != rc) {
+        return rc;
+    }
+    for (i = 0; i < 5; i++) {
+        rc = sr_val_set_xpath(&v[i], leaves[i]);
+        if (SR_ERR_OK != rc) {
+            sr_free_values(v, 5);
+            return rc;
+        }
     }
+    v[0].type = SR_UINT32_T;
+    v[0].data.uint32_val = n_leases;
+    v[1].type = SR_UINT64_T;
+    v[1].data.uint64_val = evicted;
+    v[2].type = SR_UINT64_T;
+    v[2].data.uint64_val = dropped;
+    v[3].type = SR_UINT64_T;
+    v[3].data.uint64_val = atomic_load(&model->wifi_dropped);
+    v[4].type = SR_UINT64_T;
+    v[4].data.uint64_val = reserved;
+
+    *values = v;
+    *values_cnt = 5;
 
-    return rc;
+    return SR_ERR_OK;
 }
 
-/*
- * Function is called by engine two times, first time to validate the changes, and second time
- * to apply validated.
+/**
+ * @brief Write the spans recorded since the plugin start as Chrome trace JSON.
  */
 static int
-module_change_cb(sr_session_ctx_t *session, const char *module_name,
-                 sr_notif_event_t event, void *private_ctx)
+dump_trace_rpc_cb(const char *xpath, const sr_val_t *input, const size_t input_cnt,
+                  sr_val_t **output, size_t *output_cnt, void *private_ctx)
 {
-    char change_path[XPATH_MAX_LEN] = {0,};
+    const char *file = DEFAULT_TRACE_FILE;
+    uint32_t n_events = 0;
+    size_t i;
+    int rc;
 
-    fprintf(stderr, "=============== module has changed ================" "%d:%s\n", event, module_name);
-    snprintf(change_path, XPATH_MAX_LEN, "/%s:*", module_name);
+    for (i = 0; i < input_cnt; i++) {
+        if (input[i].type == SR_STRING_T && !strcmp(input[i].xpath, DUMP_TRACE_XPATH "/file")) {
+            file = input[i].data.string_val;
+        }
+    }
 
-    switch (event) {
-    case SR_EV_VERIFY:
-        return validate_changes(session, change_path);
-    case SR_EV_APPLY:
-        return commit_to_uci((struct model *) private_ctx);
-    default:
-        printf("Changes aborted with event %d\n", event);
-        return SR_ERR_OK;
+    rc = trace_dump(file, &n_events);
+    if (SR_ERR_OK != rc) {
+        return rc;
+    }
+
+    rc = sr_new_values(1, output);
+    if (SR_ERR_OK != rc) {
+        return rc;
+    }
+    rc = sr_val_set_xpath(&(*output)[0], DUMP_TRACE_XPATH "/events");
+    if (SR_ERR_OK != rc) {
+        sr_free_values(*output, 1);
+        *output = NULL;
+        return rc;
     }
+    (*output)[0].type = SR_UINT32_T;
+    (*output)[0].data.uint32_val = n_events;
+    *output_cnt = 1;
+
+    return SR_ERR_OK;
 }
 
-/*
- * Initialize plugin with necessary information and store it in the private context usable by
- * engines callbacks.
- * Subscribe module_change callback.
- */
-int
-sr_plugin_init_cb(sr_session_ctx_t *session, void **private_ctx)
+/* Set up the model and its subscriptions, see sr_plugin_init_cb(). */
+static int
+init_plugin(sr_session_ctx_t *session, void **private_ctx)
 {
     sr_subscription_ctx_t *subscription = NULL;
+    size_t i;
     int rc = SR_ERR_OK;
 
     struct model *model = calloc(1, sizeof(*model));
+    if (!model) {
+        return SR_ERR_NOMEM;
+    }
     model->leases = &leases;
     model->wifi_ifs = &ifs;
     model->wifi_devs = &devs;
-    model->ubus_ctx = NULL;
     model->uci_ctx = NULL;
+    model->settings.apply_quiet_window = DEFAULT_APPLY_QUIET_WINDOW_MS;
+    model->settings.station_dump_interval = DEFAULT_STATION_DUMP_INTERVAL_S;
+    model->settings.health_interval = DEFAULT_HEALTH_INTERVAL_MS;
+    pthread_mutex_init(&model->lock, NULL);
+    pthread_mutex_init(&model->publish_lock, NULL);
+    INIT_LIST_HEAD(&model->verified);
     fprintf(stderr, "SR PLUGIN INIT CB\n");
 
+    rc = classifier_init(&classifier);
+    if (SR_ERR_OK != rc) {
+        goto error;
+    }
+
+    rc = start_collectors(model);
+    if (SR_ERR_OK != rc) {
+        goto error;
+    }
+
+    model->bus = calloc(1, sizeof(*model->bus));
+    if (!model->bus) {
+        rc = SR_ERR_NOMEM;
+        goto error;
+    }
+    /* Without ubusd yet the first collection connects. */
+    bus_init(model->bus);
+
+    model->runtime = calloc(1, sizeof(*model->runtime));
+    if (!model->runtime) {
+        rc = SR_ERR_NOMEM;
+        goto error;
+    }
+    wifi_runtime_init(model->runtime, model->bus);
+
+    /* Without counters or /proc the interfaces and health subtrees stay empty. */
+    model->netstats = calloc(1, sizeof(*model->netstats));
+    if (model->netstats && SR_ERR_OK != netstats_start(model->netstats)) {
+        fprintf(stderr, "Interface counters disabled.\n");
+        free(model->netstats);
+        model->netstats = NULL;
+    }
+
+    model->health = calloc(1, sizeof(*model->health));
+    if (model->health && SR_ERR_OK != health_init(model->health)) {
+        fprintf(stderr, "Board health disabled.\n");
+        free(model->health);
+        model->health = NULL;
+    }
+
+    model->shm = calloc(1, sizeof(*model->shm));
+    if (model->shm && SR_ERR_OK != shm_writer_open(model->shm, STATUS_SHM_NAME)) {
+        fprintf(stderr, "Shared-memory snapshot disabled.\n");
+        free(model->shm);
+        model->shm = NULL;
+    }
+
+    /* The memory budget is fixed before the first collection. */
+    load_settings(session, &model->settings);
+    rc = start_wifi_budget(model);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Wifi memory budget error.\n");
+        goto error;
+    }
+    trace_begin("plugin", "init_data");
     init_data(model);
-    set_values(session, model->board, model->wifi_devs, model->wifi_ifs, model->leases);
+    trace_end("plugin", "init_data");
+    rc = start_lease_sources(session, model);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Lease sources error.\n");
+        goto error;
+    }
+    set_values(session, model);
+    collector_set_ttl(&model->sources[SOURCE_HEALTH], model->settings.health_interval);
+    start_station_monitor(model);
+
+    model->cache = calloc(1, sizeof(*model->cache));
+    if (!model->cache) {
+        rc = SR_ERR_NOMEM;
+        goto error;
+    }
+    response_cache_init(model->cache);
+
+    model->apply = calloc(1, sizeof(*model->apply));
+    if (!model->apply) {
+        rc = SR_ERR_NOMEM;
+        goto error;
+    }
+    rc = apply_queue_start(model->apply, model->settings.apply_quiet_window, commit_to_uci, model);
+    if (SR_ERR_OK != rc) {
+        goto error;
+    }
 
     *private_ctx = model;
 
-    rc = sr_module_change_subscribe(session, "status", module_change_cb, *private_ctx,
-                                    0, SR_SUBSCR_DEFAULT, &subscription);
+    for (i = 0; i < sizeof(subscribed_subtrees) / sizeof(subscribed_subtrees[0]); i++) {
+        rc = sr_subtree_change_subscribe(session, subscribed_subtrees[i], subtree_change_cb,
+                                         *private_ctx, 0,
+                                         subscription ? SR_SUBSCR_CTX_REUSE : SR_SUBSCR_DEFAULT,
+                                         &subscription);
+        if (SR_ERR_OK != rc) {
+            fprintf(stderr, "Subtree change error for %s.\n", subscribed_subtrees[i]);
+            goto error;
+        }
+    }
+
+    rc = sr_dp_get_items_subscribe(session, APPLY_STATUS_XPATH, apply_status_dp_cb, *private_ctx,
+                                   SR_SUBSCR_CTX_REUSE, &subscription);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Apply status subscription error.\n");
+        goto error;
+    }
+
+    rc = sr_dp_get_items_subscribe(session, WIFI_RUNTIME_XPATH, wifi_runtime_dp_cb, *private_ctx,
+                                   SR_SUBSCR_CTX_REUSE, &subscription);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Wifi runtime subscription error.\n");
+        goto error;
+    }
+
+    rc = sr_dp_get_items_subscribe(session, INTERFACES_XPATH, interfaces_dp_cb, *private_ctx,
+                                   SR_SUBSCR_CTX_REUSE, &subscription);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Interfaces subscription error.\n");
+        goto error;
+    }
+
+    rc = sr_dp_get_items_subscribe(session, HEALTH_XPATH, health_dp_cb, *private_ctx,
+                                   SR_SUBSCR_CTX_REUSE, &subscription);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Board health subscription error.\n");
+        goto error;
+    }
+
+    rc = sr_dp_get_items_subscribe(session, MEMORY_XPATH, memory_dp_cb, *private_ctx,
+                                   SR_SUBSCR_CTX_REUSE, &subscription);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Memory subscription error.\n");
+        goto error;
+    }
+
+    rc = sr_rpc_subscribe(session, DUMP_TRACE_XPATH, dump_trace_rpc_cb, *private_ctx,
+                          SR_SUBSCR_CTX_REUSE, &subscription);
     if (SR_ERR_OK != rc) {
-        fprintf(stderr, "Module change error.\n");
+        fprintf(stderr, "Trace dump subscription error.\n");
         goto error;
     }
 
     model->subscription = subscription;
 
+    rc = start_lease_watch(model);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Lease watcher error.\n");
+        goto error;
+    }
+
+    rc = start_config_watch(model);
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Config watcher error.\n");
+        goto error;
+    }
+
     return SR_ERR_OK;
 
   error:
+    stop_config_watch(model);
+    stop_lease_watch(model);
     if (subscription) {
         sr_unsubscribe(session, subscription);
     }
-    if (model) {
-        free(model);
+    if (model->apply) {
+        apply_queue_stop(model->apply);
+        free(model->apply);
+    }
+    if (model->cache) {
+        response_cache_free(model->cache);
+        free(model->cache);
+    }
+    stop_collectors(model);
+    stop_station_monitor(model);
+    if (model->runtime) {
+        wifi_runtime_free(model->runtime);
+        free(model->runtime);
+    }
+    if (model->netstats) {
+        netstats_stop(model->netstats);
+        free(model->netstats);
+    }
+    if (model->health) {
+        health_free(model->health);
+        free(model->health);
+    }
+    if (model->shm) {
+        shm_writer_close(model->shm);
+        free(model->shm);
+    }
+    if (model->bus) {
+        bus_free(model->bus);
+        free(model->bus);
+    }
+    if (model->uci_ctx) {
+        uci_free_context(model->uci_ctx);
     }
+    model_free_list(MODEL_DHCP_LEASES, model->leases);
+    model_free_list(MODEL_WIFI_IFACE, model->wifi_ifs);
+    model_free_list(MODEL_WIFI_DEVICE, model->wifi_devs);
+    if (model->board) {
+        model_free_entry(MODEL_BOARD, model->board);
+    }
+    stop_memory_budget(model);
+    batch_free(&model->published);
+    free_verified(model);
+    free(model->settings.station_replay);
+    free(model);
+    *private_ctx = NULL;
+    classifier_free(&classifier);
+
+    return rc;
+}
+
+/*
+ * Initialize plugin with necessary information and store it in the private context usable by
+ * engines callbacks.
+ * Subscribe the writable and read-only subtrees separately.
+ */
+int
+sr_plugin_init_cb(sr_session_ctx_t *session, void **private_ctx)
+{
+    int rc;
+
+    trace_init();
+    trace_begin("plugin", "sr_plugin_init_cb");
+    rc = init_plugin(session, private_ctx);
+    trace_end("plugin", "sr_plugin_init_cb");
 
     return rc;
 }
@@ -908,15 +2556,56 @@ sr_plugin_cleanup_cb(sr_session_ctx_t *session, void *private_ctx)
     if (!model) {
         return;
     }
+    stop_config_watch(model);
+    stop_lease_watch(model);
     if (model->subscription) {
         sr_unsubscribe(session, model->subscription);
     }
-    if (model->ubus_ctx) {
-        ubus_free(model->ubus_ctx);
+    if (model->apply) {
+        /* Applies whatever is still queued. */
+        apply_queue_stop(model->apply);
+        free(model->apply);
+    }
+    if (model->cache) {
+        response_cache_free(model->cache);
+        free(model->cache);
+    }
+    stop_collectors(model);
+    stop_station_monitor(model);
+    if (model->runtime) {
+        wifi_runtime_free(model->runtime);
+        free(model->runtime);
+    }
+    if (model->netstats) {
+        netstats_stop(model->netstats);
+        free(model->netstats);
+    }
+    if (model->health) {
+        health_free(model->health);
+        free(model->health);
+    }
+    if (model->shm) {
+        shm_writer_close(model->shm);
+        free(model->shm);
+    }
+    if (model->bus) {
+        bus_free(model->bus);
+        free(model->bus);
     }
     if (model->uci_ctx) {
         uci_free_context(model->uci_ctx);
     }
+    model_free_list(MODEL_DHCP_LEASES, model->leases);
+    model_free_list(MODEL_WIFI_IFACE, model->wifi_ifs);
+    model_free_list(MODEL_WIFI_DEVICE, model->wifi_devs);
+    if (model->board) {
+        model_free_entry(MODEL_BOARD, model->board);
+    }
+    stop_memory_budget(model);
+    batch_free(&model->published);
+    free_verified(model);
+    free(model->settings.station_replay);
+    classifier_free(&classifier);
     free(model);
 }
 
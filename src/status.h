@@ -1,127 +1,82 @@
+#ifndef STATUS_H
+#define STATUS_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "sysrepo.h"
 #include <libubox/list.h>
 
-struct release {
-    char *distribution;
-    char *version;
-    char *revision;
-    char *codename;
-    char *target;
-    char *description;
-};
-
-struct board {
-    char *kernel;
-    char *hostname;
-    char *system;
-    struct release *release;
-};
-
-void
-print_release(struct release *r)
-{
-    printf("release:\n");
-    printf("\tdistribution:%s\n\tversion:%s\n\trevision:%s\n\tcodename:%s\n\ttarget:%s\n\tdescription:%s\n",
-           r->distribution,
-           r->version,
-           r->revision,
-           r->codename,
-           r->target,
-           r->description);
-}
-
-void
-print_board(struct board *b)
-{
-    printf("board:\n");
-    printf("\tkernel:%s\n\thostname:%s\n\tsystem:%s\n",
-           b->kernel, b->hostname, b->system);
-    print_release(b->release);
-}
+/* Model structs and leaf tables, generated from yang/status@2015-12-01.yang. */
+#include "status_model.h"
 
-struct dhcp_lease {
-    struct list_head head;
-    char *lease_expirey;
-    char *mac;
-    char *ip;
-    char *name;
-    char *id;
+/* Sorted values assembled for one publish. */
+struct value_batch {
+    sr_val_t *values;
+    size_t cnt;
+    size_t size;
 };
 
-void
-print_dhcp_lease(struct dhcp_lease *l)
-{
-    printf("dhcp leases:\n");
-    printf("\t%s\n\t%s\n\t%s\n\t%s\n\t%s\n",
-           l->lease_expirey,
-           l->mac,
-           l->ip,
-           l->name,
-           l->id);
-}
+struct apply_queue;
+struct lease_collector;
+struct response_cache;
+struct collector;
+struct wifi_runtime;
+struct station_monitor;
+struct netstats;
+struct health;
+struct shm_writer;
+struct bus;
+struct config_watch;
+struct pool;
 
-struct wifi_device {
-    struct list_head head;
-    char *name;
-    char *type;
-    char *channel;
-    char *macaddr;
-    char *hwmode;
-    char *disabled;
+/* Data sources behind a single-flight collector. */
+enum model_source {
+    SOURCE_BOARD,
+    SOURCE_WIFI,
+    SOURCE_LEASES,
+    SOURCE_RUNTIME,
+    SOURCE_HEALTH,
+    SOURCE_COUNT
 };
 
-void
-print_wifi_device(struct wifi_device *dev)
-{
-    printf("wifi-device\n");
-    printf("\tname:%s\n\ttype:%s\n\tchannel:%s\n\tmacaddr:%s\n\thwmo:%s\n\tdisabled:%s\n",
-           dev->name,
-           dev->type,
-           dev->channel,
-           dev->macaddr,
-           dev->hwmode,
-           dev->disabled);
-}
-
-struct wifi_iface {
-    struct list_head head;
-    char *name;
-    char *device;
-    char *network;
-    char *mode;
-    char *ssid;
-    char *encryption;
-    char *maclist;
-    char *macfilter;
-    char *key;
-};
-
-void
-print_wifi_iface(struct wifi_iface *iface)
-{
-    printf("wifi-iface\n");
-    printf("\tname:%s\n\tdevice:%s\n\tnetwork:%s\n\tmode:%s\n\tssid:%s\n\tencryption:%s\n\tmaclist:%s\n\tmacfilter:%s\n\tkey:%s\n",
-           iface->name,
-           iface->device,
-           iface->network,
-           iface->mode,
-           iface->ssid,
-           iface->encryption,
-           iface->maclist,
-           iface->macfilter,
-           iface->key);
-}
-
 struct model {
     struct list_head *wifi_devs;
     struct list_head *wifi_ifs;
     struct list_head *leases;
     struct board *board;
+    struct value_batch published;   /* values last committed to the data-store */
+    struct settings settings;
+    pthread_mutex_t lock;           /* guards the model against the apply worker */
+    pthread_mutex_t publish_lock;   /* serializes the publishers of the model */
+    unsigned long wifi_changes;     /* wifi sections changed by collections, under lock */
+    struct list_head verified;      /* commits to the wifi lists awaiting apply, under lock */
+    size_t n_verified;
+    struct value_batch *committing; /* batch of the plugin's commit in flight, under lock */
+    struct apply_queue *apply;
+    struct response_cache *cache;   /* answers of the operational data providers */
+    struct collector *sources;      /* one per enum model_source */
+    struct lease_collector *collector;
+    struct wifi_runtime *runtime;   /* live wifi state from iwinfo and hostapd */
+    struct station_monitor *stations;   /* nl80211 station events, NULL when polling */
+    struct netstats *netstats;      /* traffic counters of all interfaces */
+    struct health *health;          /* board load, memory and CPU usage */
+    struct shm_writer *shm;         /* snapshot for local readers, NULL when disabled */
+    sr_conn_ctx_t *lease_conn;      /* own connection for the lease watcher threads */
+    sr_session_ctx_t *lease_session;
+    struct config_watch *config_watch;  /* edits of the wireless package by other tools */
+    sr_session_ctx_t *config_session;
+
+    struct pool *lease_pool;        /* slots of the lease lists, NULL without lease-limit */
+    struct pool *wifi_pool;         /* slots of the wifi lists, NULL without wifi-section-limit */
+    size_t wifi_limit;              /* sections per wifi list, fixed when the pool is set up */
+    atomic_ulong wifi_dropped;      /* sections left out by the last collection */
 
-    struct ubus_context *ubus_ctx;
+    struct bus *bus;                /* ubus connection shared by the collectors */
     struct uci_context *uci_ctx;
     sr_subscription_ctx_t *subscription;
 };
+
+#endif /* STATUS_H */
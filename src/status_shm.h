@@ -0,0 +1,105 @@
+#ifndef STATUS_SHM_H
+#define STATUS_SHM_H
+
+/*
+ * Shared-memory snapshot of the status plugin for local readers.
+ *
+ * The plugin keeps the segment STATUS_SHM_NAME up to date with the board,
+ * DHCP leases and wifi configuration it publishes to sysrepo. Its layout is
+ * fixed; a change of it bumps STATUS_SHM_VERSION. Readers map the segment
+ * once and copy a consistent snapshot out of it without any system call,
+ * a sequence counter tells them when a copy raced with an update.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STATUS_SHM_NAME "/status-snapshot"
+#define STATUS_SHM_MAGIC 0x53545348     /* "STSH" */
+#define STATUS_SHM_VERSION 1
+
+#define STATUS_SHM_STR_LEN 64           /* strings are cut to fit, always terminated */
+#define STATUS_SHM_ADDR_LEN 48          /* IPv6 address with prefix length */
+#define STATUS_SHM_MAX_LEASES 256
+#define STATUS_SHM_MAX_WIFI_DEVICES 8
+#define STATUS_SHM_MAX_WIFI_IFACES 32
+
+struct status_shm_board {
+    char hostname[STATUS_SHM_STR_LEN];
+    char kernel[STATUS_SHM_STR_LEN];
+    char system[STATUS_SHM_STR_LEN];
+    char distribution[STATUS_SHM_STR_LEN];
+    char version[STATUS_SHM_STR_LEN];
+    char revision[STATUS_SHM_STR_LEN];
+    char target[STATUS_SHM_STR_LEN];
+    char description[STATUS_SHM_STR_LEN];
+};
+
+struct status_shm_lease {
+    int64_t expiry;                     /* unix time, 0 for infinite */
+    uint8_t family;                     /* 4 or 6 */
+    char mac[STATUS_SHM_STR_LEN];       /* empty for DHCPv6 leases */
+    char ip[STATUS_SHM_ADDR_LEN];
+    char name[STATUS_SHM_STR_LEN];
+    char source[STATUS_SHM_STR_LEN];
+};
+
+struct status_shm_wifi_device {
+    char name[STATUS_SHM_STR_LEN];
+    char type[STATUS_SHM_STR_LEN];
+    char channel[STATUS_SHM_STR_LEN];
+    char hwmode[STATUS_SHM_STR_LEN];
+    uint8_t disabled;
+};
+
+/* The key of the interface is left out, the segment is readable by everyone. */
+struct status_shm_wifi_iface {
+    char name[STATUS_SHM_STR_LEN];
+    char device[STATUS_SHM_STR_LEN];
+    char network[STATUS_SHM_STR_LEN];
+    char mode[STATUS_SHM_STR_LEN];
+    char ssid[STATUS_SHM_STR_LEN];
+    char encryption[STATUS_SHM_STR_LEN];
+};
+
+/* Everything a reader copies out. */
+struct status_shm_data {
+    int64_t updated;                    /* unix time of the last update */
+    uint32_t n_leases;
+    uint32_t n_wifi_devices;
+    uint32_t n_wifi_ifaces;
+    uint32_t dropped_leases;            /* leases that did not fit */
+    struct status_shm_board board;
+    struct status_shm_lease leases[STATUS_SHM_MAX_LEASES];
+    struct status_shm_wifi_device wifi_devices[STATUS_SHM_MAX_WIFI_DEVICES];
+    struct status_shm_wifi_iface wifi_ifaces[STATUS_SHM_MAX_WIFI_IFACES];
+};
+
+/* Layout of the segment. */
+struct status_shm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                      /* sizeof(struct status_shm) of the writer */
+    uint32_t seq;                       /* odd while the writer updates data, twice the updates */
+    struct status_shm_data data;
+};
+
+struct status_shm_reader {
+    const struct status_shm *shm;
+    uint32_t size;
+};
+
+int status_shm_open(struct status_shm_reader *r, const char *name);
+void status_shm_close(struct status_shm_reader *r);
+uint32_t status_shm_generation(const struct status_shm_reader *r);
+int status_shm_read(const struct status_shm_reader *r, struct status_shm_data *data,
+                    uint32_t *generation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATUS_SHM_H */
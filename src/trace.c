@@ -0,0 +1,210 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "sysrepo.h"
+#include "trace.h"
+
+static atomic_bool trace_enabled;
+static _Atomic(struct trace_ring *) trace_rings;
+static __thread struct trace_ring *trace_ring;
+static __thread uint32_t trace_tid;
+
+/* Record from now on when the environment asks for it, called at plugin start. */
+void
+trace_init(void)
+{
+    const char *env = getenv(TRACE_ENV);
+
+    atomic_store(&trace_enabled, env && *env && strcmp(env, "0"));
+    if (atomic_load(&trace_enabled)) {
+        fprintf(stderr, "Recording trace spans\n");
+    }
+}
+
+/* Ring of the calling thread, added to the list on its first event. */
+static struct trace_ring *
+trace_thread_ring(void)
+{
+    struct trace_ring *ring = trace_ring;
+
+    if (ring) {
+        return ring;
+    }
+    ring = calloc(1, sizeof(*ring));
+    if (!ring) {
+        return NULL;
+    }
+    ring->next = atomic_load(&trace_rings);
+    while (!atomic_compare_exchange_weak(&trace_rings, &ring->next, ring)) {
+        ;
+    }
+    trace_ring = ring;
+    trace_tid = (uint32_t) syscall(SYS_gettid);
+
+    return ring;
+}
+
+static void
+trace_record(const char *cat, const char *name, char phase)
+{
+    struct trace_ring *ring;
+    struct trace_event *ev;
+    struct timespec now;
+    unsigned long head;
+
+    if (!atomic_load_explicit(&trace_enabled, memory_order_relaxed)) {
+        return;
+    }
+    ring = trace_thread_ring();
+    if (!ring) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    /* A dump that sees the slot rewritten also sees the head it was rewritten after. */
+    atomic_thread_fence(memory_order_release);
+    ev = &ring->events[head % TRACE_RING_LEN];
+    ev->ts_us = (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    ev->cat = cat;
+    ev->name = name;
+    ev->tid = trace_tid;
+    ev->phase = phase;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void
+trace_begin(const char *cat, const char *name)
+{
+    trace_record(cat, name, 'B');
+}
+
+void
+trace_end(const char *cat, const char *name)
+{
+    trace_record(cat, name, 'E');
+}
+
+/* The dump directory, created on first use; refused unless only we can reach into it. */
+static int
+trace_dir_open(void)
+{
+    struct stat st;
+    int fd;
+
+    if (mkdir(TRACE_DIR, 0700) && errno != EEXIST) {
+        return -1;
+    }
+    fd = open(TRACE_DIR, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) || st.st_uid != geteuid() || (st.st_mode & (S_IRWXG | S_IRWXO))) {
+        close(fd);
+        errno = EPERM;
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Write the events of all threads as Chrome trace JSON.
+ *
+ * The trace goes to a file of TRACE_DIR, replacing an earlier dump of the same
+ * name. The threads keep recording meanwhile; events they overwrote during the
+ * copy of their ring are left out.
+ *
+ * @param[in] name File name in TRACE_DIR, no path.
+ * @param[out] n_events Number of events written.
+ * @return SR_ERR_OK on success, otherwise some Sysrepo error code.
+ */
+int
+trace_dump(const char *name, uint32_t *n_events)
+{
+    struct trace_event *copy;
+    const struct trace_event *ev;
+    struct trace_ring *ring;
+    unsigned long head, last, first, i;
+    uint32_t n = 0;
+    FILE *f = NULL;
+    int dir, fd = -1;
+    int rc = SR_ERR_OK;
+
+    if (!name[0] || name[0] == '.' || strchr(name, '/')) {
+        fprintf(stderr, "Trace file %s is no plain file name\n", name);
+        return SR_ERR_INVAL_ARG;
+    }
+    copy = malloc(sizeof(ring->events));
+    if (!copy) {
+        return SR_ERR_NOMEM;
+    }
+
+    dir = trace_dir_open();
+    if (dir < 0) {
+        fprintf(stderr, "Can't use trace directory %s: %s\n", TRACE_DIR, strerror(errno));
+        free(copy);
+        return SR_ERR_IO;
+    }
+    /* Nobody else writes into the directory, the old dump can go safely. */
+    if (!unlinkat(dir, name, 0) || errno == ENOENT) {
+        fd = openat(dir, name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    }
+    if (fd >= 0) {
+        f = fdopen(fd, "w");
+    }
+    if (!f) {
+        fprintf(stderr, "Can't write trace to %s/%s: %s\n", TRACE_DIR, name, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        close(dir);
+        free(copy);
+        return SR_ERR_IO;
+    }
+    close(dir);
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (ring = atomic_load(&trace_rings); ring; ring = ring->next) {
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        memcpy(copy, ring->events, sizeof(ring->events));
+        atomic_thread_fence(memory_order_acquire);
+        last = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+        /* The slot of event last may be in the middle of being rewritten. */
+        first = head > TRACE_RING_LEN ? head - TRACE_RING_LEN : 0;
+        if (last >= TRACE_RING_LEN && first <= last - TRACE_RING_LEN) {
+            first = last - TRACE_RING_LEN + 1;
+        }
+        for (i = first; i < head; i++) {
+            ev = &copy[i % TRACE_RING_LEN];
+            fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIu64
+                    ",\"pid\":%d,\"tid\":%" PRIu32 "}",
+                    n ? "," : "", ev->name, ev->cat, ev->phase, ev->ts_us, (int) getpid(), ev->tid);
+            n++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    if (ferror(f)) {
+        rc = SR_ERR_IO;
+    }
+    if (fclose(f)) {
+        rc = SR_ERR_IO;
+    }
+    if (SR_ERR_OK != rc) {
+        fprintf(stderr, "Can't write trace to %s/%s\n", TRACE_DIR, name);
+    }
+    free(copy);
+    *n_events = n;
+
+    return rc;
+}
@@ -0,0 +1,39 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define TRACE_ENV "STATUS_TRACE"        /* set to 1 to record spans from the plugin start */
+#define TRACE_RING_LEN 2048             /* latest events kept per thread */
+#ifndef TRACE_DIR
+#define TRACE_DIR "/var/run/status-trace" /* private directory of the dumps */
+#endif
+
+/* Begin or end of a span, names are string literals. */
+struct trace_event {
+    uint64_t ts_us;                     /* CLOCK_MONOTONIC */
+    const char *cat;
+    const char *name;
+    uint32_t tid;
+    char phase;                         /* 'B' or 'E' as in the Chrome trace format */
+};
+
+/*
+ * Events of one thread. Only the owner writes, bumping head after each event;
+ * a dump copies the ring and keeps the events the owner cannot have overwritten
+ * meanwhile. Rings are allocated by the first span of a thread and kept for the
+ * life of the process, the threads that trace are long-lived.
+ */
+struct trace_ring {
+    struct trace_ring *next;            /* list of all rings, only prepended */
+    atomic_ulong head;                  /* events written so far */
+    struct trace_event events[TRACE_RING_LEN];
+};
+
+void trace_init(void);
+void trace_begin(const char *cat, const char *name);
+void trace_end(const char *cat, const char *name);
+int trace_dump(const char *name, uint32_t *n_events);
+
+#endif /* TRACE_H */
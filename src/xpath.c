@@ -0,0 +1,146 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sysrepo.h"
+#include "sysrepo/values.h"
+#include "xpath.h"
+
+#define XPATH_BUF_MIN_SIZE 128
+
+/**
+ * @brief Append formatted text to the xpath, growing the buffer as needed.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_NOMEM when the buffer can not grow.
+ */
+int
+xpath_buf_append(struct xpath_buf *xb, const char *fmt, ...)
+{
+    va_list ap;
+    size_t size;
+    char *buf;
+    int n;
+
+    for (;;) {
+        if (xb->buf) {
+            va_start(ap, fmt);
+            n = vsnprintf(xb->buf + xb->len, xb->size - xb->len, fmt, ap);
+            va_end(ap);
+            if (n < 0) {
+                xb->buf[xb->len] = '\0';
+                return SR_ERR_INVAL_ARG;
+            }
+            if ((size_t) n < xb->size - xb->len) {
+                xb->len += n;
+                return SR_ERR_OK;
+            }
+            xb->buf[xb->len] = '\0';
+        } else {
+            n = 0;
+        }
+
+        size = xb->size ? xb->size : XPATH_BUF_MIN_SIZE;
+        while (size < xb->len + n + 1) {
+            size *= 2;
+        }
+
+        buf = realloc(xb->buf, size);
+        if (!buf) {
+            return SR_ERR_NOMEM;
+        }
+        if (!xb->buf) {
+            buf[0] = '\0';
+        }
+        xb->buf = buf;
+        xb->size = size;
+    }
+}
+
+/**
+ * @brief Append a list key predicate, quoting the value with whichever quote
+ * it does not contain.
+ *
+ * @return SR_ERR_OK on success, SR_ERR_INVAL_ARG for values holding both quotes.
+ */
+int
+xpath_buf_append_key(struct xpath_buf *xb, const char *key, const char *value)
+{
+    if (!strchr(value, '\'')) {
+        return xpath_buf_append(xb, "[%s='%s']", key, value);
+    }
+    if (!strchr(value, '"')) {
+        return xpath_buf_append(xb, "[%s=\"%s\"]", key, value);
+    }
+
+    fprintf(stderr, "Can not quote key value [%s].\n", value);
+    return SR_ERR_INVAL_ARG;
+}
+
+/**
+ * @brief Locate the key value of a list entry in an xpath.
+ *
+ * @return Start of the value inside xpath with its length in len, NULL when
+ * the xpath holds no keyed entry of the list.
+ */
+const char *
+xpath_list_key(const char *xpath, const char *list, size_t *len)
+{
+    size_t list_len = strlen(list);
+    const char *p = xpath, *value, *end;
+
+    while ((p = strstr(p, list))) {
+        if (p > xpath && p[-1] == '/' && p[list_len] == '[') {
+            value = strpbrk(p + list_len, "'\"");
+            if (!value) {
+                return NULL;
+            }
+            end = strchr(value + 1, *value);
+            if (!end) {
+                return NULL;
+            }
+            *len = end - value - 1;
+            return value + 1;
+        }
+        p += list_len;
+    }
+
+    return NULL;
+}
+
+/* Cut the xpath back to a previously taken length. */
+void
+xpath_buf_truncate(struct xpath_buf *xb, size_t len)
+{
+    if (xb->buf && len <= xb->len) {
+        xb->len = len;
+        xb->buf[len] = '\0';
+    }
+}
+
+void
+xpath_buf_free(struct xpath_buf *xb)
+{
+    free(xb->buf);
+    xb->buf = NULL;
+    xb->len = 0;
+    xb->size = 0;
+}
+
+/**
+ * @brief Set the xpath of an operational value to <prefix>/<leaf>.
+ *
+ * @param[in] prefix Length of the list entry or container path in xb.
+ */
+int
+xpath_set_leaf(sr_val_t *v, struct xpath_buf *xb, size_t prefix, const char *leaf)
+{
+    int rc;
+
+    xpath_buf_truncate(xb, prefix);
+    rc = xpath_buf_append(xb, "/%s", leaf);
+    if (SR_ERR_OK == rc) {
+        rc = sr_val_set_xpath(v, xb->buf);
+    }
+
+    return rc;
+}
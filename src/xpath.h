@@ -0,0 +1,24 @@
+#ifndef XPATH_H
+#define XPATH_H
+
+#include <stddef.h>
+#include "sysrepo.h"
+
+/**
+ * Growable xpath string. A length taken after building a list entry prefix can be
+ * passed to xpath_buf_truncate() to reuse that prefix for all leaves of the entry.
+ */
+struct xpath_buf {
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+int xpath_buf_append(struct xpath_buf *xb, const char *fmt, ...);
+int xpath_buf_append_key(struct xpath_buf *xb, const char *key, const char *value);
+const char *xpath_list_key(const char *xpath, const char *list, size_t *len);
+void xpath_buf_truncate(struct xpath_buf *xb, size_t len);
+void xpath_buf_free(struct xpath_buf *xb);
+int xpath_set_leaf(sr_val_t *v, struct xpath_buf *xb, size_t prefix, const char *leaf);
+
+#endif /* XPATH_H */
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Write stations.pcap, a small nlmon capture of nl80211 station events.
+
+The capture holds the GETFAMILY exchange for nl80211 (family id 0x1c), two
+associations and one disassociation on ifindex 4242, and a NEW_STATION with
+the same command number from another generic netlink family (0x1d) which a
+replay has to ignore.
+"""
+
+import struct
+import sys
+
+NETLINK_GENERIC = 16
+GENL_ID_CTRL = 0x10
+CTRL_CMD_NEWFAMILY, CTRL_CMD_GETFAMILY = 1, 3
+CTRL_ATTR_FAMILY_ID, CTRL_ATTR_FAMILY_NAME, CTRL_ATTR_MCAST_GROUPS = 1, 2, 7
+CTRL_ATTR_MCAST_GRP_NAME, CTRL_ATTR_MCAST_GRP_ID = 1, 2
+NL80211_CMD_NEW_STATION, NL80211_CMD_DEL_STATION = 19, 20
+NL80211_ATTR_IFINDEX, NL80211_ATTR_MAC, NL80211_ATTR_STA_INFO = 3, 6, 21
+NL80211_STA_INFO_INACTIVE_TIME, NL80211_STA_INFO_SIGNAL = 1, 7
+NL80211_STA_INFO_CONNECTED_TIME = 16
+NL80211_FAMILY, OTHER_FAMILY = 0x1c, 0x1d
+IFINDEX = 4242
+
+
+def attr(kind, data):
+    pad = (4 - len(data) % 4) % 4
+    return struct.pack("=HH", 4 + len(data), kind) + data + b"\0" * pad
+
+
+def genl(kind, cmd, attrs, flags=0):
+    body = struct.pack("=BBH", cmd, 1, 0) + b"".join(attrs)
+    return struct.pack("=IHHII", 16 + len(body), kind, flags, 1, 0) + body
+
+
+def station(family, cmd, mac, signal=None, connected=None):
+    attrs = [attr(NL80211_ATTR_IFINDEX, struct.pack("=I", IFINDEX)),
+             attr(NL80211_ATTR_MAC, bytes.fromhex(mac.replace(":", "")))]
+    if signal is not None:
+        attrs.append(attr(NL80211_ATTR_STA_INFO, b"".join([
+            attr(NL80211_STA_INFO_SIGNAL, struct.pack("=b", signal)),
+            attr(NL80211_STA_INFO_INACTIVE_TIME, struct.pack("=I", 10)),
+            attr(NL80211_STA_INFO_CONNECTED_TIME, struct.pack("=I", connected)),
+        ])))
+    return genl(family, cmd, attrs)
+
+
+MESSAGES = [
+    genl(GENL_ID_CTRL, CTRL_CMD_GETFAMILY,
+         [attr(CTRL_ATTR_FAMILY_NAME, b"nl80211\0")], flags=1),
+    genl(GENL_ID_CTRL, CTRL_CMD_NEWFAMILY, [
+        attr(CTRL_ATTR_FAMILY_ID, struct.pack("=H", NL80211_FAMILY)),
+        attr(CTRL_ATTR_FAMILY_NAME, b"nl80211\0"),
+        attr(CTRL_ATTR_MCAST_GROUPS, attr(1, b"".join([
+            attr(CTRL_ATTR_MCAST_GRP_NAME, b"mlme\0"),
+            attr(CTRL_ATTR_MCAST_GRP_ID, struct.pack("=I", 5)),
+        ]))),
+    ]),
+    station(NL80211_FAMILY, NL80211_CMD_NEW_STATION, "02:00:00:00:00:01", -40, 30),
+    station(NL80211_FAMILY, NL80211_CMD_NEW_STATION, "02:00:00:00:00:02", -60, 5),
+    station(OTHER_FAMILY, NL80211_CMD_NEW_STATION, "02:00:00:00:00:03", -50, 1),
+    station(NL80211_FAMILY, NL80211_CMD_DEL_STATION, "02:00:00:00:00:02"),
+]
+
+
+def main(path):
+    with open(path, "wb") as f:
+        f.write(struct.pack("=IHHiIII", 0xa1b2c3d4, 2, 4, 0, 0, 65535, 253))
+        for i, msg in enumerate(MESSAGES):
+            # Linux cooked header: packet type, ARPHRD_NETLINK, no address, protocol.
+            sll = struct.pack(">HHH8sH", 4, 824, 0, b"", NETLINK_GENERIC)
+            f.write(struct.pack("=IIII", 1700000000 + i, 0, len(sll) + len(msg), len(sll) + len(msg)))
+            f.write(sll + msg)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1] if len(sys.argv) > 1 else "stations.pcap")
@@ -0,0 +1,19 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+/* Failed checks are reported and counted, the test exits with TEST_RESULT. */
+static int test_failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT (test_failures ? 1 : 0)
+
+#endif /* TEST_H */
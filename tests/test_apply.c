@@ -0,0 +1,244 @@
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include "sysrepo.h"
+#include "apply.h"
+#include "test.h"
+
+#define WINDOW_FOREVER_MS 3600000
+
+/* Flush callback: counts the calls and fails when told to. */
+struct flushes {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int calls;
+    size_t sets;
+    int rc;
+};
+
+#define FLUSHES_INIT { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER }
+
+static int
+flush_cb(struct list_head *sets, void *priv)
+{
+    struct flushes *f = priv;
+    struct list_head *pos;
+
+    pthread_mutex_lock(&f->lock);
+    f->calls++;
+    list_for_each(pos, sets) {
+        f->sets++;
+    }
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+
+    return f->rc;
+}
+
+/* Wait until the worker flushed calls times, false after a few seconds. */
+static bool
+wait_flushed(struct flushes *f, int calls)
+{
+    struct timespec deadline;
+    bool done;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 5;
+    pthread_mutex_lock(&f->lock);
+    while (f->calls < calls && !pthread_cond_timedwait(&f->cond, &f->lock, &deadline)) {
+        ;
+    }
+    done = f->calls >= calls;
+    pthread_mutex_unlock(&f->lock);
+
+    return done;
+}
+
+/* Wait until the worker applied done sets, false after a few seconds. */
+static bool
+wait_applied(struct apply_queue *q, unsigned long done)
+{
+    struct timespec pause = { .tv_nsec = 10 * 1000000L };
+    struct apply_status status;
+    int i;
+
+    for (i = 0; i < 500; i++) {
+        apply_queue_status(q, &status);
+        if (status.applied + status.failed >= done && !status.applying) {
+            return true;
+        }
+        nanosleep(&pause, NULL);
+    }
+
+    return false;
+}
+
+static struct apply_set *
+set_new(const char *key, const char *ssid)
+{
+    const struct model_node *node = &model_nodes[MODEL_WIFI_IFACE];
+    struct apply_set *set = apply_set_new();
+    size_t i;
+
+    for (i = 0; i < node->n_leaves && strcmp(node->leaves[i].name, "ssid"); i++);
+    CHECK(set && i < node->n_leaves);
+    CHECK(SR_ERR_OK == apply_set_add(set, MODEL_WIFI_IFACE, key, &node->leaves[i],
+                                     SR_OP_MODIFIED, ssid));
+
+    return set;
+}
+
+/* Sets pushed within the window are applied together once it stays quiet. */
+static void
+test_merge(void)
+{
+    struct flushes f = FLUSHES_INIT;
+    struct apply_queue q;
+
+    memset(&q, 0, sizeof(q));
+    CHECK(SR_ERR_OK == apply_queue_start(&q, WINDOW_FOREVER_MS, flush_cb, &f));
+    apply_queue_push(&q, set_new("wlan0", "one"));
+    apply_queue_push(&q, set_new("wlan1", "two"));
+
+    apply_queue_set_window(&q, 0);
+    CHECK(wait_flushed(&f, 1));
+    CHECK(f.calls == 1 && f.sets == 2);
+    apply_queue_stop(&q);
+}
+
+static void
+test_reserve(void)
+{
+    struct flushes f = FLUSHES_INIT;
+    struct apply_queue q;
+    struct apply_status status;
+    size_t i;
+
+    memset(&q, 0, sizeof(q));
+    CHECK(SR_ERR_OK == apply_queue_start(&q, WINDOW_FOREVER_MS, flush_cb, &f));
+
+    for (i = 0; i < APPLY_QUEUE_LEN; i++) {
+        CHECK(SR_ERR_OK == apply_queue_reserve(&q));
+    }
+    CHECK(SR_ERR_OPERATION_FAILED == apply_queue_reserve(&q));
+
+    /* A released slot can be taken again. */
+    apply_queue_release(&q);
+    CHECK(SR_ERR_OK == apply_queue_reserve(&q));
+
+    /* Pushed sets keep their slot until applied. */
+    apply_queue_push(&q, set_new("wlan0", "one"));
+    apply_queue_push(&q, set_new("wlan1", "two"));
+    CHECK(SR_ERR_OPERATION_FAILED == apply_queue_reserve(&q));
+    apply_queue_status(&q, &status);
+    CHECK(status.pending == 2);
+
+    for (i = 2; i < APPLY_QUEUE_LEN; i++) {
+        apply_queue_release(&q);
+    }
+    /* Releasing more than was reserved does not make room. */
+    apply_queue_release(&q);
+    for (i = 2; i < APPLY_QUEUE_LEN; i++) {
+        CHECK(SR_ERR_OK == apply_queue_reserve(&q));
+    }
+    CHECK(SR_ERR_OPERATION_FAILED == apply_queue_reserve(&q));
+    for (i = 2; i < APPLY_QUEUE_LEN; i++) {
+        apply_queue_release(&q);
+    }
+
+    /* Both sets are applied together once the window closes, freeing their slots. */
+    apply_queue_set_window(&q, 0);
+    CHECK(wait_applied(&q, 2));
+    CHECK(f.calls == 1 && f.sets == 2);
+    apply_queue_status(&q, &status);
+    CHECK(status.pending == 0 && status.applied == 2 && status.failed == 0);
+    CHECK(status.n_results == 2 && status.results[0].merged == 2);
+    CHECK(status.results[0].id == 1 && status.results[1].id == 2);
+    for (i = 0; i < APPLY_QUEUE_LEN; i++) {
+        CHECK(SR_ERR_OK == apply_queue_reserve(&q));
+    }
+
+    apply_queue_stop(&q);
+}
+
+static void
+test_failure(void)
+{
+    struct flushes f = FLUSHES_INIT;
+    struct apply_queue q;
+    struct apply_status status;
+
+    f.rc = SR_ERR_OPERATION_FAILED;
+    memset(&q, 0, sizeof(q));
+    CHECK(SR_ERR_OK == apply_queue_start(&q, 0, flush_cb, &f));
+    CHECK(SR_ERR_OK == apply_queue_reserve(&q));
+    apply_queue_push(&q, set_new("wlan0", "one"));
+    CHECK(wait_applied(&q, 1));
+    apply_queue_status(&q, &status);
+    CHECK(status.applied == 0 && status.failed == 1);
+    CHECK(status.n_results == 1 && status.results[0].rc == SR_ERR_OPERATION_FAILED);
+    apply_queue_stop(&q);
+}
+
+/* Sets still waiting for the window are applied on stop. */
+static void
+test_stop(void)
+{
+    struct flushes f = FLUSHES_INIT;
+    struct apply_queue q;
+
+    memset(&q, 0, sizeof(q));
+    CHECK(SR_ERR_OK == apply_queue_start(&q, WINDOW_FOREVER_MS, flush_cb, &f));
+    apply_queue_push(&q, set_new("wlan0", "one"));
+    apply_queue_stop(&q);
+    CHECK(f.calls == 1 && f.sets == 1);
+}
+
+/* A window that never stays quiet does not hold the sets back beyond the max delay. */
+static void
+test_max_delay(void)
+{
+    struct flushes f = FLUSHES_INIT;
+    struct apply_queue q;
+
+    memset(&q, 0, sizeof(q));
+    CHECK(SR_ERR_OK == apply_queue_start(&q, WINDOW_FOREVER_MS, flush_cb, &f));
+    /* Read by the worker only once a set is pushed under the lock. */
+    q.max_delay_ms = 50;
+    apply_queue_push(&q, set_new("wlan0", "one"));
+    apply_queue_push(&q, set_new("wlan1", "two"));
+    CHECK(wait_flushed(&f, 1));
+    CHECK(f.sets == 2);
+    apply_queue_stop(&q);
+}
+
+static void
+test_set_equal(void)
+{
+    struct apply_set *a = set_new("wlan0", "one");
+    struct apply_set *b = set_new("wlan0", "one");
+    struct apply_set *c = set_new("wlan0", "two");
+
+    CHECK(apply_set_equal(a, b));
+    CHECK(!apply_set_equal(a, c));
+    CHECK(SR_ERR_OK == apply_set_add(b, MODEL_WIFI_IFACE, "wlan1", NULL, SR_OP_DELETED, NULL));
+    CHECK(!apply_set_equal(a, b));
+    CHECK(!apply_set_equal(b, a));
+
+    apply_set_free(a);
+    apply_set_free(b);
+    apply_set_free(c);
+}
+
+int
+main(void)
+{
+    test_merge();
+    test_reserve();
+    test_failure();
+    test_stop();
+    test_max_delay();
+    test_set_equal();
+
+    return TEST_RESULT;
+}
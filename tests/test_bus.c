@@ -0,0 +1,29 @@
+#include "bus.h"
+#include "test.h"
+
+/* The wait doubles after every failed connect, up to the maximum. */
+static void
+test_backoff(void)
+{
+    uint32_t backoff = 0;
+    int i;
+
+    backoff = bus_backoff_next(backoff);
+    CHECK(backoff == BUS_BACKOFF_MIN_MS);
+    backoff = bus_backoff_next(backoff);
+    CHECK(backoff == 2 * BUS_BACKOFF_MIN_MS);
+
+    for (i = 0; i < 32; i++) {
+        backoff = bus_backoff_next(backoff);
+        CHECK(backoff <= BUS_BACKOFF_MAX_MS);
+    }
+    CHECK(backoff == BUS_BACKOFF_MAX_MS);
+}
+
+int
+main(void)
+{
+    test_backoff();
+
+    return TEST_RESULT;
+}
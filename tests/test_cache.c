@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "sysrepo.h"
+#include "sysrepo/values.h"
+#include "cache.h"
+#include "test.h"
+
+/* Build callback: counts the calls and answers cnt containers, or fails with rc. */
+struct builds {
+    int calls;
+    size_t cnt;
+    int rc;
+};
+
+static int
+build_cb(const char *xpath, void *arg, sr_val_t **values, size_t *values_cnt)
+{
+    struct builds *b = arg;
+    size_t i;
+    int rc;
+
+    b->calls++;
+    if (SR_ERR_OK != b->rc) {
+        return b->rc;
+    }
+    rc = sr_new_values(b->cnt, values);
+    if (SR_ERR_OK != rc) {
+        return rc;
+    }
+    for (i = 0; i < b->cnt; i++) {
+        (*values)[i].type = SR_CONTAINER_T;
+        sr_val_set_xpath(&(*values)[i], xpath);
+    }
+    *values_cnt = b->cnt;
+
+    return SR_ERR_OK;
+}
+
+/* Get xpath and drop the answer, which must hold the built count. */
+static int
+get(struct response_cache *c, const char *xpath, unsigned long generation, struct builds *b)
+{
+    sr_val_t *values = NULL;
+    size_t cnt = 0;
+    int rc;
+
+    rc = response_cache_get(c, xpath, generation, build_cb, b, &values, &cnt);
+    if (SR_ERR_OK == rc) {
+        CHECK(cnt == b->cnt);
+    }
+    sr_free_values(values, cnt);
+
+    return rc;
+}
+
+/* An answer is rebuilt only when the generation moved on. */
+static void
+test_generation(void)
+{
+    struct builds b = { .cnt = 2 };
+    struct response_cache c;
+    sr_val_t *first, *second;
+    size_t n1, n2;
+
+    response_cache_init(&c);
+
+    CHECK(SR_ERR_OK == get(&c, "/status:board/health", 1, &b));
+    CHECK(b.calls == 1);
+    CHECK(SR_ERR_OK == get(&c, "/status:board/health", 1, &b));
+    CHECK(b.calls == 1);
+
+    /* Every request gets its own copy of the cached values. */
+    CHECK(SR_ERR_OK == response_cache_get(&c, "/status:board/health", 1, build_cb, &b, &first, &n1));
+    CHECK(SR_ERR_OK == response_cache_get(&c, "/status:board/health", 1, build_cb, &b, &second, &n2));
+    CHECK(b.calls == 1 && n1 == 2 && n2 == 2 && first != second);
+    sr_free_values(first, n1);
+    sr_free_values(second, n2);
+
+    CHECK(SR_ERR_OK == get(&c, "/status:board/health", 2, &b));
+    CHECK(b.calls == 2);
+    /* Another xpath of the same generation is an answer of its own. */
+    CHECK(SR_ERR_OK == get(&c, "/status:interfaces", 2, &b));
+    CHECK(b.calls == 3);
+
+    response_cache_free(&c);
+}
+
+/* A failed build is returned and not cached. */
+static void
+test_failure(void)
+{
+    struct builds b = { .cnt = 1, .rc = SR_ERR_IO };
+    struct response_cache c;
+
+    response_cache_init(&c);
+
+    CHECK(SR_ERR_IO == get(&c, "/status:interfaces", 1, &b));
+    CHECK(b.calls == 1);
+    b.rc = SR_ERR_OK;
+    CHECK(SR_ERR_OK == get(&c, "/status:interfaces", 1, &b));
+    CHECK(b.calls == 2);
+    CHECK(SR_ERR_OK == get(&c, "/status:interfaces", 1, &b));
+    CHECK(b.calls == 2);
+
+    response_cache_free(&c);
+}
+
+/* A new xpath takes the entry used least recently. */
+static void
+test_lru(void)
+{
+    struct builds b = { .cnt = 1 };
+    struct response_cache c;
+    char xpath[32];
+    int i;
+
+    response_cache_init(&c);
+
+    for (i = 0; i < RESPONSE_CACHE_LEN; i++) {
+        snprintf(xpath, sizeof(xpath), "/status:x%d", i);
+        CHECK(SR_ERR_OK == get(&c, xpath, 1, &b));
+    }
+    CHECK(b.calls == RESPONSE_CACHE_LEN);
+
+    /* x0 is used again, so x1 is the one to go. */
+    CHECK(SR_ERR_OK == get(&c, "/status:x0", 1, &b));
+    CHECK(SR_ERR_OK == get(&c, "/status:new", 1, &b));
+    CHECK(b.calls == RESPONSE_CACHE_LEN + 1);
+    CHECK(SR_ERR_OK == get(&c, "/status:x0", 1, &b));
+    CHECK(SR_ERR_OK == get(&c, "/status:x2", 1, &b));
+    CHECK(b.calls == RESPONSE_CACHE_LEN + 1);
+    CHECK(SR_ERR_OK == get(&c, "/status:x1", 1, &b));
+    CHECK(b.calls == RESPONSE_CACHE_LEN + 2);
+
+    response_cache_free(&c);
+}
+
+int
+main(void)
+{
+    test_generation();
+    test_failure();
+    test_lru();
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,73 @@
+#include <string.h>
+#include "sysrepo.h"
+#include "classify.h"
+#include "test.h"
+
+static struct change_classifier classifier;
+
+static enum change_class
+cls(const char *xpath)
+{
+    struct change_info info;
+
+    classify_change(&classifier, xpath, &info);
+
+    return info.cls;
+}
+
+static void
+test_classes(void)
+{
+    CHECK(cls("/status:wifi") == CHANGE_CONTAINER);
+    CHECK(cls("/status:wifi/wifi-iface[name='lan']") == CHANGE_WIFI_IFACE);
+    CHECK(cls("/status:wifi/wifi-device[name='radio0']/channel") == CHANGE_WIFI_DEVICE);
+    CHECK(cls("/status:settings") == CHANGE_SETTINGS);
+    CHECK(cls("/status:settings/lease-source[name='dnsmasq']/path") == CHANGE_SETTINGS);
+
+    /* Published containers are read-only down to their last leaf. */
+    CHECK(cls("/status:board") == CHANGE_READ_ONLY);
+    CHECK(cls("/status:board/release/version") == CHANGE_READ_ONLY);
+    CHECK(cls("/status:dhcp/dhcp-leases[id='01:02']/ip") == CHANGE_READ_ONLY);
+
+    CHECK(cls("/status:nope") == CHANGE_UNKNOWN);
+    CHECK(cls("/status:wifi/wifi-iface[name='lan']/nope") == CHANGE_UNKNOWN);
+    CHECK(cls("/status:wifi/wifi-iface[name='unterminated]/ssid") == CHANGE_UNKNOWN);
+}
+
+static void
+test_info(void)
+{
+    struct change_info info;
+
+    /* A quoted key may hold the characters that end segments and predicates. */
+    classify_change(&classifier, "/status:wifi/wifi-iface[name=\"a/b]'c\"]/ssid", &info);
+    CHECK(info.cls == CHANGE_WIFI_IFACE);
+    CHECK(info.node == MODEL_WIFI_IFACE);
+    CHECK(info.leaf && !strcmp(info.leaf->name, "ssid"));
+    CHECK(info.key && info.key_len == 6 && !strncmp(info.key, "a/b]'c", info.key_len));
+
+    /* The entry key is kept, not the value of a leaf-list item. */
+    classify_change(&classifier, "/status:wifi/wifi-iface[name='lan']/maclist[.='00:11:22:33:44:55']",
+                    &info);
+    CHECK(info.leaf && !strcmp(info.leaf->name, "maclist"));
+    CHECK(info.key && info.key_len == 3 && !strncmp(info.key, "lan", info.key_len));
+
+    classify_change(&classifier, "/status:wifi/wifi-device[name='radio0']", &info);
+    CHECK(info.node == MODEL_WIFI_DEVICE && !info.leaf);
+
+    classify_change(&classifier, "/status:wifi", &info);
+    CHECK(info.node == MODEL_NODE_COUNT && !info.key);
+}
+
+int
+main(void)
+{
+    if (SR_ERR_OK != classifier_init(&classifier)) {
+        return 1;
+    }
+    test_classes();
+    test_info();
+    classifier_free(&classifier);
+
+    return TEST_RESULT;
+}
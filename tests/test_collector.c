@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <sched.h>
+#include "sysrepo.h"
+#include "collector.h"
+#include "test.h"
+
+#define TTL_LONG_MS 3600000
+
+/* Source whose collections wait until the test opens the gate. */
+struct source {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool closed;
+    int calls;
+    int rc;
+};
+
+static struct source src = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static int
+source_collect(void *priv)
+{
+    struct source *s = priv;
+    int rc;
+
+    pthread_mutex_lock(&s->lock);
+    s->calls++;
+    pthread_cond_broadcast(&s->cond);
+    while (s->closed) {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    rc = s->rc;
+    pthread_mutex_unlock(&s->lock);
+
+    return rc;
+}
+
+static int
+calls(void)
+{
+    int n;
+
+    pthread_mutex_lock(&src.lock);
+    n = src.calls;
+    pthread_mutex_unlock(&src.lock);
+
+    return n;
+}
+
+static void
+gate(bool closed)
+{
+    pthread_mutex_lock(&src.lock);
+    src.closed = closed;
+    pthread_cond_broadcast(&src.cond);
+    pthread_mutex_unlock(&src.lock);
+}
+
+struct caller {
+    pthread_t thread;
+    struct collector *c;
+    bool changed;
+    int rc;
+};
+
+static void *
+caller_thread(void *arg)
+{
+    struct caller *caller = arg;
+
+    caller->rc = collector_refresh(caller->c, caller->changed);
+
+    return NULL;
+}
+
+/* Wait until n callers block on the running collection. */
+static void
+wait_waiters(struct collector *c, unsigned int n)
+{
+    unsigned int waiters;
+
+    for (;;) {
+        pthread_mutex_lock(&c->lock);
+        waiters = c->waiters;
+        pthread_mutex_unlock(&c->lock);
+        if (waiters >= n) {
+            break;
+        }
+        sched_yield();
+    }
+}
+
+static void
+test_single_flight(void)
+{
+    struct collector c;
+    struct caller callers[5];
+    size_t i;
+
+    collector_init(&c, "test", TTL_LONG_MS, source_collect, &src);
+    src.calls = 0;
+    gate(true);
+
+    /* The first caller starts a collection and blocks in it. */
+    callers[0].c = &c;
+    callers[0].changed = false;
+    pthread_create(&callers[0].thread, NULL, caller_thread, &callers[0]);
+    pthread_mutex_lock(&src.lock);
+    while (!src.calls) {
+        pthread_cond_wait(&src.cond, &src.lock);
+    }
+    pthread_mutex_unlock(&src.lock);
+
+    /*
+     * Plain callers share the running collection, callers that know of a change
+     * share one collection begun after it. However the threads are scheduled,
+     * there are two collections for all of them.
+     */
+    for (i = 1; i < 5; i++) {
+        callers[i].c = &c;
+        callers[i].changed = i >= 3;
+        pthread_create(&callers[i].thread, NULL, caller_thread, &callers[i]);
+    }
+    wait_waiters(&c, 4);
+    CHECK(calls() == 1);
+    gate(false);
+    for (i = 0; i < 5; i++) {
+        pthread_join(callers[i].thread, NULL);
+        CHECK(callers[i].rc == SR_ERR_OK);
+    }
+    CHECK(calls() == 2);
+    CHECK(collector_generation(&c) == 2);
+
+    collector_destroy(&c);
+}
+
+static void
+test_ttl(void)
+{
+    struct collector c;
+
+    collector_init(&c, "test", TTL_LONG_MS, source_collect, &src);
+    src.calls = 0;
+    gate(false);
+
+    CHECK(SR_ERR_OK == collector_refresh(&c, false));
+    CHECK(calls() == 1);
+    /* A fresh result is reused unless the source changed. */
+    CHECK(SR_ERR_OK == collector_refresh(&c, false));
+    CHECK(calls() == 1);
+    CHECK(SR_ERR_OK == collector_refresh(&c, true));
+    CHECK(calls() == 2);
+
+    /* A failure is not fresh, the next refresh tries again. */
+    src.rc = SR_ERR_IO;
+    CHECK(SR_ERR_IO == collector_refresh(&c, true));
+    CHECK(calls() == 3);
+    src.rc = SR_ERR_OK;
+    CHECK(SR_ERR_OK == collector_refresh(&c, false));
+    CHECK(calls() == 4);
+    CHECK(SR_ERR_OK == collector_refresh(&c, false));
+    CHECK(calls() == 4);
+
+    /* Without a TTL every refresh collects. */
+    collector_set_ttl(&c, 0);
+    CHECK(SR_ERR_OK == collector_refresh(&c, false));
+    CHECK(calls() == 5);
+    CHECK(collector_generation(&c) == 5);
+
+    collector_destroy(&c);
+}
+
+int
+main(void)
+{
+    test_single_flight();
+    test_ttl();
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,61 @@
+#include <string.h>
+#include <libubox/blobmsg.h>
+#include "confwatch.h"
+#include "test.h"
+
+/* Whether an event of type with the field set to value marks the wireless watcher. */
+static bool
+matches(const char *type, const char *field, const char *value)
+{
+    struct config_watch w;
+    struct blob_buf b;
+
+    memset(&w, 0, sizeof(w));
+    memset(&b, 0, sizeof(b));
+    w.package = "wireless";
+    blob_buf_init(&b, 0);
+    if (field) {
+        blobmsg_add_string(&b, field, value);
+    }
+
+    config_watch_match(&w, type, b.head);
+    blob_buf_free(&b);
+
+    return w.pending;
+}
+
+static void
+test_match(void)
+{
+    /* procd notifies its subscribers with the package field. */
+    CHECK(matches("config.change", "package", "wireless"));
+    /* The broadcast event of other tools names the config. */
+    CHECK(matches("config.change", "config", "wireless"));
+
+    CHECK(!matches("config.change", "package", "network"));
+    CHECK(!matches("config.change", "config", "wireless.radio0"));
+    CHECK(!matches("config.change", "name", "wireless"));
+    CHECK(!matches("config.change", NULL, NULL));
+    CHECK(!matches("service.update", "package", "wireless"));
+}
+
+/* An event without a message is ignored. */
+static void
+test_no_message(void)
+{
+    struct config_watch w;
+
+    memset(&w, 0, sizeof(w));
+    w.package = "wireless";
+    config_watch_match(&w, "config.change", NULL);
+    CHECK(!w.pending);
+}
+
+int
+main(void)
+{
+    test_match();
+    test_no_message();
+
+    return TEST_RESULT;
+}
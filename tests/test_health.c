@@ -0,0 +1,84 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "sysrepo.h"
+#include "health.h"
+#include "test.h"
+
+/* Replace one of the /proc files by a fixture. */
+static void
+use_file(int *fd, const char *name)
+{
+    char path[256];
+
+    if (*fd >= 0) {
+        close(*fd);
+    }
+    snprintf(path, sizeof(path), "%s/%s", TEST_DATA_DIR, name);
+    *fd = open(path, O_RDONLY | O_CLOEXEC);
+    CHECK(*fd >= 0);
+}
+
+static bool
+cpu_is(const struct cpu_usage *u, uint8_t usage, uint8_t user, uint8_t system, uint8_t iowait)
+{
+    return u->usage == usage && u->user == user && u->system == system && u->iowait == iowait;
+}
+
+static void
+test_collect(void)
+{
+    const struct health_sample *s;
+    struct health h;
+
+    memset(&h, 0, sizeof(h));
+    pthread_mutex_init(&h.lock, NULL);
+    h.loadavg_fd = h.meminfo_fd = h.uptime_fd = h.stat_fd = -1;
+    use_file(&h.loadavg_fd, "loadavg");
+    use_file(&h.meminfo_fd, "meminfo");
+    use_file(&h.uptime_fd, "uptime");
+    use_file(&h.stat_fd, "stat");
+
+    CHECK(SR_ERR_OK == health_collect(&h));
+    s = &h.sample;
+    CHECK(s->uptime == 12345);
+    CHECK(s->load[0] == 0.52 && s->load[1] == 0.34 && s->load[2] == 0.20);
+    /* Fields are matched at the start of a line, SwapCached is not Cached. */
+    CHECK(s->mem_total == 255288 && s->mem_free == 150000 && s->mem_available == 180000);
+    CHECK(s->mem_buffered == 4096 && s->mem_cached == 30000);
+    CHECK(s->swap_total == 8192 && s->swap_free == 4096);
+
+    /* The first sample is the usage since boot. */
+    CHECK(cpu_is(&s->all, 20, 10, 10, 10));
+    CHECK(s->n_cpus == 2);
+    CHECK(s->cpu[0].id == 0 && s->cpu[1].id == 1);
+
+    /* Later samples are the usage since the one before. */
+    use_file(&h.stat_fd, "stat.later");
+    CHECK(SR_ERR_OK == health_collect(&h));
+    CHECK(cpu_is(&s->all, 30, 20, 10, 10));
+    CHECK(s->n_cpus == 2);
+    CHECK(cpu_is(&s->cpu[0], 50, 40, 10, 10));
+    CHECK(cpu_is(&s->cpu[1], 10, 0, 10, 10));
+
+    /* Counters that went back restart from boot. */
+    use_file(&h.stat_fd, "stat");
+    CHECK(SR_ERR_OK == health_collect(&h));
+    CHECK(cpu_is(&s->all, 20, 10, 10, 10));
+
+    /* An unreadable file fails the sample and keeps the last one. */
+    close(h.loadavg_fd);
+    h.loadavg_fd = -1;
+    CHECK(SR_ERR_OK != health_collect(&h));
+    CHECK(s->mem_total == 255288);
+
+    health_free(&h);
+}
+
+int
+main(void)
+{
+    test_collect();
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,431 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sysrepo.h"
+#include "leases.h"
+#include "test.h"
+
+#define NOW 1000
+
+/* Lease pointing at the given strings, freed with free() alone. */
+static void
+lease_put(struct list_head *list, const char *id, const char *expiry, const char *ip)
+{
+    struct dhcp_lease *lease = calloc(1, sizeof(*lease));
+
+    if (!lease) {
+        abort();
+    }
+    lease->id = (char *) id;
+    lease->lease_expirey = (char *) expiry;
+    lease->ip = (char *) ip;
+    list_add_tail(&lease->head, list);
+}
+
+static void
+lease_clear(struct list_head *list)
+{
+    struct dhcp_lease *lease, *tmp;
+
+    list_for_each_entry_safe(lease, tmp, list, head) {
+        list_del(&lease->head);
+        free(lease);
+    }
+}
+
+/* Events reported by lease_diff, as "<event> <id>" lines. */
+static char events[512];
+
+static void
+event_cb(enum lease_event event, const struct dhcp_lease *lease, void *priv)
+{
+    size_t len = strlen(events);
+
+    snprintf(events + len, sizeof(events) - len, "%s %s\n", lease_event_name(event), lease->id);
+}
+
+static void
+test_diff(void)
+{
+    struct list_head old = LIST_HEAD_INIT(old), new = LIST_HEAD_INIT(new);
+
+    lease_put(&old, "kept", "2000", "10.0.0.1");
+    lease_put(&old, "renewed", "1500", "10.0.0.2");
+    lease_put(&old, "moved", "1500", "10.0.0.3");
+    lease_put(&old, "released", "1500", "10.0.0.4");
+    lease_put(&old, "expired", "900", "10.0.0.5");
+    lease_put(&old, "infinite", "0", "10.0.0.6");
+
+    /* Listed in another order, leases are matched by client. */
+    lease_put(&new, "moved", "1500", "10.0.0.33");
+    lease_put(&new, "added", "3000", "10.0.0.7");
+    lease_put(&new, "renewed", "2500", "10.0.0.2");
+    lease_put(&new, "kept", "2000", "10.0.0.1");
+
+    events[0] = 0;
+    CHECK(SR_ERR_OK == lease_diff(&old, &new, NOW, event_cb, NULL));
+    CHECK(!strcmp(events,
+                  "added added\n"
+                  "expired expired\n"
+                  "released infinite\n"
+                  "renewed moved\n"
+                  "released released\n"
+                  "renewed renewed\n"));
+
+    /* Nothing changed, nothing to report. */
+    events[0] = 0;
+    CHECK(SR_ERR_OK == lease_diff(&new, &new, NOW, event_cb, NULL));
+    CHECK(!events[0]);
+
+    lease_clear(&old);
+    lease_clear(&new);
+}
+
+/* Pool of the collector under test, NULL without a lease limit. */
+static struct pool *merged_pool;
+
+static void
+table_clear(struct list_head *list)
+{
+    struct dhcp_lease *lease, *tmp;
+
+    list_for_each_entry_safe(lease, tmp, list, head) {
+        list_del(&lease->head);
+        pool_entry_free(merged_pool, MODEL_DHCP_LEASES, lease);
+    }
+}
+
+static bool
+str_eq(const char *a, const char *b)
+{
+    return a && b ? !strcmp(a, b) : a == b;
+}
+
+static bool
+lease_is(const struct dhcp_lease *l, const char *id, const char *expiry, const char *mac,
+         const char *ip, const char *name, const char *family, const char *source)
+{
+    return str_eq(l->id, id) && str_eq(l->lease_expirey, expiry) && str_eq(l->mac, mac) &&
+           str_eq(l->ip, ip) && str_eq(l->name, name) && str_eq(l->family, family) &&
+           str_eq(l->source, source);
+}
+
+/* Parse text with the parser of type into table, returns the number of leases. */
+static size_t
+parse_table(const char *type, const char *text, struct lease_table *table)
+{
+    const struct lease_parser *parser = lease_parser_find(type);
+    struct list_head *pos;
+    size_t n = 0;
+    FILE *fd;
+
+    CHECK(parser);
+    fd = fmemopen((void *) text, strlen(text), "r");
+    CHECK(fd);
+    if (!parser || !fd) {
+        return 0;
+    }
+    CHECK(SR_ERR_OK == parser->parse(fd, table));
+    fclose(fd);
+    list_for_each(pos, table->leases) {
+        n++;
+    }
+
+    return n;
+}
+
+static size_t
+parse(const char *type, const char *text, struct list_head *list)
+{
+    struct lease_table table = { .leases = list, .source = type };
+
+    return parse_table(type, text, &table);
+}
+
+static void
+test_dnsmasq(void)
+{
+    struct list_head list = LIST_HEAD_INIT(list);
+    struct dhcp_lease *l;
+
+    CHECK(4 == parse("dnsmasq",
+                     "1700000100 00:11:22:33:44:01 192.168.1.101 laptop 01:00:11:22:33:44:01\n"
+                     "1700000200 00:11:22:33:44:02 192.168.1.102 * *\n"
+                     "1700000250 00:11:22:33:44:09 192.168.1.109\n"
+                     "0 00:11:22:33:44:04 192.168.1.104 printer 01:00:11:22:33:44:04  \r\n"
+                     "duid 00:01:00:01:aa:bb:cc:dd:00:11:22:33:44:55\n"
+                     "1700000300 1234 fd00::101 phone 00:04:aa\n",
+                     &list));
+
+    l = list_first_entry(&list, struct dhcp_lease, head);
+    CHECK(lease_is(l, "01:00:11:22:33:44:01", "1700000100", "00:11:22:33:44:01", "192.168.1.101",
+                   "laptop", "ipv4", "dnsmasq"));
+    /* Without a client id the client is its MAC. */
+    l = list_entry(l->head.next, struct dhcp_lease, head);
+    CHECK(lease_is(l, "00:11:22:33:44:02", "1700000200", "00:11:22:33:44:02", "192.168.1.102",
+                   "*", "ipv4", "dnsmasq"));
+    /* The short line is skipped, trailing blanks are not part of the id. */
+    l = list_entry(l->head.next, struct dhcp_lease, head);
+    CHECK(lease_is(l, "01:00:11:22:33:44:04", "0", "00:11:22:33:44:04", "192.168.1.104",
+                   "printer", "ipv4", "dnsmasq"));
+    /* Behind the duid line come DHCPv6 leases, without a MAC. */
+    l = list_entry(l->head.next, struct dhcp_lease, head);
+    CHECK(lease_is(l, "00:04:aa/1234", "1700000300", NULL, "fd00::101", "phone", "ipv6",
+                   "dnsmasq"));
+
+    table_clear(&list);
+}
+
+static void
+test_odhcpd(void)
+{
+    struct list_head list = LIST_HEAD_INIT(list);
+    struct dhcp_lease *l;
+
+    CHECK(3 == parse("odhcpd",
+                     "# br-lan 00:04:aa 5678 phone 1700000500 1 128 fd00::101/128 fd00::102/64\n"
+                     "# br-lan 00:04:aa 1a phone 1700000600 1 64 fd00:1::/64\n"
+                     "# br-lan 00:11:22:33:44:02 ipv4 - -1 1 32 192.168.1.102/32\n"
+                     "# br-lan 00:11:22:33:44:05 ipv4 short\n"
+                     "192.168.1.1 router\n",
+                     &list));
+
+    /* All addresses of an assignment in one leaf, without prefix lengths. */
+    l = list_first_entry(&list, struct dhcp_lease, head);
+    CHECK(lease_is(l, "00:04:aa/22136", "1700000500", NULL, "fd00::101 fd00::102", "phone",
+                   "ipv6", "odhcpd"));
+    /* Each IA of a client is a lease of its own, the IAID is read as hex. */
+    l = list_entry(l->head.next, struct dhcp_lease, head);
+    CHECK(lease_is(l, "00:04:aa/26", "1700000600", NULL, "fd00:1::", "phone", "ipv6", "odhcpd"));
+    /* An infinite lease is 0 as with dnsmasq, a missing hostname "*". */
+    l = list_entry(l->head.next, struct dhcp_lease, head);
+    CHECK(lease_is(l, "00:11:22:33:44:02", "0", "00:11:22:33:44:02", "192.168.1.102", "*", "ipv4",
+                   "odhcpd"));
+
+    table_clear(&list);
+    CHECK(!lease_parser_find("isc"));
+}
+
+/* Update callback of the collector, keeps the merged leases in priv. */
+static void
+update_cb(struct list_head *leases, void *priv)
+{
+    struct list_head *merged = priv;
+
+    table_clear(merged);
+    list_splice_init(leases, merged);
+}
+
+static void
+test_merge(void)
+{
+    struct list_head merged = LIST_HEAD_INIT(merged);
+    struct lease_collector c;
+    struct dhcp_lease *l;
+    struct list_head *pos;
+    size_t n = 0;
+
+    lease_collector_init(&c, update_cb, &merged);
+    CHECK(SR_ERR_OK == lease_collector_add(&c, "dnsmasq", "dnsmasq", TEST_DATA_DIR "/dnsmasq.leases"));
+    CHECK(SR_ERR_OK == lease_collector_add(&c, "odhcpd", "odhcpd", TEST_DATA_DIR "/odhcpd.leases"));
+    CHECK(SR_ERR_OK == lease_collector_add(&c, "gone", "dnsmasq", TEST_DATA_DIR "/missing.leases"));
+    CHECK(SR_ERR_OK != lease_collector_add(&c, "isc", "isc", TEST_DATA_DIR "/dhcpd.leases"));
+    CHECK(SR_ERR_OK == lease_collector_reload(&c));
+
+    /* One lease per client, sorted by client; the one lasting longest wins. */
+    list_for_each(pos, &merged) {
+        n++;
+    }
+    CHECK(n == 4);
+    if (n == 4) {
+        l = list_first_entry(&merged, struct dhcp_lease, head);
+        CHECK(lease_is(l, "00:04:aa/1234", "1700000500", NULL, "fd00::101 fd00::102", "phone",
+                       "ipv6", "odhcpd"));
+        l = list_entry(l->head.next, struct dhcp_lease, head);
+        CHECK(lease_is(l, "00:11:22:33:44:02", "0", "00:11:22:33:44:02", "192.168.1.102", "*",
+                       "ipv4", "odhcpd"));
+        l = list_entry(l->head.next, struct dhcp_lease, head);
+        CHECK(lease_is(l, "00:11:22:33:44:03", "1700000010", "00:11:22:33:44:03", "192.168.1.103",
+                       "tv", "ipv4", "odhcpd"));
+        l = list_entry(l->head.next, struct dhcp_lease, head);
+        CHECK(lease_is(l, "01:00:11:22:33:44:01", "1700000100", "00:11:22:33:44:01",
+                       "192.168.1.101", "laptop", "ipv4", "dnsmasq"));
+    }
+
+    lease_collector_free(&c);
+    table_clear(&merged);
+}
+
+/* A full table keeps the leases that last longest, 0 never expires. */
+static void
+test_table_limit(void)
+{
+    struct list_head list = LIST_HEAD_INIT(list);
+    struct dhcp_lease *heap[3], *l;
+    struct lease_table table = {
+        .leases = &list,
+        .source = "dnsmasq",
+        .limit = 3,
+        .heap = heap,
+    };
+    const char *kept[] = { "b", "d", "f" };
+    size_t i = 0;
+
+    CHECK(3 == parse_table("dnsmasq",
+                           "500 00:00:00:00:00:0a 10.0.0.1 * a\n"
+                           "0 00:00:00:00:00:0b 10.0.0.2 * b\n"
+                           "300 00:00:00:00:00:0c 10.0.0.3 * c\n"
+                           "900 00:00:00:00:00:0d 10.0.0.4 * d\n"
+                           "100 00:00:00:00:00:0e 10.0.0.5 * e\n"
+                           "700 00:00:00:00:00:0f 10.0.0.6 * f\n",
+                           &table));
+    CHECK(table.evicted == 3 && table.dropped == 0);
+    list_for_each_entry(l, &list, head) {
+        CHECK(i < 3 && !strcmp(l->id, kept[i]));
+        i++;
+    }
+    /* The heap has the lease expiring first on top. */
+    CHECK(table.n == 3 && !strcmp(heap[0]->id, "f"));
+
+    table_clear(&list);
+}
+
+/* With a limit of one per source and merged, one lease is left of both files. */
+static void
+test_collector_limit(void)
+{
+    struct list_head merged = LIST_HEAD_INIT(merged);
+    struct lease_collector c;
+    struct dhcp_lease *l;
+    struct pool pool;
+    int i;
+
+    lease_collector_init(&c, update_cb, &merged);
+    CHECK(SR_ERR_OK == lease_collector_add(&c, "dnsmasq", "dnsmasq", TEST_DATA_DIR "/dnsmasq.leases"));
+    CHECK(SR_ERR_OK == lease_collector_add(&c, "odhcpd", "odhcpd", TEST_DATA_DIR "/odhcpd.leases"));
+    CHECK(SR_ERR_OK == lease_collector_set_limit(&c, &pool, 1));
+    merged_pool = &pool;
+
+    /* Counts of left-out leases stay the same however often the sources are read. */
+    for (i = 0; i < 3; i++) {
+        CHECK(SR_ERR_OK == lease_collector_reload(&c));
+        CHECK(atomic_load(&c.evicted) == 5 && atomic_load(&c.dropped) == 0);
+    }
+    CHECK(!list_empty(&merged) && merged.next->next == &merged);
+    if (!list_empty(&merged)) {
+        l = list_first_entry(&merged, struct dhcp_lease, head);
+        CHECK(!strcmp(l->id, "00:11:22:33:44:02") && !strcmp(l->lease_expirey, "0"));
+        CHECK(pool_owns(&pool, l));
+    }
+
+    lease_collector_free(&c);
+    table_clear(&merged);
+    CHECK(pool.used == 0);
+    merged_pool = NULL;
+    pool_destroy(&pool);
+}
+
+/* Counts the changes reported by a watcher. */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int calls;
+} watched = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void
+watched_cb(void *priv)
+{
+    pthread_mutex_lock(&watched.lock);
+    watched.calls++;
+    pthread_cond_broadcast(&watched.cond);
+    pthread_mutex_unlock(&watched.lock);
+}
+
+/* Wait up to a few seconds for the watcher to report a change. */
+static bool
+watched_wait(void)
+{
+    struct timespec until;
+    int rc = 0;
+    bool seen;
+
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += 5;
+    pthread_mutex_lock(&watched.lock);
+    while (!watched.calls && !rc) {
+        rc = pthread_cond_timedwait(&watched.cond, &watched.lock, &until);
+    }
+    seen = watched.calls > 0;
+    watched.calls = 0;
+    pthread_mutex_unlock(&watched.lock);
+
+    return seen;
+}
+
+static void
+write_file(const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    CHECK(f != NULL);
+    if (f) {
+        fputs("1 02:00:00:00:00:01 192.168.1.10 host *\n", f);
+        fclose(f);
+    }
+}
+
+/* The directory of the lease file is created after the watcher started. */
+static void
+test_watch_missing_dir(void)
+{
+    char top[] = "/tmp/test_leases.XXXXXX";
+    char sub[64], dir[96], path[128];
+    struct lease_watcher w;
+
+    CHECK(mkdtemp(top) != NULL);
+    snprintf(sub, sizeof(sub), "%s/run", top);
+    snprintf(dir, sizeof(dir), "%s/dnsmasq", sub);
+    snprintf(path, sizeof(path), "%s/dhcp.leases", dir);
+
+    CHECK(SR_ERR_OK == lease_watcher_start(&w, path, watched_cb, NULL));
+    CHECK(0 == mkdir(sub, 0700));
+    CHECK(0 == mkdir(dir, 0700));
+    CHECK(watched_wait());
+    write_file(path);
+    CHECK(watched_wait());
+
+    /* Without its directory the file is gone, a new one is found again. */
+    CHECK(0 == unlink(path));
+    CHECK(watched_wait());
+    CHECK(0 == rmdir(dir));
+    CHECK(watched_wait());
+    CHECK(0 == mkdir(dir, 0700));
+    write_file(path);
+    CHECK(watched_wait());
+    lease_watcher_stop(&w);
+
+    unlink(path);
+    rmdir(dir);
+    rmdir(sub);
+    rmdir(top);
+}
+
+int
+main(void)
+{
+    test_diff();
+    test_dnsmasq();
+    test_odhcpd();
+    test_merge();
+    test_table_limit();
+    test_collector_limit();
+    test_watch_missing_dir();
+
+    return TEST_RESULT;
+}
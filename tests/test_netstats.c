@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include "sysrepo.h"
+#include "sysrepo/values.h"
+#include "netstats.h"
+#include "test.h"
+
+#define IFACES_XPATH "/status:interfaces/interface"
+
+static void
+iface_init(struct netstats_iface *ifc, const char *name)
+{
+    size_t i;
+
+    memset(ifc, 0, sizeof(*ifc));
+    snprintf(ifc->name, sizeof(ifc->name), "%s", name);
+    for (i = 0; i < NETSTAT_COUNT; i++) {
+        ifc->fd[i] = -1;
+    }
+}
+
+/* Add a sample as the sampler thread would. */
+static void
+sample(struct netstats_iface *ifc, int64_t ms, uint64_t rx_bytes, uint64_t tx_bytes)
+{
+    struct netstats_sample *s = &ifc->ring[ifc->n_samples++ % NETSTATS_RING_LEN];
+
+    memset(s, 0, sizeof(*s));
+    s->ms = ms;
+    s->v[NETSTAT_RX_BYTES] = rx_bytes;
+    s->v[NETSTAT_TX_BYTES] = tx_bytes;
+}
+
+/* Value of a leaf of the interface entry, UINT64_MAX when it is missing. */
+static uint64_t
+leaf(const sr_val_t *values, size_t cnt, const char *iface, const char *name)
+{
+    char xpath[128];
+    size_t i;
+
+    snprintf(xpath, sizeof(xpath), IFACES_XPATH "[name='%s']/%s", iface, name);
+    for (i = 0; i < cnt; i++) {
+        if (values[i].xpath && !strcmp(values[i].xpath, xpath)) {
+            return values[i].data.uint64_val;
+        }
+    }
+
+    return UINT64_MAX;
+}
+
+static void
+test_rates(void)
+{
+    struct netstats_iface ifaces[2];
+    struct netstats ns;
+    sr_val_t *values = NULL;
+    size_t cnt = 0;
+    int i;
+
+    memset(&ns, 0, sizeof(ns));
+    pthread_mutex_init(&ns.lock, NULL);
+    ns.ifaces = ifaces;
+    ns.n_ifaces = 2;
+    iface_init(&ifaces[0], "eth0");
+    iface_init(&ifaces[1], "wlan0");
+
+    /*
+     * A sample a second over more seconds than the ring holds: 1000 bytes a
+     * second received and 10000 more within the last one, the sent bytes went
+     * back with the last sample.
+     */
+    for (i = 0; i < 70; i++) {
+        sample(&ifaces[0], i * 1000, i * 1000 + (i == 69 ? 10000 : 0), i == 69 ? 0 : 5000);
+    }
+
+    CHECK(SR_ERR_OK == netstats_build(IFACES_XPATH, &ns, &values, &cnt));
+    /* The interface without samples is left out. */
+    CHECK(cnt == 13);
+    CHECK(leaf(values, cnt, "eth0", "rx-bytes") == 79000);
+    CHECK(leaf(values, cnt, "eth0", "rx-rate-1s") == 11000 * 8);
+    CHECK(leaf(values, cnt, "eth0", "rx-rate-10s") == 20000 * 8 / 10);
+    CHECK(leaf(values, cnt, "eth0", "rx-rate-60s") == 70000 * 8 / 60);
+    CHECK(leaf(values, cnt, "eth0", "tx-rate-1s") == 0);
+    CHECK(leaf(values, cnt, "wlan0", "rx-bytes") == UINT64_MAX);
+    sr_free_values(values, cnt);
+
+    /* With fewer samples than a window, the rate covers the samples there are. */
+    sample(&ifaces[1], 0, 0, 0);
+    sample(&ifaces[1], 1000, 0, 0);
+    sample(&ifaces[1], 3000, 0, 3000);
+    CHECK(SR_ERR_OK == netstats_build(IFACES_XPATH, &ns, &values, &cnt));
+    CHECK(cnt == 26);
+    CHECK(leaf(values, cnt, "wlan0", "tx-rate-1s") == 3000 * 8 / 2);
+    CHECK(leaf(values, cnt, "wlan0", "tx-rate-60s") == 3000 * 8 / 3);
+    sr_free_values(values, cnt);
+
+    /* A single sample has no rate yet. */
+    iface_init(&ifaces[1], "wlan0");
+    sample(&ifaces[1], 0, 100, 100);
+    CHECK(SR_ERR_OK == netstats_build(IFACES_XPATH, &ns, &values, &cnt));
+    CHECK(leaf(values, cnt, "wlan0", "rx-bytes") == 100);
+    CHECK(leaf(values, cnt, "wlan0", "rx-rate-1s") == 0);
+    sr_free_values(values, cnt);
+
+    /* Other nodes of the subtree have no values. */
+    CHECK(SR_ERR_OK == netstats_build("/status:interfaces", &ns, &values, &cnt));
+    CHECK(!values && !cnt);
+
+    pthread_mutex_destroy(&ns.lock);
+}
+
+int
+main(void)
+{
+    test_rates();
+
+    return TEST_RESULT;
+}
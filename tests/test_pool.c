@@ -0,0 +1,97 @@
+#include <string.h>
+#include "sysrepo.h"
+#include "pool.h"
+#include "test.h"
+
+#define SLOT_STRINGS 64
+
+static const struct dhcp_lease lease = {
+    .lease_expirey = "1700000100",
+    .mac = "00:11:22:33:44:01",
+    .ip = "192.168.1.101",
+    .id = "01:00:11:22:33:44:01",
+    .family = "ipv4",
+};
+
+static bool
+lease_equal(const struct dhcp_lease *a, const struct dhcp_lease *b)
+{
+    return !strcmp(a->lease_expirey, b->lease_expirey) && !strcmp(a->mac, b->mac) &&
+           !strcmp(a->ip, b->ip) && !a->name && !strcmp(a->id, b->id) &&
+           !strcmp(a->family, b->family) && !a->source;
+}
+
+static void
+test_slots(void)
+{
+    struct pool p;
+    void *a, *b, *c;
+
+    CHECK(SR_ERR_OK == pool_init(&p, 1, 2));
+    CHECK(p.slot_size >= sizeof(void *));
+    a = pool_get(&p);
+    b = pool_get(&p);
+    CHECK(a && b && a != b);
+    CHECK(!pool_get(&p));
+    CHECK(pool_owns(&p, a) && pool_owns(&p, b));
+    CHECK(!pool_owns(&p, &p) && !pool_owns(NULL, a));
+
+    /* A returned slot is handed out again, zeroed. */
+    memset(a, 0xff, p.slot_size);
+    pool_put(&p, a);
+    CHECK(p.used == 1);
+    c = pool_get(&p);
+    CHECK(c == a && !*(char *) c);
+    pool_destroy(&p);
+}
+
+static void
+test_entry_dup(void)
+{
+    struct dhcp_lease *first, *second, *heap, big = lease;
+    char name[2 * SLOT_STRINGS];
+    struct pool p;
+
+    CHECK(SR_ERR_OK == pool_init(&p, sizeof(struct dhcp_lease) + SLOT_STRINGS, 2));
+
+    /* Pooled copies keep their strings inside the slot. */
+    first = pool_entry_dup(&p, MODEL_DHCP_LEASES, &lease);
+    CHECK(first && lease_equal(first, &lease));
+    CHECK(first && pool_owns(&p, first->ip) && pool_owns(&p, first->family));
+    CHECK(first && first->ip != lease.ip);
+
+    /* Strings that do not fit leave the entry out, the pool stays as it was. */
+    memset(name, 'x', sizeof(name) - 1);
+    name[sizeof(name) - 1] = 0;
+    big.name = name;
+    CHECK(!pool_entry_dup(&p, MODEL_DHCP_LEASES, &big));
+    CHECK(p.used == 1);
+
+    second = pool_entry_dup(&p, MODEL_DHCP_LEASES, &lease);
+    CHECK(second && !pool_entry_dup(&p, MODEL_DHCP_LEASES, &lease));
+
+    /* Without a pool the copy and its strings are on the heap. */
+    heap = pool_entry_dup(NULL, MODEL_DHCP_LEASES, &big);
+    CHECK(heap && !pool_owns(&p, heap) && heap->name != name && !strcmp(heap->name, name));
+
+    /* Either kind is freed to where it came from. */
+    pool_entry_free(&p, MODEL_DHCP_LEASES, heap);
+    pool_entry_free(&p, MODEL_DHCP_LEASES, first);
+    CHECK(p.used == 1);
+    first = pool_entry_dup(&p, MODEL_DHCP_LEASES, &lease);
+    CHECK(first && lease_equal(first, &lease));
+    pool_entry_free(&p, MODEL_DHCP_LEASES, first);
+    pool_entry_free(&p, MODEL_DHCP_LEASES, second);
+    CHECK(p.used == 0);
+
+    pool_destroy(&p);
+}
+
+int
+main(void)
+{
+    test_slots();
+    test_entry_dup();
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,178 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "shm.h"
+#include "test.h"
+
+#define WRITER_UPDATES 2000
+
+static char shm_name[64];
+
+static struct list_head leases = LIST_HEAD_INIT(leases);
+static struct list_head devs = LIST_HEAD_INIT(devs);
+static struct list_head ifs = LIST_HEAD_INIT(ifs);
+static struct model model = {
+    .leases = &leases,
+    .wifi_devs = &devs,
+    .wifi_ifs = &ifs,
+};
+
+static struct dhcp_lease lease_slots[STATUS_SHM_MAX_LEASES + 2];
+
+/* The first n lease slots as the model's leases. */
+static void
+set_leases(size_t n)
+{
+    size_t i;
+
+    INIT_LIST_HEAD(&leases);
+    for (i = 0; i < n; i++) {
+        list_add_tail(&lease_slots[i].head, &leases);
+    }
+}
+
+static void
+test_round_trip(void)
+{
+    struct board board = {
+        .hostname = "router",
+        .kernel = "5.15.0",
+        .release = { .distribution = "OpenWrt" },
+    };
+    struct wifi_device dev = { .name = "radio0", .channel = "36", .disabled = "1" };
+    struct wifi_iface ifc = { .name = "wlan0", .device = "radio0", .ssid = "home" };
+    static struct status_shm_data d;
+    struct status_shm_reader r;
+    struct shm_writer w, next;
+    uint32_t generation;
+
+    CHECK(-ENOENT == status_shm_open(&r, shm_name));
+    CHECK(SR_ERR_OK == shm_writer_open(&w, shm_name));
+    CHECK(0 == status_shm_open(&r, shm_name));
+
+    lease_slots[0] = (struct dhcp_lease) {
+        .lease_expirey = "1700000100", .mac = "00:11:22:33:44:01", .ip = "192.168.1.101",
+        .name = "laptop", .family = "ipv4", .source = "dnsmasq",
+    };
+    lease_slots[1] = (struct dhcp_lease) {
+        .lease_expirey = "0", .ip = "fd00::101", .name = "phone", .family = "ipv6",
+        .source = "odhcpd",
+    };
+    set_leases(2);
+    list_add_tail(&dev.head, &devs);
+    list_add_tail(&ifc.head, &ifs);
+    model.board = &board;
+
+    shm_writer_publish(&w, &model);
+    CHECK(status_shm_generation(&r) == 1);
+    CHECK(0 == status_shm_read(&r, &d, &generation));
+    CHECK(generation == 1);
+    CHECK(!strcmp(d.board.hostname, "router") && !strcmp(d.board.distribution, "OpenWrt"));
+    CHECK(!strcmp(d.board.system, ""));
+    CHECK(d.n_leases == 2 && d.dropped_leases == 0);
+    CHECK(d.leases[0].expiry == 1700000100 && d.leases[0].family == 4);
+    CHECK(!strcmp(d.leases[0].mac, "00:11:22:33:44:01") && !strcmp(d.leases[0].name, "laptop"));
+    CHECK(d.leases[1].expiry == 0 && d.leases[1].family == 6 && !strcmp(d.leases[1].mac, ""));
+    CHECK(d.n_wifi_devices == 1 && d.wifi_devices[0].disabled);
+    CHECK(!strcmp(d.wifi_devices[0].channel, "36"));
+    CHECK(d.n_wifi_ifaces == 1 && !strcmp(d.wifi_ifaces[0].ssid, "home"));
+
+    /* While the counter is odd the writer is updating, every copy is retried. */
+    w.shm->seq++;
+    CHECK(-EAGAIN == status_shm_read(&r, &d, &generation));
+    w.shm->seq++;
+    CHECK(0 == status_shm_read(&r, &d, &generation));
+    CHECK(generation == 2);
+
+    /* Leases beyond the segment are counted. */
+    set_leases(STATUS_SHM_MAX_LEASES + 2);
+    shm_writer_publish(&w, &model);
+    CHECK(0 == status_shm_read(&r, &d, &generation));
+    CHECK(generation == 3);
+    CHECK(d.n_leases == STATUS_SHM_MAX_LEASES && d.dropped_leases == 2);
+
+    /* A writer that died while updating is taken over with the next generation. */
+    w.shm->seq++;
+    CHECK(SR_ERR_OK == shm_writer_open(&next, shm_name));
+    CHECK(status_shm_generation(&r) == 4);
+    CHECK(0 == status_shm_read(&r, &d, &generation));
+    CHECK(d.n_leases == STATUS_SHM_MAX_LEASES);
+    shm_writer_close(&next);
+
+    status_shm_close(&r);
+    shm_writer_close(&w);
+    CHECK(-ENOENT == status_shm_open(&r, shm_name));
+
+    INIT_LIST_HEAD(&devs);
+    INIT_LIST_HEAD(&ifs);
+    model.board = NULL;
+}
+
+/* Updates the leases, all of them named after their count. */
+static void *
+writer_thread(void *arg)
+{
+    struct shm_writer *w = arg;
+    char name[16];
+    size_t i, j, n;
+
+    for (i = 1; i <= WRITER_UPDATES; i++) {
+        n = i % (STATUS_SHM_MAX_LEASES + 1);
+        snprintf(name, sizeof(name), "%zu", n);
+        for (j = 0; j < n; j++) {
+            lease_slots[j].name = name;
+        }
+        set_leases(n);
+        shm_writer_publish(w, &model);
+    }
+
+    return NULL;
+}
+
+/* Copies taken while the writer updates are never torn. */
+static void
+test_concurrent(void)
+{
+    static struct status_shm_data d;
+    struct status_shm_reader r;
+    struct shm_writer w;
+    pthread_t thread;
+    uint32_t generation = 0, i;
+    int torn = 0;
+
+    memset(lease_slots, 0, sizeof(lease_slots));
+    CHECK(SR_ERR_OK == shm_writer_open(&w, shm_name));
+    CHECK(0 == status_shm_open(&r, shm_name));
+    pthread_create(&thread, NULL, writer_thread, &w);
+
+    do {
+        if (status_shm_read(&r, &d, &generation)) {
+            continue;
+        }
+        for (i = 0; i < d.n_leases; i++) {
+            if ((uint32_t) atoi(d.leases[i].name) != d.n_leases) {
+                torn++;
+                break;
+            }
+        }
+    } while (generation < WRITER_UPDATES);
+
+    pthread_join(thread, NULL);
+    CHECK(!torn);
+    status_shm_close(&r);
+    shm_writer_close(&w);
+}
+
+int
+main(void)
+{
+    snprintf(shm_name, sizeof(shm_name), "/status-test-%d", (int) getpid());
+
+    test_round_trip();
+    test_concurrent();
+
+    return TEST_RESULT;
+}
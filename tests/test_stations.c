@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sysrepo.h"
+#include "stations.h"
+#include "test.h"
+
+/* data/stations.pcap, written by data/stations.py. */
+static void
+test_replay(void)
+{
+    struct station_monitor m;
+    struct station *stations = NULL;
+    size_t n = 0;
+
+    CHECK(SR_ERR_OK == station_monitor_start(&m, TEST_DATA_DIR "/stations.pcap", 0));
+    CHECK(m.family == 0x1c);
+    CHECK(SR_ERR_OK == station_monitor_copy(&m, "if4242", &stations, &n));
+
+    /* The second station left again, the one of the other family never counted. */
+    CHECK(n == 1);
+    if (n == 1) {
+        CHECK(!strcmp(stations[0].mac, "02:00:00:00:00:01"));
+        CHECK(stations[0].signal == -40);
+        CHECK(stations[0].inactive == 10);
+        CHECK(stations[0].connected_time == 30);
+    }
+    free(stations);
+    station_monitor_stop(&m);
+}
+
+static void
+test_replay_missing(void)
+{
+    struct station_monitor m;
+
+    CHECK(SR_ERR_OK != station_monitor_start(&m, TEST_DATA_DIR "/missing.pcap", 0));
+}
+
+int
+main(void)
+{
+    test_replay();
+    test_replay_missing();
+
+    return TEST_RESULT;
+}
@@ -0,0 +1,101 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sysrepo.h"
+#include "trace.h"
+#include "test.h"
+
+#define EXTRA_SPANS 10
+
+/* Occurrences of needle in the dump file name. */
+static int
+count_in_dump(const char *name, const char *needle)
+{
+    char path[512], line[256];
+    FILE *f;
+    int n = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", TRACE_DIR, name);
+    f = fopen(path, "r");
+    CHECK(f);
+    if (!f) {
+        return -1;
+    }
+    /* One event a line. */
+    while (fgets(line, sizeof(line), f)) {
+        if (strstr(line, needle)) {
+            n++;
+        }
+    }
+    fclose(f);
+
+    return n;
+}
+
+static void *
+short_thread(void *arg)
+{
+    trace_begin("test", "short");
+    trace_end("test", "short");
+
+    return NULL;
+}
+
+/* A thread keeps its latest events, each thread in a ring of its own. */
+static void
+test_wrap(void)
+{
+    pthread_t thread;
+    uint32_t n;
+    int i;
+
+    setenv(TRACE_ENV, "1", 1);
+    trace_init();
+
+    pthread_create(&thread, NULL, short_thread, NULL);
+    pthread_join(thread, NULL);
+
+    for (i = 0; i < EXTRA_SPANS; i++) {
+        trace_begin("test", "old");
+    }
+    for (i = 0; i < TRACE_RING_LEN / 2; i++) {
+        trace_begin("test", "new");
+        trace_end("test", "new");
+    }
+
+    /* The slot after the head may be rewritten during the copy and is left out. */
+    CHECK(SR_ERR_OK == trace_dump("wrap.json", &n));
+    CHECK(n == TRACE_RING_LEN - 1 + 2);
+    CHECK(count_in_dump("wrap.json", "\"name\":\"old\"") == 0);
+    CHECK(count_in_dump("wrap.json", "\"name\":\"new\"") == TRACE_RING_LEN - 1);
+    CHECK(count_in_dump("wrap.json", "\"name\":\"short\"") == 2);
+
+    /* A dump replaces the one of the same name. */
+    trace_begin("test", "last");
+    CHECK(SR_ERR_OK == trace_dump("wrap.json", &n));
+    CHECK(n == TRACE_RING_LEN - 1 + 2);
+    CHECK(count_in_dump("wrap.json", "\"name\":\"last\"") == 1);
+}
+
+/* Dumps stay in the trace directory. */
+static void
+test_names(void)
+{
+    uint32_t n;
+
+    CHECK(SR_ERR_INVAL_ARG == trace_dump("", &n));
+    CHECK(SR_ERR_INVAL_ARG == trace_dump("..", &n));
+    CHECK(SR_ERR_INVAL_ARG == trace_dump(".hidden", &n));
+    CHECK(SR_ERR_INVAL_ARG == trace_dump("../wrap.json", &n));
+    CHECK(SR_ERR_INVAL_ARG == trace_dump("sub/wrap.json", &n));
+}
+
+int
+main(void)
+{
+    test_wrap();
+    test_names();
+
+    return TEST_RESULT;
+}
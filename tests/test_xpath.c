@@ -0,0 +1,55 @@
+#include <string.h>
+#include "sysrepo.h"
+#include "xpath.h"
+#include "test.h"
+
+static void
+test_append_key(void)
+{
+    struct xpath_buf xb = {0};
+
+    CHECK(SR_ERR_OK == xpath_buf_append(&xb, "/status:wifi/wifi-iface"));
+    CHECK(SR_ERR_OK == xpath_buf_append_key(&xb, "name", "plain"));
+    CHECK(!strcmp(xb.buf, "/status:wifi/wifi-iface[name='plain']"));
+
+    xpath_buf_truncate(&xb, strlen("/status:wifi/wifi-iface"));
+    CHECK(SR_ERR_OK == xpath_buf_append_key(&xb, "name", "it's"));
+    CHECK(!strcmp(xb.buf, "/status:wifi/wifi-iface[name=\"it's\"]"));
+
+    xpath_buf_truncate(&xb, strlen("/status:wifi/wifi-iface"));
+    CHECK(SR_ERR_OK == xpath_buf_append_key(&xb, "name", "say \"hi\""));
+    CHECK(!strcmp(xb.buf, "/status:wifi/wifi-iface[name='say \"hi\"']"));
+
+    /* A value with both quotes can't be written, the xpath is left alone. */
+    xpath_buf_truncate(&xb, strlen("/status:wifi/wifi-iface"));
+    CHECK(SR_ERR_INVAL_ARG == xpath_buf_append_key(&xb, "name", "it's \"both\""));
+    CHECK(!strcmp(xb.buf, "/status:wifi/wifi-iface"));
+
+    xpath_buf_free(&xb);
+}
+
+static void
+test_list_key(void)
+{
+    const char *key;
+    size_t len = 0;
+
+    key = xpath_list_key("/status:wifi/wifi-iface[name=\"it's\"]/ssid", "wifi-iface", &len);
+    CHECK(key && len == 4 && !strncmp(key, "it's", len));
+
+    key = xpath_list_key("/status:wifi/wifi-iface[name='a\"b']/ssid", "wifi-iface", &len);
+    CHECK(key && len == 3 && !strncmp(key, "a\"b", len));
+
+    /* Only whole segments count, not a list whose name ends the same. */
+    CHECK(!xpath_list_key("/status:wifi/my-wifi-iface[name='x']", "wifi-iface", &len));
+    CHECK(!xpath_list_key("/status:wifi/wifi-iface", "wifi-iface", &len));
+}
+
+int
+main(void)
+{
+    test_append_key();
+    test_list_key();
+
+    return TEST_RESULT;
+}